@@ -171,7 +171,7 @@ void CodecExplorerApp::inspectBlockAt(int x, int y) {
         Image cr(ycrcb.width(), ycrcb.height(), 1);
         const double* src = ycrcb.data();
         double* dst = cr.data();
-        for(size_t i=0; i<ycrcb.width()*ycrcb.height(); ++i) dst[i] = src[i*3 + 1];
+        for(size_t i=0; i<static_cast<size_t>(ycrcb.width())*ycrcb.height(); ++i) dst[i] = src[i*3 + 1];
 
         m_inspectionData = codec.inspectBlock(cr, m_selectedBlockX, m_selectedBlockY, true);
 
@@ -180,7 +180,7 @@ void CodecExplorerApp::inspectBlockAt(int x, int y) {
         Image cb(ycrcb.width(), ycrcb.height(), 1);
         const double* src = ycrcb.data();
         double* dst = cb.data();
-        for(size_t i=0; i<ycrcb.width()*ycrcb.height(); ++i) dst[i] = src[i*3 + 2];
+        for(size_t i=0; i<static_cast<size_t>(ycrcb.width())*ycrcb.height(); ++i) dst[i] = src[i*3 + 2];
 
         m_inspectionData = codec.inspectBlock(cb, m_selectedBlockX, m_selectedBlockY, true);
     } else {
@@ -189,7 +189,7 @@ void CodecExplorerApp::inspectBlockAt(int x, int y) {
         Image y(ycrcb.width(), ycrcb.height(), 1);
         const double* src = ycrcb.data();
         double* dst = y.data();
-        for(size_t i=0; i<ycrcb.width()*ycrcb.height(); ++i) dst[i] = src[i*3 + 0];
+        for(size_t i=0; i<static_cast<size_t>(ycrcb.width())*ycrcb.height(); ++i) dst[i] = src[i*3 + 0];
 
         m_inspectionData = codec.inspectBlock(y, m_selectedBlockX, m_selectedBlockY, false);
     }
@@ -199,9 +199,13 @@ void CodecExplorerApp::inspectBlockAt(int x, int y) {
 
 void CodecExplorerApp::updateCodecOutput() {
     ImageCodec codec(m_quality, true, m_chromaSubsampling);
-    Image processedImage = codec.process(m_state.originalImage);
-    m_state.metrics = CodecAnalysis::computeMetrics(m_state.originalImage, processedImage);
-    m_state.processedYCrCb = bgrToYCrCb(processedImage);
+    // Quality changes reuse the cached forward transform, which is built
+    // straight from the loaded Mat's bytes.
+    if (!codec.canReconstruct(m_state.coeffCache))
+        codec.analyze(CvAdapter::packedView(m_state.originalCvMat), m_state.coeffCache);
+    codec.reconstruct(m_state.coeffCache, m_state.processedBgr);
+    CodecAnalysis::computeMetrics(m_state.originalImage, m_state.processedBgr, m_state.metrics);
+    bgrToYCrCb(m_state.processedBgr, m_state.processedYCrCb);
 }
 
 void CodecExplorerApp::render() {
@@ -38,6 +38,8 @@ private:
         cv::Mat originalCvMat;
         std::string windowName;
         ViewMode mode = ViewMode::RGB;
+        Image processedBgr;
+        ImageCodec::CoefficientCache coeffCache; // Forward transform of originalImage
         Image processedYCrCb;
         CodecMetrics metrics;
     };
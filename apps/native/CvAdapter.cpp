@@ -44,4 +44,22 @@ cv::Mat CvAdapter::imageToCvMat(const Image& img) {
         }
     }
     return mat;
+}
+
+static PixelLayout packedLayout(const cv::Mat& mat) {
+    if ((mat.depth() != CV_8U && mat.depth() != CV_16U) || (mat.channels() != 3 && mat.channels() != 4))
+        throw std::invalid_argument("Packed views need an 8- or 16-bit BGR or BGRA Mat");
+    if (mat.depth() == CV_16U)
+        return mat.channels() == 4 ? PixelLayout::BGRA16 : PixelLayout::BGR16;
+    return mat.channels() == 4 ? PixelLayout::BGRA8 : PixelLayout::BGR8;
+}
+
+ImageCodec::PackedImage CvAdapter::packedView(const cv::Mat& mat) {
+    if (mat.empty()) throw std::invalid_argument("Empty Mat");
+    return { mat.ptr<uchar>(0), mat.cols, mat.rows, mat.step[0], packedLayout(mat) };
+}
+
+ImageCodec::PackedTarget CvAdapter::packedTarget(cv::Mat& mat) {
+    if (mat.empty()) throw std::invalid_argument("Empty Mat");
+    return { mat.ptr<uchar>(0), mat.step[0], packedLayout(mat) };
 }
\ No newline at end of file
@@ -11,9 +11,16 @@
 
 #include <opencv2/opencv.hpp>
 #include "Image.h"
+#include "ImageCodec.h"
 
 class CvAdapter {
 public:
     static Image cvMatToImage(const cv::Mat& mat);
     static cv::Mat imageToCvMat(const Image& img);
+
+    // Non-owning views of an 8- or 16-bit BGR or BGRA Mat (row step
+    // included) for ImageCodec's packed entry points; no pixels are copied.
+    // 16-bit Mats need a codec set to their bit depth.
+    static ImageCodec::PackedImage packedView(const cv::Mat& mat);
+    static ImageCodec::PackedTarget packedTarget(cv::Mat& mat);
 };
\ No newline at end of file
@@ -19,6 +19,36 @@
 
 #include "Image.h"
 
+// Window SSIM is measured over. Box is a 9x9 uniform window centred on
+// every pixel, clipped at the border. Gaussian is the Wang et al. reference
+// window (11x11, sigma 1.5, evaluated where it fits inside the image), the
+// variant other tools report.
+enum class SsimWindow { Box, Gaussian };
+
+// What CodecAnalysis::computeMetrics() produces. `metrics` is a mask of the
+// flags below; values that were not asked for are left at 0 and an
+// unrequested artifact map is left untouched, so callers pay only for what
+// they read (e.g. PSNR_Y alone while a slider is being dragged).
+struct MetricsOptions {
+    enum : unsigned {
+        PSNR_Y       = 1u << 0,
+        PSNR_CR      = 1u << 1,
+        PSNR_CB      = 1u << 2,
+        SSIM_Y       = 1u << 3,
+        SSIM_CR      = 1u << 4,
+        SSIM_CB      = 1u << 5,
+        MSSSIM_Y     = 1u << 6,
+        ARTIFACT_MAP = 1u << 7,
+
+        PSNR = PSNR_Y | PSNR_CR | PSNR_CB,
+        SSIM = SSIM_Y | SSIM_CR | SSIM_CB,
+        DEFAULT_METRICS = PSNR | SSIM | ARTIFACT_MAP
+    };
+
+    unsigned metrics = DEFAULT_METRICS;
+    SsimWindow ssimWindow = SsimWindow::Box;
+};
+
 struct CodecMetrics {
     double psnrY = 0.0;
     double psnrCr = 0.0;
@@ -26,6 +56,7 @@ struct CodecMetrics {
     double ssimY = 0.0;
     double ssimCr = 0.0;
     double ssimCb = 0.0;
+    double msssimY = 0.0; // 0 unless requested and supported
     Image artifactMap;
 };
 
@@ -49,21 +80,79 @@ public:
         const Image& reconstructed
     );
 
-    // Compute PSNR (moved out of utils if you want)
+    // Compute PSNR. The peak is 2^bitDepth - 1 (255 for 8-bit samples).
     static double computePSNR(
         const Image& I1,
-        const Image& I2
+        const Image& I2,
+        int bitDepth = 8
     );
 
-    // Compute SSIM
+    // Compute SSIM over `window`, averaged over pixels and channels. Box
+    // windows cost O(1) each via summed-area tables; the Gaussian window is
+    // applied as separable convolutions of the moment planes, split into row
+    // bands across worker threads, and needs images of at least 11x11. The
+    // stabilising constants C1 = (0.01 L)^2 and C2 = (0.03 L)^2 use the
+    // dynamic range L = 2^bitDepth - 1.
     static double computeSSIM(
         const Image& I1,
-        const Image& I2
+        const Image& I2,
+        int bitDepth = 8,
+        SsimWindow window = SsimWindow::Box
+    );
+
+    // Compute MS-SSIM over five dyadic scales with the Gaussian window and
+    // the Wang et al. scale weights, averaged over channels. Throws
+    // std::invalid_argument unless supportsMSSSIM() holds for the size.
+    static double computeMSSSIM(
+        const Image& I1,
+        const Image& I2,
+        int bitDepth = 8
     );
 
-    // Compute all metrics
+    // True if images of this size are large enough for MS-SSIM: at least
+    // 176x176, so the window still fits at the coarsest scale.
+    static bool supportsMSSSIM(int width, int height);
+
+    // Compute all metrics on images with samples of `bitDepth` bits (see
+    // ImageCodec::setBitDepth()). The artifact map stays on the 0..255
+    // display scale whatever the depth. The results equal the per-channel
+    // functions above, but come from one sweep over the rows without
+    // storing colour-converted planes. The Gaussian SSIM window falls back
+    // to the box window on images smaller than 11x11, as MS-SSIM reads 0
+    // on images too small for it. Throws std::invalid_argument if the
+    // images differ in size.
     static CodecMetrics computeMetrics(
         const Image& originalBgr,
-        const Image& reconstructedBgr
+        const Image& reconstructedBgr,
+        int bitDepth = 8,
+        const MetricsOptions& options = MetricsOptions()
+    );
+
+    // Output-parameter variants of the above. Each writes into `out`, which is
+    // resized in place so a caller can keep reusing the same buffers per frame.
+    static void computeArtifactMap(
+        const Image& original,
+        const Image& reconstructed,
+        Image& out,
+        double gain = 5.0
+    );
+
+    static void computeEdgeDistortionMap(
+        const Image& original,
+        const Image& reconstructed,
+        Image& out
+    );
+
+    static void computeBlockingMap(
+        const Image& reconstructed,
+        Image& out
+    );
+
+    static void computeMetrics(
+        const Image& originalBgr,
+        const Image& reconstructedBgr,
+        CodecMetrics& out,
+        int bitDepth = 8,
+        const MetricsOptions& options = MetricsOptions()
     );
 };
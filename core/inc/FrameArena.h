@@ -0,0 +1,74 @@
+/*
+ * Codec Explorer: An interactive codec laboratory.
+ * Copyright (C) 2026 Abhinav Tanniru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/*
+ * FrameArena is a bump allocator for per-frame scratch buffers.
+ *
+ * Buffers carved with allocate() stay valid until the next reset(). The arena
+ * grows by appending blocks while a frame is in flight; reset() folds all
+ * blocks into a single one large enough for the whole frame, so once the
+ * largest frame has been seen, allocate()/reset() never touch the heap.
+ */
+class FrameArena {
+public:
+    FrameArena() = default;
+
+    // Returns an uninitialised buffer of `count` doubles, aligned to a
+    // 64-byte cache line.
+    double* allocate(size_t count);
+
+    // Same as allocate(), but the buffer is zero-filled.
+    double* allocateZeroed(size_t count);
+
+    // Releases every buffer handed out since the last reset.
+    void reset();
+
+    // Position returned by mark(); rewind() releases every buffer handed out
+    // after it, so a loop can reuse the same memory on each iteration.
+    struct Mark {
+        size_t block;
+        size_t offset;
+        size_t used;
+    };
+    Mark mark() const { return { m_block, m_offset, m_used }; }
+    void rewind(const Mark& mark);
+
+    // Total number of doubles the arena can serve without growing.
+    size_t capacity() const;
+
+    // Number of doubles handed out since the last reset.
+    size_t used() const { return m_used; }
+
+private:
+    // Heap block whose usable range starts on a 64-byte boundary.
+    struct Block {
+        explicit Block(size_t count);
+        std::unique_ptr<double[]> storage;
+        double* data;
+        size_t size;
+    };
+
+    std::vector<Block> m_blocks;
+    size_t m_block  = 0; // Index of the block currently being carved
+    size_t m_offset = 0; // Next free slot in m_blocks[m_block]
+    size_t m_used   = 0;
+};
@@ -74,8 +74,35 @@ public:
     int height() const { return m_height; }
     int channels() const { return m_channels; }
     size_t size() const { return m_data.size(); }
+    size_t capacity() const { return m_data.capacity(); }
     bool empty() const { return m_data.empty(); }
 
+    // --- Buffer Reuse ---
+    // Changes the dimensions in place. The underlying storage only grows when
+    // the new size exceeds the current capacity, so an image can be reused as
+    // an output buffer across frames. Pixel contents are unspecified afterwards.
+    void resize(int width, int height, int channels) {
+        if (width <= 0 || height <= 0 || channels <= 0)
+            throw std::invalid_argument("Invalid image dimensions");
+
+        m_width = width;
+        m_height = height;
+        m_channels = channels;
+        m_data.resize(static_cast<size_t>(width) * height * channels);
+    }
+
+    // Reinterprets the existing samples with new dimensions. The total number
+    // of samples must not change; no memory is touched.
+    void reshape(int width, int height, int channels) {
+        if (width <= 0 || height <= 0 || channels <= 0 ||
+            static_cast<size_t>(width) * height * channels != m_data.size())
+            throw std::invalid_argument("Reshape must preserve the sample count");
+
+        m_width = width;
+        m_height = height;
+        m_channels = channels;
+    }
+
     // --- Pixel Access ---
     // Note: Version 1 uses .at() in loops. For maximum speed, 
     // ensure your compiler inlines these calls.
@@ -91,6 +118,14 @@ public:
     double* data() { return m_data.data(); }
     const double* data() const { return m_data.data(); }
 
+    // Offset of sample (x, y, c) in a row-major interleaved buffer of the
+    // given width and channel count: (y * width + x) * channels + c. Widened
+    // before multiplying, since y * width alone overflows int beyond 2^31
+    // samples.
+    static size_t sampleOffset(int x, int y, int c, int width, int channels) {
+        return (static_cast<size_t>(y) * width + x) * channels + c;
+    }
+
 private:
     int m_width  = 0;
     int m_height = 0;
@@ -105,6 +140,6 @@ private:
             throw std::out_of_range("Image index out of range");
         }
 #endif
-        return static_cast<size_t>((y * m_width + x) * m_channels + c);
+        return sampleOffset(x, y, c, m_width, m_channels);
     }
 };
\ No newline at end of file
@@ -19,6 +19,11 @@
 #define IMAGE_PROCESSOR_H
 
 #include "Image.h"
+#include "FrameArena.h"
+#include "colorspace.h"
+#include <cstdint>
+#include <functional>
+#include <vector>
 
 /*
 * ImageCodec class encapsulates the functionality for compressing and decompressing images using
@@ -34,8 +39,66 @@ public:
     };
 
     enum class TransformType {
-        DCT, // Discrete Cosine Transform (JPEG-style)
-        DWT  // Haar Discrete Wavelet Transform
+        DCT,     // Discrete Cosine Transform (JPEG-style)
+        DWT,     // Haar Discrete Wavelet Transform
+        Adaptive // DCT, DWT or lossless skip chosen per region (see getRegionMap())
+    };
+
+    // Coding mode of one region under TransformType::Adaptive.
+    enum class RegionMode {
+        DCT,  // Block DCT
+        DWT,  // Haar DWT over the region
+        Skip  // Samples kept losslessly (DPCM-coded)
+    };
+
+    // Side of the square luma regions used by TransformType::Adaptive.
+    static constexpr int REGION_SIZE = 64;
+
+    enum class IntraMode {
+        DC,         // Mean of the available neighbours (128 when there are none)
+        Horizontal, // Each row repeats its left neighbour
+        Vertical,   // Each column repeats its top neighbour
+        Planar      // Blend of horizontal and vertical ramps (HEVC style)
+    };
+
+    /*
+    * Block-DCT instrumentation for the last call: how many full 8×8 blocks
+    * were coded, how many were classified flat (pixel range so small that
+    * only the DC coefficient was computed), and how many reconstructed from
+    * the DC coefficient alone (flat blocks included). Zero for DWT.
+    */
+    struct BlockStats {
+        size_t blocks = 0;
+        size_t flatBlocks = 0;
+        size_t dcOnlyBlocks = 0;
+    };
+
+    /*
+    * Quantized DCT levels of one plane. Each 8×8 block, in raster order,
+    * holds 64 levels in zigzag order (see ZIGZAG_ORDER) and an end-of-block
+    * index one past its last non-zero level (0 when every level is zero).
+    * Boundary blocks, which are not transformed, read all zero. Levels are
+    * the quantizer's output before dequantization, so multiplying them by
+    * the (adaptively scaled) quantization table gives the coefficients the
+    * inverse DCT sees; with intra prediction they code the residual.
+    */
+    struct QuantizedPlane {
+        int blocksX = 0;
+        int blocksY = 0;
+        std::vector<int16_t> levels; // 64 per block
+        std::vector<uint8_t> eob;    // One per block
+
+        bool empty() const { return blocksX == 0; }
+        const int16_t* block(int bx, int by) const {
+            return levels.data() + (static_cast<size_t>(by) * blocksX + bx) * 64;
+        }
+        int endOfBlock(int bx, int by) const {
+            return eob[static_cast<size_t>(by) * blocksX + bx];
+        }
+    };
+
+    struct QuantizedCoefficients {
+        QuantizedPlane y, cr, cb; // Chroma at its coded (subsampled) size
     };
 
 public:
@@ -43,6 +106,8 @@ public:
     * Constructs an ImageCodec with the specified quality, quantization, and transform options.
     * @param quality Quality factor for quantization (1-100). Higher means better quality.
     * @param enableQuantization Whether to apply quantization to transform coefficients.
+    *        Without it the floating-point transforms still round; use
+    *        LosslessCodec for bit-exact coding.
     * @param cs Chroma subsampling mode (default: 4:4:4).
     * @param transform Transform type to use (default: DCT).
     */
@@ -51,8 +116,231 @@ public:
                         ChromaSubsampling cs = ChromaSubsampling::CS_444,
                         TransformType transform = TransformType::DCT);
 
+    /*
+    * Changes the quality factor and regenerates the quantization tables, so
+    * one codec (and its scratch memory) can be reused across qualities.
+    */
+    void setQuality(double quality);
+    double quality() const { return m_quality; }
+
     Image process(const Image& bgrImage);
 
+    /*
+    * Same as process(), but writes the reconstruction into `out`, which is
+    * resized in place and only reallocates when it needs more room. Together with
+    * the codec's frame arena this makes repeated calls on same-sized frames
+    * free of heap allocations.
+    */
+    void process(const Image& bgrImage, Image& out);
+
+    /*
+    * Packed pixels in caller memory, e.g. canvas ImageData (RGBA8), a
+    * cv::Mat (BGR8) or a 16-bit camera master (BGR16). `stride` is the
+    * distance between rows in bytes and must cover at least
+    * width × bytesPerPixel(layout).
+    */
+    struct PackedImage {
+        const uint8_t* data = nullptr;
+        int width = 0;
+        int height = 0;
+        size_t stride = 0;
+        PixelLayout layout = PixelLayout::BGR8;
+    };
+
+    // Destination rows for a packed reconstruction the size of the input.
+    struct PackedTarget {
+        uint8_t* data = nullptr;
+        size_t stride = 0;
+        PixelLayout layout = PixelLayout::BGR8;
+    };
+
+    /*
+    * Packed-pixel variants of process(), analyze() and reconstruct(). Input
+    * bytes are colour converted straight into the planar working format and
+    * the reconstruction is written straight back to bytes (clamped and
+    * rounded to nearest), so no interleaved double image is built on either
+    * side. Coding decisions and the bit estimate match the Image entry
+    * points on the same pixels. Throw std::invalid_argument for a null
+    * buffer, an empty size, a stride shorter than one row, misaligned
+    * 16-bit rows, or an 8-bit layout on a codec deeper than 8 bits.
+    */
+    void process(const PackedImage& in, const PackedTarget& out);
+
+    /*
+    * Enables strip processing: instead of running every stage over the whole
+    * frame, one MCU row (8 luma rows, 16 for 4:2:0) is pushed through colour
+    * conversion, resampling, the transform and the inverse conversion while it
+    * is still cache resident. Output is identical to frame processing and the
+    * working memory no longer depends on image height.
+    * The full-image DWT needs the whole frame at once, so DWT codecs always use
+    * frame processing.
+    */
+    void setStripProcessing(bool enable) { m_stripProcessing = enable; }
+    bool stripProcessing() const { return m_stripProcessing; }
+
+    /*
+    * Enables rate-distortion-optimised quantization for the block DCT: each
+    * AC coefficient may be lowered by one level or zeroed when the bits
+    * saved under the codec's rate model outweigh the added distortion.
+    * Slower than plain rounding, but spends fewer bits for the same PSNR.
+    * The DWT path is unaffected.
+    */
+    void setRdoQuantization(bool enable) { m_rdoQuantization = enable; }
+    bool rdoQuantization() const { return m_rdoQuantization; }
+
+    /*
+    * Enables variance-driven adaptive quantization for the block DCT. Each
+    * 8×8 luma block's quantization table is scaled by 2^(offset / 6), where
+    * the offset grows with log2 of the block's variance: flat blocks, where
+    * errors are visible, get finer steps and textured blocks, which mask
+    * errors, get coarser ones. `strength` multiplies the offset.
+    * Chroma keeps the base table; the DWT path is unaffected.
+    */
+    void setAdaptiveQuantization(bool enable, double strength = 1.0);
+    bool adaptiveQuantization() const { return m_adaptiveQuantization; }
+
+    /*
+    * Per-block quantizer scale of the luma plane from the last call, one
+    * sample per 8×8 block (boundary blocks, which are not quantized, read
+    * 1.0). Empty unless adaptive quantization is enabled.
+    */
+    const Image& getQpScaleMap() const { return m_qpScaleMap; }
+
+    /*
+    * Enables intra prediction for the block DCT. Blocks are coded in raster
+    * order and each one is predicted from the reconstructed row above and
+    * column to its left with the IntraMode of lowest SAD against the source;
+    * only the residual is transformed and quantized. Strip, stream and cached
+    * processing carry the row above across MCU rows, so all paths still
+    * agree. The DWT path is unaffected.
+    */
+    void setIntraPrediction(bool enable);
+    bool intraPrediction() const { return m_intraPrediction; }
+
+    /*
+    * IntraMode chosen for each 8×8 luma block in the last call, stored as its
+    * enum value (boundary blocks, which are not predicted, read DC). Empty
+    * unless intra prediction is enabled.
+    */
+    const Image& getIntraModeMap() const { return m_intraModeMap; }
+
+    /*
+    * RegionMode chosen for each REGION_SIZE×REGION_SIZE luma region in the
+    * last call, stored as its enum value; chroma follows the co-located
+    * luma region. Empty unless the transform is TransformType::Adaptive.
+    * Regions are coded independently of each other, and their DCT blocks
+    * use neither adaptive quantization nor intra prediction.
+    */
+    const Image& getRegionMap() const { return m_regionMap; }
+
+    /*
+    * Enables the quantized-coefficient output: process(), processStream()
+    * and reconstruct() then also store every plane's quantized levels (see
+    * QuantizedPlane), at a quarter of the size of the double coefficients,
+    * for histograms, block inspection or an entropy coder to consume without
+    * re-running the transform. Only the block DCT with quantization has
+    * levels; otherwise the planes are left empty. The planes always cover
+    * the whole image, so with processStream() they grow with its height.
+    */
+    void setCoefficientOutput(bool enable);
+    bool coefficientOutput() const { return m_coefficientOutput; }
+    const QuantizedCoefficients& getQuantizedCoefficients() const { return m_quantized; }
+
+    /*
+    * Colour matrix and range used between BGR and the coded Y/Cr/Cb planes
+    * (default BT.601 full range, as in JPEG). Pick the matrix the content
+    * was mastered with, e.g. BT.709 limited range for HD video frames, so
+    * the planes the codec works on match the source without an extra
+    * conversion pass.
+    */
+    void setColorFormat(const ColorFormat& format) { m_colorFormat = format; }
+    const ColorFormat& colorFormat() const { return m_colorFormat; }
+
+    /*
+    * Bit depth (8..16, default 8) of the samples the codec reads and
+    * writes: every entry point takes and returns values from 0 to
+    * 2^bitDepth - 1, so 10-, 12- and 16-bit masters are coded without being
+    * truncated to 8 bits first. The level shift (2^(bitDepth - 1)), output
+    * clamp and quantizer steps (scaled by 2^(bitDepth - 8), as 12-bit JPEG
+    * does) follow from it, and the rate model and adaptive quantization
+    * measure in the same unit, so an image and its 8-bit equivalent code to
+    * the same levels and bit estimate. Packed input above 8 bits needs a
+    * 16-bit PixelLayout. Throws std::invalid_argument outside 8..16.
+    */
+    void setBitDepth(int bitDepth);
+    int bitDepth() const { return m_bitDepth; }
+
+    /*
+    * Row callbacks for processStream(). The reader fills `rows` rows of
+    * interleaved BGR samples, starting at image row `y`, into `bgr` (row
+    * stride width * 3). The writer receives reconstructed rows in the same
+    * layout.
+    */
+    using RowReader = std::function<void(int y, int rows, double* bgr)>;
+    using RowWriter = std::function<void(int y, int rows, const double* bgr)>;
+
+    /*
+    * Encodes and reconstructs a width×height image that is never held in
+    * memory as a whole: rows are pulled from `read` and pushed to `write` one
+    * MCU row at a time, so images beyond 2^31 samples can be processed with
+    * memory proportional to the width only. Output matches process().
+    * Only the block DCT can be streamed; DWT and Adaptive codecs throw
+    * std::logic_error.
+    */
+    void processStream(int width, int height, const RowReader& read, const RowWriter& write);
+
+    /*
+    * Forward-transform coefficients of one image. Colour conversion, chroma
+    * downsampling and the forward DCT/DWT do not depend on the quality
+    * factor, so once analyze() has filled a cache, reconstruct() can
+    * requantise it at any quality without repeating those stages.
+    * Intra-predicted residuals depend on the reconstruction at the chosen
+    * quality, so with intra prediction the DCT planes hold the resampled
+    * samples and only colour conversion and downsampling are skipped.
+    */
+    struct CoefficientCache {
+        int width = 0;
+        int height = 0;
+        ChromaSubsampling chromaSubsampling = ChromaSubsampling::CS_444;
+        TransformType transformType = TransformType::DCT;
+        bool intraPrediction = false;
+        int bitDepth = 8;
+        ColorFormat colorFormat;
+        std::vector<double> y, cr, cb; // Coefficient planes (chroma at subsampled size)
+
+        bool empty() const { return width == 0; }
+        void clear() { width = height = 0; }
+    };
+
+    /*
+    * Runs the quality-independent front half of process() and stores its
+    * coefficients in `cache`, reusing the cache's storage.
+    */
+    void analyze(const Image& bgrImage, CoefficientCache& cache);
+    void analyze(const PackedImage& in, CoefficientCache& cache);
+
+    /*
+    * Quantises the cached coefficients with this codec's tables, inverse
+    * transforms them and writes the BGR reconstruction to `out`. The result
+    * and bit estimate are identical to process() on the analysed image.
+    * Throws std::invalid_argument if the cache was built with a different
+    * subsampling, transform, bit depth or colour format (see canReconstruct()).
+    */
+    void reconstruct(const CoefficientCache& cache, Image& out);
+    void reconstruct(const CoefficientCache& cache, const PackedTarget& out);
+
+    // True if `cache` holds coefficients this codec can reconstruct.
+    bool canReconstruct(const CoefficientCache& cache) const;
+
+    /*
+    * Rate-only counterpart of reconstruct(): quantises the cached
+    * coefficients and returns the bit estimate reconstruct() would report,
+    * skipping the inverse transform and colour conversion (intra prediction
+    * still needs the inverse DCT to form its neighbours). The last call's
+    * bit estimate, block statistics and region map are left untouched.
+    */
+    double estimateBits(const CoefficientCache& cache);
+
 private:
     double m_quality;
     bool   m_enableQuantization;
@@ -63,14 +351,169 @@ private:
     ChromaSubsampling m_chromaSubsampling;
     TransformType     m_transformType;
 
+    bool   m_stripProcessing = false;
+    bool   m_rdoQuantization = false;
+    bool   m_adaptiveQuantization = false;
+    double m_aqStrength = 1.0;
+    Image  m_qpScaleMap;
+    bool   m_intraPrediction = false;
+    Image  m_intraModeMap;
+    Image  m_regionMap;
+    int    m_regionFrameWidth = 0;  // Luma size the region map was chosen for
+    int    m_regionFrameHeight = 0;
+    bool   m_coefficientOutput = false;
+    QuantizedCoefficients m_quantized;
+    ColorFormat m_colorFormat;
+    int    m_bitDepth = 8;
+
     double m_lastBitEstimate = 0.0; // Total bits estimated in the last process() call
+    BlockStats m_blockStats;
+
+    // Scratch planes for one process() call; kept across calls so that
+    // steady-state frames reuse the same memory.
+    FrameArena m_arena;
+
+    // Where one plane's quantized levels go; null when the output is off.
+    struct LevelOutput {
+        int16_t* levels;
+        uint8_t* eob;
+
+        LevelOutput(int16_t* levels = nullptr, uint8_t* eob = nullptr) : levels(levels), eob(eob) {}
+        LevelOutput atBlock(size_t block) const {
+            return levels ? LevelOutput{ levels + block * 64, eob + block } : LevelOutput{};
+        }
+    };
+
+    // Sample scale relative to 8 bits, 2^(bitDepth - 8); the level shift
+    // 2^(bitDepth - 1) and the largest sample value.
+    double sampleUnit() const { return static_cast<double>(1 << (m_bitDepth - 8)); }
+    double levelShift() const { return 128.0 * sampleUnit(); }
+    double maxSample() const { return static_cast<double>((1 << m_bitDepth) - 1); }
 
     void generateQuantizationTables();
-    Image processChannel(const Image& channel,
-                         const double quantTable[8][8]);
-    Image processChannelDWT(const Image& channel);
-    Image downsampleChannel(const Image& channel, ChromaSubsampling cs) const;
-    Image upsampleChannel(const Image& channel, int targetWidth, int targetHeight, ChromaSubsampling cs) const;
+    double quantizeDctBlock(double coeffs[8][8], const double quantTable[8][8],
+                            double* qpScale = nullptr, LevelOutput levels = {}) const;
+    double* prepareQpScaleMap(int width, int height);
+    double* prepareIntraModeMap(int width, int height);
+    LevelOutput prepareQuantizedPlane(QuantizedPlane& plane, int width, int height);
+    bool usesIntraPrediction() const;
+
+    /*
+    * Interleaved pixel rows a pipeline reads from or writes to: the BGR
+    * doubles of an Image (`bgr`, `stride` = width × 3) or caller-owned
+    * packed bytes (`bytes`, `stride` in bytes). Exactly one pointer is set.
+    */
+    struct PixelSource {
+        const double* bgr = nullptr;
+        const uint8_t* bytes = nullptr;
+        size_t stride = 0;
+        PixelLayout layout = PixelLayout::BGR8;
+
+        PixelSource rowsFrom(int y) const {
+            PixelSource rows = *this;
+            if (bgr) rows.bgr += static_cast<size_t>(y) * stride;
+            else     rows.bytes += static_cast<size_t>(y) * stride;
+            return rows;
+        }
+    };
+    struct PixelSink {
+        double* bgr = nullptr;
+        uint8_t* bytes = nullptr;
+        size_t stride = 0;
+        PixelLayout layout = PixelLayout::BGR8;
+
+        PixelSink rowsFrom(int y) const {
+            PixelSink rows = *this;
+            if (bgr) rows.bgr += static_cast<size_t>(y) * stride;
+            else     rows.bytes += static_cast<size_t>(y) * stride;
+            return rows;
+        }
+    };
+    static PixelSource imageSource(const Image& bgrImage);
+    static PixelSink imageSink(Image& out);
+    static PixelSource packedSource(const PackedImage& in, int bitDepth);
+    static PixelSink packedSink(const PackedTarget& out, int width, int bitDepth);
+
+    // The pipeline is instantiated once per (transform, subsampling,
+    // quantization) combination; process() only picks the specialisation, so
+    // none of these settings are re-tested inside the per-pixel loops.
+    void processPixels(const PixelSource& in, int width, int height, const PixelSink& out);
+    void analyzePixels(const PixelSource& in, int width, int height, CoefficientCache& cache);
+    void reconstructPixels(const CoefficientCache& cache, const PixelSink& out);
+
+    template <TransformType TT, ChromaSubsampling CS, bool Quantize>
+    void runPipeline(const PixelSource& in, int width, int height, const PixelSink& out);
+    template <ChromaSubsampling CS, bool Quantize>
+    void runStripPipeline(const PixelSource& in, int width, int height, const PixelSink& out);
+    template <ChromaSubsampling CS, bool Quantize>
+    void runStreamPipeline(int width, int height, const RowReader& read, const RowWriter& write);
+    template <ChromaSubsampling CS, bool Quantize, typename Source, typename Sink>
+    void runStrips(int width, int height, Source& source, Sink& sink);
+
+    template <TransformType TT, ChromaSubsampling CS>
+    void runAnalysis(const PixelSource& in, int width, int height, CoefficientCache& cache);
+    template <TransformType TT, ChromaSubsampling CS, bool Quantize>
+    void runReconstruction(const CoefficientCache& cache, const PixelSink& out);
+
+    template <TransformType TT, bool Quantize>
+    void processPlane(const double* src, int width, int height, double* dst,
+                      const double quantTable[8][8], double* qpMap = nullptr,
+                      double* modeMap = nullptr, LevelOutput levels = {});
+    template <bool Quantize>
+    void processChannel(const double* src, int width, int height, double* dst,
+                        const double quantTable[8][8], double* qpMap = nullptr,
+                        double* modeMap = nullptr, const double* above = nullptr,
+                        LevelOutput levels = {});
+    template <bool Quantize>
+    void processChannelDWT(const double* src, int width, int height, double* dst);
+    template <bool Quantize>
+    void selectRegionModes(const double* luma, const double* cr, const double* cb,
+                           int width, int height, int chromaWidth, int chromaHeight);
+    template <bool Quantize>
+    void processChannelAdaptive(const double* src, int width, int height, double* dst,
+                                const double quantTable[8][8]);
+    template <bool Quantize>
+    void processRegion(RegionMode mode, const double* src, int width, int height, double* dst,
+                       const double quantTable[8][8]);
+
+    // Split halves of processChannel()/processChannelDWT() used by the
+    // coefficient cache.
+    template <TransformType TT>
+    void forwardPlane(const double* src, int width, int height, std::vector<double>& coeffs);
+    template <TransformType TT, bool Quantize>
+    void reconstructPlane(const double* coeffs, int width, int height, double* dst,
+                          const double quantTable[8][8], double* qpMap = nullptr,
+                          double* modeMap = nullptr, LevelOutput levels = {});
+    template <bool Quantize>
+    void reconstructChannel(const double* coeffs, int width, int height, double* dst,
+                            const double quantTable[8][8], double* qpMap = nullptr,
+                            double* modeMap = nullptr, LevelOutput levels = {});
+    void forwardChannelDWT(const double* src, int width, int height, double* coeffs);
+    template <bool Quantize>
+    void inverseChannelDWT(double* coeffs, int width, int height, double* dst);
+    void quantizeChannelDWT(double* coeffs, int width, int height, int levels) const;
+    void accumulatePlaneBits(const double* coeffs, int width, int height,
+                             const double quantTable[8][8], bool adaptive, double& bits);
+    template <typename Fn>
+    void accumulateBitsOf(double& bits, Fn&& run);
+
+    template <ChromaSubsampling CS>
+    static void downsampleChannel(const double* src, int width, int height, double* dst);
+    static void convertRows(const PixelSource& in, int width, int rows,
+                            double* y, double* cr, double* cb, const ColorFormat& format,
+                            int bitDepth);
+    static void writeRows(const double* y, const double* cr, const double* cb, int width, int rows,
+                          const PixelSink& out, const ColorFormat& format, int bitDepth);
+    template <ChromaSubsampling CS>
+    static void convertAndDownsample(const PixelSource& in, int width, int height,
+                                     double* y, double* cr, double* cb, double* scratch,
+                                     const ColorFormat& format, int bitDepth);
+    template <ChromaSubsampling CS>
+    static void upsampleToBgr(const double* y, const double* cr, const double* cb,
+                              int width, int height, int chromaWidth,
+                              const double* const* chromaAbove, const double* const* chromaBelow,
+                              double* scratch, const PixelSink& out, const ColorFormat& format,
+                              int bitDepth);
 
 public:
     struct BlockDebugData {
@@ -84,6 +527,8 @@ public:
     BlockDebugData inspectBlock(const Image& channel, int blockX, int blockY, bool isChroma = false);
 
     double getLastBitEstimate() const { return m_lastBitEstimate; }
+
+    const BlockStats& getLastBlockStats() const { return m_blockStats; }
 };
 
 #endif
@@ -0,0 +1,55 @@
+/*
+ * Codec Explorer: An interactive codec laboratory.
+ * Copyright (C) 2026 Abhinav Tanniru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "Image.h"
+#include <cstdint>
+#include <vector>
+
+/*
+ * LosslessCodec codes 8-bit images bit-exactly. Colour images go through
+ * the reversible YCoCg-R transform, every plane through up to
+ * MAX_LEVELS levels of the integer LeGall 5/3 wavelet, and the coefficients
+ * through a context-adaptive binary range coder: a zero flag conditioned on
+ * the magnitude of already-coded neighbours, then sign and an adaptive
+ * Exp-Golomb magnitude. The LL band is coded as MED (LOCO-I) prediction
+ * residuals. When a cheap cost estimate favours it (flat graphics, sharp
+ * synthetic edges) the wavelet is skipped and every plane is coded as one
+ * MED-predicted band instead.
+ *
+ * Stream layout: "CL53", version, channels, width and height (u32 little
+ * endian), wavelet levels (0 for the spatial mode), then the range-coded
+ * payload.
+ */
+class LosslessCodec {
+public:
+    static constexpr int MAX_LEVELS = 5;
+
+    /*
+    * Encodes a 1- or 3-channel (BGR) image of at most 65536 pixels per side
+    * (the limit decode() accepts). Every sample must be an integer in
+    * [0, 255]; anything else throws std::invalid_argument.
+    */
+    static std::vector<uint8_t> encode(const Image& image);
+
+    /*
+    * Decodes a stream produced by encode(). Throws std::runtime_error if the
+    * stream is truncated or malformed.
+    */
+    static Image decode(const std::vector<uint8_t>& stream);
+};
@@ -0,0 +1,116 @@
+/*
+ * Codec Explorer: An interactive codec laboratory.
+ * Copyright (C) 2026 Abhinav Tanniru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include "Image.h"
+#include "ImageCodec.h"
+#include <vector>
+
+/*
+ * One operating point of a rate-distortion curve.
+ */
+struct RdPoint {
+    int quality = 0;
+    double bits = 0.0; // ImageCodec::getLastBitEstimate() at this quality
+    double psnrY = 0.0;
+    double psnrCr = 0.0;
+    double psnrCb = 0.0;
+    double ssimY = 0.0;
+    double ssimCr = 0.0;
+    double ssimCb = 0.0;
+};
+
+/*
+ * Constraint for RateDistortion::encodeToTarget().
+ */
+struct RdTarget {
+    enum class Kind {
+        MaxBits, // Highest quality whose bit estimate is at most `value`
+        MinPsnrY, // Lowest quality whose luma PSNR is at least `value` dB
+        MinSsimY  // Lowest quality whose luma SSIM is at least `value`
+    };
+
+    Kind kind = Kind::MaxBits;
+    double value = 0.0;
+};
+
+struct RdTargetResult {
+    bool met = false;    // False if no quality in [1, 100] satisfies the target
+    int iterations = 0;  // Cheap evaluations spent in the search
+    RdPoint point;       // Quality and metrics of the final encode
+};
+
+/*
+ * RateDistortion evaluates a codec configuration over a range of quality
+ * settings. The image is analysed once; every quality then only requantises
+ * the cached coefficients, reconstructs and measures, with the qualities
+ * spread across worker threads.
+ */
+class RateDistortion {
+public:
+    // Sweeps qualities [minQuality, maxQuality] and returns one point per
+    // quality in ascending order.
+    static std::vector<RdPoint> sweep(
+        const Image& bgrImage,
+        ImageCodec::ChromaSubsampling cs,
+        ImageCodec::TransformType transform,
+        int minQuality = 1,
+        int maxQuality = 100
+    );
+
+    // Same, starting from coefficients ImageCodec::analyze() already
+    // produced for `bgrImage` (for callers that keep a cache around).
+    static std::vector<RdPoint> sweep(
+        const Image& bgrImage,
+        const ImageCodec::CoefficientCache& cache,
+        int minQuality = 1,
+        int maxQuality = 100
+    );
+
+    // Same, for an arbitrary list of qualities in [1, 100]; points come back
+    // in the order given (e.g. a few qualities spread along the curve).
+    static std::vector<RdPoint> sweep(
+        const Image& bgrImage,
+        const ImageCodec::CoefficientCache& cache,
+        const std::vector<int>& qualities
+    );
+
+    /*
+    * Picks a quality by bisection so the encode satisfies `target`, then
+    * encodes at that quality into `out` (BGR). Search steps reuse the cached
+    * coefficients: bit budgets are checked with ImageCodec::estimateBits(),
+    * which skips the inverse transform, and quality floors reconstruct and
+    * measure only luma. Rate and quality are assumed to grow with the
+    * quality factor, so the search needs at most 7 steps. When the target
+    * cannot be met the closest extreme (quality 1 or 100) is encoded.
+    */
+    static RdTargetResult encodeToTarget(
+        const Image& bgrImage,
+        const ImageCodec::CoefficientCache& cache,
+        const RdTarget& target,
+        Image& out
+    );
+
+    static RdTargetResult encodeToTarget(
+        const Image& bgrImage,
+        ImageCodec::ChromaSubsampling cs,
+        ImageCodec::TransformType transform,
+        const RdTarget& target,
+        Image& out
+    );
+};
@@ -17,9 +17,126 @@
  */
 #pragma once
 #include "Image.h"
+#include <cstddef>
+#include <cstdint>
+
+// Luma/chroma matrix used by the YCrCb conversions. BT.601 is the JPEG
+// matrix and the default; BT.709 is used for HD video and BT.2020 for
+// UHD/HDR content.
+enum class ColorMatrix { BT601, BT709, BT2020 };
+
+// Full range uses the whole sample range for Y, Cr and Cb; limited
+// ("studio") range maps 8-bit Y to 16..235 and chroma to 16..240, scaled
+// by 2^(bitDepth - 8) for deeper samples.
+enum class ColorRange { Full, Limited };
+
+struct ColorFormat {
+    ColorMatrix matrix = ColorMatrix::BT601;
+    ColorRange  range  = ColorRange::Full;
+
+    bool operator==(const ColorFormat& other) const { return matrix == other.matrix && range == other.range; }
+    bool operator!=(const ColorFormat& other) const { return !(*this == other); }
+};
 
 // Converts a BGR Image to YCrCb colorspace.
-Image bgrToYCrCb(const Image& bgrImage);
+// Floating-point conversions take the bit depth (8..16) of the samples they
+// see: values run from 0 to 2^bitDepth - 1, the chroma offset is
+// 2^(bitDepth - 1), and a depth outside 8..16 throws std::invalid_argument.
+Image bgrToYCrCb(const Image& bgrImage, const ColorFormat& format = ColorFormat(),
+                 int bitDepth = 8);
 
 // Converts a YCrCb Image to BGR colorspace.
-Image ycrcbToBgr(const Image& ycrcbImage);
\ No newline at end of file
+Image ycrcbToBgr(const Image& ycrcbImage, const ColorFormat& format = ColorFormat(),
+                 int bitDepth = 8);
+
+// Output-parameter variants: `out` is resized to match the input, reusing its
+// storage when the dimensions are unchanged.
+void bgrToYCrCb(const Image& bgrImage, Image& out, const ColorFormat& format = ColorFormat(),
+                int bitDepth = 8);
+void ycrcbToBgr(const Image& ycrcbImage, Image& out, const ColorFormat& format = ColorFormat(),
+                int bitDepth = 8);
+
+// Converts `numPixels` interleaved BGR pixels straight into separate Y, Cr
+// and Cb planes (same math as bgrToYCrCb, without the interleaved copy).
+// The float overload trades precision for twice the vector width.
+void bgrToYCrCbPlanar(const double* bgr, size_t numPixels,
+                      double* y, double* cr, double* cb,
+                      const ColorFormat& format = ColorFormat(), int bitDepth = 8);
+void bgrToYCrCbPlanar(const float* bgr, size_t numPixels,
+                      float* y, float* cr, float* cb,
+                      const ColorFormat& format = ColorFormat(), int bitDepth = 8);
+
+// Converts separate Y, Cr and Cb planes back into `numPixels` interleaved
+// BGR pixels (same math and clamping as ycrcbToBgr).
+void yCrCbPlanarToBgr(const double* y, const double* cr, const double* cb,
+                      size_t numPixels, double* bgr,
+                      const ColorFormat& format = ColorFormat(), int bitDepth = 8);
+void yCrCbPlanarToBgr(const float* y, const float* cr, const float* cb,
+                      size_t numPixels, float* bgr,
+                      const ColorFormat& format = ColorFormat(), int bitDepth = 8);
+
+// Sample order of packed pixels, e.g. BGR8 for OpenCV and RGBA8 for canvas
+// ImageData. The 16-bit layouts hold native-endian uint16_t samples (a
+// CV_16UC3 Mat is BGR16) whose buffers must be 2-byte aligned. Alpha is
+// ignored on input and written as the largest sample value.
+enum class PixelLayout { BGR8, RGB8, BGRA8, RGBA8, BGR16, RGB16, BGRA16, RGBA16 };
+
+inline int bytesPerSample(PixelLayout layout)
+{
+    return (layout >= PixelLayout::BGR16) ? 2 : 1;
+}
+
+inline int bytesPerPixel(PixelLayout layout)
+{
+    const bool alpha = layout == PixelLayout::BGRA8 || layout == PixelLayout::RGBA8 ||
+                       layout == PixelLayout::BGRA16 || layout == PixelLayout::RGBA16;
+    return (alpha ? 4 : 3) * bytesPerSample(layout);
+}
+
+// Converts `numPixels` packed pixels straight into Y, Cr and Cb planes and
+// back, without an interleaved double copy. Output samples are clamped and
+// rounded to nearest. 8-bit layouts need a bit depth of 8; 16-bit layouts
+// take any depth and hold samples up to 2^bitDepth - 1.
+void packedToYCrCbPlanar(const uint8_t* pixels, PixelLayout layout, size_t numPixels,
+                         double* y, double* cr, double* cb,
+                         const ColorFormat& format = ColorFormat(), int bitDepth = 8);
+void yCrCbPlanarToPacked(const double* y, const double* cr, const double* cb,
+                         size_t numPixels, uint8_t* pixels, PixelLayout layout,
+                         const ColorFormat& format = ColorFormat(), int bitDepth = 8);
+
+// Reorders packed pixels to and from interleaved BGR doubles (the Image
+// layout); packing clamps to 0..2^bitDepth - 1 and rounds to nearest.
+void unpackPixels(const uint8_t* pixels, PixelLayout layout, size_t numPixels, double* bgr);
+void packPixels(const double* bgr, size_t numPixels, uint8_t* pixels, PixelLayout layout,
+                int bitDepth = 8);
+
+// Fixed-point variants for integer samples. Coefficients carry 16
+// fractional bits (24 above 12-bit depth) and results are rounded to
+// nearest and clamped to the sample range; they agree with the
+// floating-point conversion to within one code value. The 8-bit overloads
+// look the coefficient products up in per-format tables (libjpeg style,
+// built on first use) and give the same results as the 16-bit overloads at
+// 8 bits. They are for callers that keep 8-bit planes; packed 8-bit ingest
+// into double planes (packedToYCrCbPlanar) stays on the floating-point
+// kernel. The 16-bit overloads take the significant bit depth of the
+// samples (8..16) and throw std::invalid_argument outside that range.
+void bgrToYCrCbPlanar(const uint8_t* bgr, size_t numPixels,
+                      uint8_t* y, uint8_t* cr, uint8_t* cb,
+                      const ColorFormat& format = ColorFormat());
+void yCrCbPlanarToBgr(const uint8_t* y, const uint8_t* cr, const uint8_t* cb,
+                      size_t numPixels, uint8_t* bgr,
+                      const ColorFormat& format = ColorFormat());
+void bgrToYCrCbPlanar(const uint16_t* bgr, size_t numPixels,
+                      uint16_t* y, uint16_t* cr, uint16_t* cb, int bitDepth,
+                      const ColorFormat& format = ColorFormat());
+void yCrCbPlanarToBgr(const uint16_t* y, const uint16_t* cr, const uint16_t* cb,
+                      size_t numPixels, uint16_t* bgr, int bitDepth,
+                      const ColorFormat& format = ColorFormat());
+
+// Reversible YCoCg-R transform for lossless coding. The input must hold
+// integer samples; Co and Cg need one bit more range than the input
+// (-255..255 for 8-bit BGR). yCoCgRToBgr() restores the input exactly.
+void bgrToYCoCgR(const double* bgr, size_t numPixels,
+                 int32_t* y, int32_t* co, int32_t* cg);
+void yCoCgRToBgr(const int32_t* y, const int32_t* co, const int32_t* cg,
+                 size_t numPixels, double* bgr);
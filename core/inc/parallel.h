@@ -0,0 +1,81 @@
+/*
+ * Codec Explorer: An interactive codec laboratory.
+ * Copyright (C) 2026 Abhinav Tanniru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Number of workers parallelFor() will run on: the hardware thread count,
+ * or 1 where threads are unavailable (WebAssembly built without pthreads).
+ */
+inline int parallelWorkerCount()
+{
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    return 1;
+#else
+    return std::max(1u, std::thread::hardware_concurrency());
+#endif
+}
+
+/*
+ * Calls fn(index, worker) for every index in [0, count). Indices are handed
+ * out one at a time so uneven work items balance across workers. `worker`
+ * is in [0, parallelWorkerCount()) and never runs two indices at once, so
+ * callers can keep per-worker scratch state indexed by it. If fn throws,
+ * no further indices are handed out and the first exception is rethrown
+ * once every worker has stopped.
+ */
+template <typename Fn>
+void parallelFor(int count, Fn&& fn)
+{
+    const int workers = std::min(parallelWorkerCount(), count);
+    if (workers <= 1) {
+        for (int i = 0; i < count; ++i)
+            fn(i, 0);
+        return;
+    }
+
+    std::atomic<int> next{0};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto run = [&](int worker) {
+        try {
+            for (int i = next++; i < count; i = next++)
+                fn(i, worker);
+        } catch (...) {
+            next = count;
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+                error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (int w = 1; w < workers; ++w)
+        threads.emplace_back(run, w);
+    run(0);
+    for (auto& t : threads)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -21,4 +21,14 @@
 void dct8x8(const double src[8][8], double dst[8][8]);
 void idct8x8(const double src[8][8], double dst[8][8]);
 
+// DC coefficient only; bit-identical to dct8x8(src, dst) followed by dst[0][0].
+double dctDc8x8(const double src[8][8]);
+
+// Inverse of a block whose AC coefficients are all zero; bit-identical to
+// idct8x8() on such a block.
+void idctDc8x8(double dc, double dst[8][8]);
+
+// Row-major index (row * 8 + column) of each position of the JPEG zigzag scan.
+extern const int ZIGZAG_ORDER[64];
+
 #endif // TRANSFORM_H
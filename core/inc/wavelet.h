@@ -18,6 +18,9 @@
 #ifndef WAVELET_H
 #define WAVELET_H
 
+#include <cstddef>
+#include <cstdint>
+
 /*
  * Forward 2D Haar Discrete Wavelet Transform on an 8x8 block.
  * Applies a 3-level separable orthonormal Haar decomposition (rows then columns).
@@ -50,15 +53,24 @@ int calcDwtLevels(int width, int height);
  *   rest of [0, W/4)×[0, H/4)   — level-3 detail bands (coarsest)
  *   rest of [0, W/2)×[0, H/2)   — level-2 detail bands
  *   rest of [0, W)×[0, H)       — level-1 detail bands (finest)
+ *
+ * `scratch` may point to dwtScratchSize(width, height) doubles of working
+ * memory; when null the transform allocates its own.
  */
-void dwtImage(double* data, int width, int height, int levels);
+void dwtImage(double* data, int width, int height, int levels, double* scratch = nullptr);
 
 /*
  * Full-image inverse 2D Haar DWT applied in-place. Exact inverse of dwtImage
  * with the same `levels`. Reconstructs the original signal perfectly (before
- * any quantization).
+ * any quantization). `scratch` is as for dwtImage.
+ */
+void idwtImage(double* data, int width, int height, int levels, double* scratch = nullptr);
+
+/*
+ * Number of doubles of scratch memory dwtImage/idwtImage need for a
+ * width×height buffer.
  */
-void idwtImage(double* data, int width, int height, int levels);
+size_t dwtScratchSize(int width, int height);
 
 /*
  * Returns the wavelet quantization step size for the coefficient at pixel
@@ -72,8 +84,23 @@ void idwtImage(double* data, int width, int height, int levels);
 double dwtQuantStep(int x, int y, int width, int height, int levels, double baseStep);
 
 /*
- * Estimates the total bits needed for a DWT coefficient buffer.
+ * Estimates the total bits needed for a DWT coefficient buffer. Magnitudes
+ * are measured in multiples of `unit`, so coefficients of samples deeper
+ * than 8 bits (unit = 2^(bitDepth - 8)) cost the same as their 8-bit
+ * equivalents.
+ */
+double dwtEstimateBits(const double* data, int width, int height, double unit = 1.0);
+
+/*
+ * Reversible integer LeGall 5/3 wavelet (the JPEG 2000 lossless filter)
+ * applied in place to a width×height buffer with `levels` levels of Mallat
+ * decomposition. Any size is allowed: a level over n samples keeps
+ * ceil(n / 2) low-pass samples first, then floor(n / 2) high-pass ones, and
+ * recurses on the top-left low-pass block. Boundaries use symmetric
+ * extension. idwt53Image() with the same `levels` restores the input
+ * exactly.
  */
-double dwtEstimateBits(const double* data, int width, int height);
+void dwt53Image(int32_t* data, int width, int height, int levels);
+void idwt53Image(int32_t* data, int width, int height, int levels);
 
 #endif // WAVELET_H
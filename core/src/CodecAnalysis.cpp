@@ -18,12 +18,37 @@
 #include "CodecAnalysis.h"
 #include <cmath>
 #include "colorspace.h"
+#include "parallel.h"
 #include <algorithm>
+#include <vector>
+
+// Scaled absolute differences of `count` samples, clamped to [0, 255].
+static void artifactSamples(const double* p1, const double* p2, double* out, size_t count, double gain) {
+    for (size_t i = 0; i < count; ++i) {
+        double diff = std::abs(p1[i] - p2[i]) * gain;
+
+        // clamp to [0, 255]
+        diff = std::min(255.0, diff);
+
+        out[i] = diff;
+    }
+}
 
 Image CodecAnalysis::computeArtifactMap(
     const Image& original,
     const Image& reconstructed,
     double gain
+) {
+    Image artifact;
+    computeArtifactMap(original, reconstructed, artifact, gain);
+    return artifact;
+}
+
+void CodecAnalysis::computeArtifactMap(
+    const Image& original,
+    const Image& reconstructed,
+    Image& artifact,
+    double gain
 ) {
     if (original.width() != reconstructed.width() ||
         original.height() != reconstructed.height() ||
@@ -31,35 +56,39 @@ Image CodecAnalysis::computeArtifactMap(
         throw std::invalid_argument("Image size mismatch");
     }
 
-    Image artifact(original.width(),
-                   original.height(),
-                   original.channels());
-
-    const double* p1 = original.data();
-    const double* p2 = reconstructed.data();
-    double* out = artifact.data();
-
-    const size_t total = original.size();
-
-    for (size_t i = 0; i < total; ++i) {
-        double diff = std::abs(p1[i] - p2[i]) * gain;
-
-        // clamp to [0, 255]
-        diff = std::min(255.0, diff);
-
-        out[i] = diff;
-    }
+    artifact.resize(original.width(),
+                    original.height(),
+                    original.channels());
 
-    return artifact;
+    artifactSamples(original.data(), reconstructed.data(), artifact.data(), original.size(), gain);
 }
 
 Image CodecAnalysis::computeEdgeDistortionMap(
     const Image& original,
     const Image& reconstructed
+) {
+    Image edgeDist;
+    computeEdgeDistortionMap(original, reconstructed, edgeDist);
+    return edgeDist;
+}
+
+void CodecAnalysis::computeEdgeDistortionMap(
+    const Image& original,
+    const Image& reconstructed,
+    Image& edgeDist
 ) {
     int w = original.width();
     int h = original.height();
-    Image edgeDist(w, h, 1);
+    edgeDist.resize(w, h, 1);
+
+    // The one-pixel border has no central difference; it stays zero.
+    double* out = edgeDist.data();
+    std::fill(out, out + w, 0.0);
+    std::fill(out + static_cast<size_t>(h - 1) * w, out + static_cast<size_t>(h) * w, 0.0);
+    for (int y = 0; y < h; ++y) {
+        edgeDist.at(0, y, 0) = 0.0;
+        edgeDist.at(w - 1, y, 0) = 0.0;
+    }
     
     // Simple Sobel-based edge detection and error comparison
     for (int y = 1; y < h - 1; ++y) {
@@ -79,15 +108,23 @@ Image CodecAnalysis::computeEdgeDistortionMap(
             edgeDist.at(x, y, 0) = std::min(255.0, diff);
         }
     }
-    return edgeDist;
 }
 
 Image CodecAnalysis::computeBlockingMap(
     const Image& reconstructed
+) {
+    Image blocking;
+    computeBlockingMap(reconstructed, blocking);
+    return blocking;
+}
+
+void CodecAnalysis::computeBlockingMap(
+    const Image& reconstructed,
+    Image& blocking
 ) {
     int w = reconstructed.width();
     int h = reconstructed.height();
-    Image blocking(w, h, 1);
+    blocking.resize(w, h, 1);
     
     // Detect discontinuities at 8x8 boundaries
     for (int y = 0; y < h; ++y) {
@@ -104,10 +141,25 @@ Image CodecAnalysis::computeBlockingMap(
             blocking.at(x, y, 0) = std::min(255.0, score * 8.0);
         }
     }
-    return blocking;
 }
 
-double CodecAnalysis::computePSNR(const Image& I1, const Image& I2) {
+// Largest sample value at `bitDepth` bits, the dynamic range the metrics use.
+static double peakValue(int bitDepth) {
+    if (bitDepth < 8 || bitDepth > 16)
+        throw std::invalid_argument("Sample bit depth must be between 8 and 16");
+    return static_cast<double>((1 << bitDepth) - 1);
+}
+
+// PSNR from the sum of squared errors over `count` samples.
+static double psnrFromSse(double sse, size_t count, int bitDepth) {
+    const double mse = sse / static_cast<double>(count);
+    if (mse <= 1e-10) return 100.0;
+
+    const double peak = peakValue(bitDepth);
+    return 10.0 * log10((peak * peak) / mse);
+}
+
+double CodecAnalysis::computePSNR(const Image& I1, const Image& I2, int bitDepth) {
     if (I1.width() != I2.width() || I1.height() != I2.height() || I1.channels() != I2.channels()) {
         return 0.0; // Or throw an exception
     }
@@ -121,171 +173,491 @@ double CodecAnalysis::computePSNR(const Image& I1, const Image& I2) {
         double diff = p1[i] - p2[i];
         mse += diff * diff;
     }
-    mse /= static_cast<double>(totalSize);
+    return psnrFromSse(mse, totalSize, bitDepth);
+}
+
+// Radius of the SSIM box window: each pixel is compared over the
+// (2r+1)x(2r+1) neighbourhood centred on it, clipped at the image border.
+static constexpr int SSIM_RADIUS = 4;
+
+namespace {
+
+// Box-window SSIM of one channel, fed a row at a time so it can run inside
+// a single sweep over the images. Window sums come from summed-area tables
+// of x, y, x^2, y^2 and xy, so each window costs four lookups per table
+// whatever its size. Only the 2r+2 table rows a window can reach are kept,
+// and samples are taken relative to the mid-range value so the running sums
+// stay small enough for the variances to keep full precision.
+class BoxSsimStream {
+public:
+    BoxSsimStream(int width, int height, double peak)
+        : m_width(width), m_height(height),
+          m_offset((peak + 1.0) / 2.0),
+          m_C1((0.01 * peak) * (0.01 * peak)), // 6.5025 at 8 bits
+          m_C2((0.03 * peak) * (0.03 * peak)), // 58.5225 at 8 bits
+          m_tableStride(static_cast<size_t>(width) + 1),
+          m_ring(static_cast<size_t>(RING_ROWS) * 5 * m_tableStride, 0.0) {}
+
+    // Adds the next row of both images, whose samples are `step` apart, and
+    // scores every pixel whose window is now complete.
+    void addRow(const double* p1, const double* p2, size_t step) {
+        const double* above = tableRow(m_builtRows);
+        double* row = tableRow(++m_builtRows);
+        double sx = 0.0, sy = 0.0, sxx = 0.0, syy = 0.0, sxy = 0.0;
+        for (size_t q = 0; q < 5; ++q)
+            row[q * m_tableStride] = 0.0;
+        for (int x = 0; x < m_width; ++x) {
+            const double vx = p1[static_cast<size_t>(x) * step] - m_offset;
+            const double vy = p2[static_cast<size_t>(x) * step] - m_offset;
+            sx += vx;
+            sy += vy;
+            sxx += vx * vx;
+            syy += vy * vy;
+            sxy += vx * vy;
+            const size_t i = static_cast<size_t>(x) + 1;
+            row[i]                     = above[i] + sx;
+            row[i + m_tableStride]     = above[i + m_tableStride] + sy;
+            row[i + 2 * m_tableStride] = above[i + 2 * m_tableStride] + sxx;
+            row[i + 3 * m_tableStride] = above[i + 3 * m_tableStride] + syy;
+            row[i + 4 * m_tableStride] = above[i + 4 * m_tableStride] + sxy;
+        }
+
+        while (m_scoredRows < m_height &&
+               std::min(m_height - 1, m_scoredRows + SSIM_RADIUS) < m_builtRows)
+            scoreRow(m_scoredRows++);
+    }
 
-    if (mse <= 1e-10) return 100.0;
+    // Mean SSIM once every row has been added.
+    double mean() const {
+        return m_sum / (static_cast<double>(m_width) * m_height);
+    }
 
-    return 10.0 * log10((255.0 * 255.0) / mse);
-}
+private:
+    static constexpr int RING_ROWS = 2 * SSIM_RADIUS + 2;
 
-// Helper for SSIM
-static double getMean(const double* data, int width, int height, int x, int y, int kernelSize) {
-    double sum = 0.0;
-    int count = 0;
-    int half = kernelSize / 2;
-
-    for (int j = -half; j <= half; ++j) {
-        for (int i = -half; i <= half; ++i) {
-            int cx = x + i;
-            int cy = y + j;
-            if (cx >= 0 && cx < width && cy >= 0 && cy < height) {
-                sum += data[cy * width + cx];
-                count++;
+    // Table row r holds, for each of the five quantities, the sums over
+    // image rows [0, r) and columns [0, x) at index x.
+    double* tableRow(int r) {
+        return m_ring.data() + static_cast<size_t>(r % RING_ROWS) * 5 * m_tableStride;
+    }
+
+    void scoreRow(int y) {
+        const int y0 = std::max(0, y - SSIM_RADIUS);
+        const int y1 = std::min(m_height - 1, y + SSIM_RADIUS);
+        const double* top = tableRow(y0);
+        const double* bottom = tableRow(y1 + 1);
+        double rowSum = 0.0;
+        for (int x = 0; x < m_width; ++x) {
+            const size_t x0 = static_cast<size_t>(std::max(0, x - SSIM_RADIUS));
+            const size_t x1 = static_cast<size_t>(std::min(m_width - 1, x + SSIM_RADIUS)) + 1;
+            double sum[5];
+            for (size_t q = 0; q < 5; ++q) {
+                const size_t o = q * m_tableStride;
+                sum[q] = bottom[o + x1] - bottom[o + x0] - top[o + x1] + top[o + x0];
             }
+            const double inv = 1.0 / static_cast<double>((x1 - x0) * static_cast<size_t>(y1 - y0 + 1));
+            const double mx = sum[0] * inv;
+            const double my = sum[1] * inv;
+            const double sigx2 = sum[2] * inv - mx * mx;
+            const double sigy2 = sum[3] * inv - my * my;
+            const double sigxy = sum[4] * inv - mx * my;
+            const double ux = mx + m_offset;
+            const double uy = my + m_offset;
+
+            const double num = (2 * ux * uy + m_C1) * (2 * sigxy + m_C2);
+            const double den = (ux * ux + uy * uy + m_C1) * (sigx2 + sigy2 + m_C2);
+            rowSum += num / den;
         }
+        m_sum += rowSum;
     }
-    return (count > 0) ? (sum / count) : 0.0;
-}
 
-static double getVariance(const double* data, int width, int height, int x, int y, int kernelSize, double mean) {
-    double sum = 0.0;
-    int count = 0;
-    int half = kernelSize / 2;
-
-    for (int j = -half; j <= half; ++j) {
-        for (int i = -half; i <= half; ++i) {
-            int cx = x + i;
-            int cy = y + j;
-            if (cx >= 0 && cx < width && cy >= 0 && cy < height) {
-                double diff = data[cy * width + cx] - mean;
-                sum += diff * diff;
-                count++;
+    int m_width;
+    int m_height;
+    double m_offset;
+    double m_C1;
+    double m_C2;
+    size_t m_tableStride;
+    std::vector<double> m_ring;
+    int m_builtRows = 0;  // Table rows 0..m_builtRows are valid
+    int m_scoredRows = 0; // Image rows whose SSIM has been summed
+    double m_sum = 0.0;
+};
+
+} // namespace
+
+// Wang et al. SSIM window: an 11x11 Gaussian with sigma 1.5, normalised to
+// unit sum. Being separable, it is applied as two 11-tap passes.
+static constexpr int GAUSSIAN_TAPS = 11;
+static constexpr double GAUSSIAN_SIGMA = 1.5;
+
+// Output rows per parallel work item of the Gaussian SSIM.
+static constexpr int SSIM_BAND_ROWS = 32;
+
+// Means of the SSIM and contrast-structure maps (SSIM without its luminance
+// factor, which MS-SSIM uses at all but the coarsest scale).
+struct GaussianSsimTerms {
+    double ssim = 0.0;
+    double cs = 0.0;
+};
+
+// SSIM terms of two single-channel planes over every position where the
+// Gaussian window fits. Each band of output rows convolves the moment planes
+// x, y, x^2, y^2 and xy vertically into row buffers, then horizontally, and
+// sums its SSIM values; bands run in parallel and their sums are added in
+// order, so the result does not depend on the worker count.
+//
+// When `half1` and `half2` are given, the bands also write the planes' 2x2
+// averages there ((width / 2) x (height / 2), odd edges dropped) while their
+// rows are in cache: the next level of an MS-SSIM pyramid.
+static GaussianSsimTerms gaussianPlaneSSIM(const double* d1, const double* d2, int width, int height,
+                                           double C1, double C2,
+                                           double* half1 = nullptr, double* half2 = nullptr) {
+    double taps[GAUSSIAN_TAPS];
+    double tapSum = 0.0;
+    for (int k = 0; k < GAUSSIAN_TAPS; ++k) {
+        const double t = k - GAUSSIAN_TAPS / 2;
+        taps[k] = std::exp(-(t * t) / (2.0 * GAUSSIAN_SIGMA * GAUSSIAN_SIGMA));
+        tapSum += taps[k];
+    }
+    for (double& tap : taps)
+        tap /= tapSum;
+
+    const int outWidth = width - GAUSSIAN_TAPS + 1;
+    const int outHeight = height - GAUSSIAN_TAPS + 1;
+    const size_t rowLength = static_cast<size_t>(width);
+    const int bands = (outHeight + SSIM_BAND_ROWS - 1) / SSIM_BAND_ROWS;
+    std::vector<GaussianSsimTerms> bandSums(bands);
+    // Per worker: five vertically filtered rows, then five fully filtered ones.
+    std::vector<std::vector<double>> scratch(parallelWorkerCount());
+
+    // Horizontal pass over one vertically filtered row.
+    auto filterRow = [&](const double* in, double* out) {
+        for (int x = 0; x < outWidth; ++x) {
+            double sum = 0.0;
+            for (int k = 0; k < GAUSSIAN_TAPS; ++k)
+                sum += taps[k] * in[x + k];
+            out[x] = sum;
+        }
+    };
+
+    parallelFor(bands, [&](int band, int w) {
+        std::vector<double>& buffer = scratch[w];
+        buffer.resize(10 * rowLength);
+        double* mu1 = buffer.data();
+        double* mu2 = mu1 + rowLength;
+        double* s11 = mu2 + rowLength;
+        double* s22 = s11 + rowLength;
+        double* s12 = s22 + rowLength;
+        double* h1 = s12 + rowLength;
+        double* h2 = h1 + rowLength;
+        double* h11 = h2 + rowLength;
+        double* h22 = h11 + rowLength;
+        double* h12 = h22 + rowLength;
+
+        const int y0 = band * SSIM_BAND_ROWS;
+        const int y1 = std::min(outHeight, y0 + SSIM_BAND_ROWS);
+        GaussianSsimTerms bandSum;
+        for (int y = y0; y < y1; ++y) {
+            // One loop per moment plane keeps each loop simple enough to
+            // vectorise.
+            std::fill(mu1, mu1 + 5 * rowLength, 0.0);
+            for (int k = 0; k < GAUSSIAN_TAPS; ++k) {
+                const double tap = taps[k];
+                const double* a = d1 + static_cast<size_t>(y + k) * rowLength;
+                const double* b = d2 + static_cast<size_t>(y + k) * rowLength;
+                for (int x = 0; x < width; ++x) mu1[x] += tap * a[x];
+                for (int x = 0; x < width; ++x) mu2[x] += tap * b[x];
+                for (int x = 0; x < width; ++x) s11[x] += tap * a[x] * a[x];
+                for (int x = 0; x < width; ++x) s22[x] += tap * b[x] * b[x];
+                for (int x = 0; x < width; ++x) s12[x] += tap * a[x] * b[x];
+            }
+            filterRow(mu1, h1);
+            filterRow(mu2, h2);
+            filterRow(s11, h11);
+            filterRow(s22, h22);
+            filterRow(s12, h12);
+
+            for (int x = 0; x < outWidth; ++x) {
+                const double ux = h1[x];
+                const double uy = h2[x];
+                const double sigx2 = h11[x] - ux * ux;
+                const double sigy2 = h22[x] - uy * uy;
+                const double sigxy = h12[x] - ux * uy;
+                const double num = (2 * ux * uy + C1) * (2 * sigxy + C2);
+                const double den = (ux * ux + uy * uy + C1) * (sigx2 + sigy2 + C2);
+                bandSum.ssim += num / den;
+                bandSum.cs += (2 * sigxy + C2) / (sigx2 + sigy2 + C2);
+            }
+        }
+        bandSums[band] = bandSum;
+
+        if (half1) {
+            // Pyramid rows whose source rows start in this band; the last band
+            // also takes the rows below the last window.
+            const int halfWidth = width / 2;
+            const int end = (band == bands - 1) ? height : y1;
+            for (int r = (y0 + 1) / 2; r < height / 2 && 2 * r < end; ++r) {
+                const double* a0 = d1 + static_cast<size_t>(2 * r) * rowLength;
+                const double* b0 = d2 + static_cast<size_t>(2 * r) * rowLength;
+                const double* a1 = a0 + rowLength;
+                const double* b1 = b0 + rowLength;
+                double* outA = half1 + static_cast<size_t>(r) * halfWidth;
+                double* outB = half2 + static_cast<size_t>(r) * halfWidth;
+                for (int x = 0; x < halfWidth; ++x) {
+                    outA[x] = 0.25 * (a0[2 * x] + a0[2 * x + 1] + a1[2 * x] + a1[2 * x + 1]);
+                    outB[x] = 0.25 * (b0[2 * x] + b0[2 * x + 1] + b1[2 * x] + b1[2 * x + 1]);
+                }
             }
         }
+    });
+
+    GaussianSsimTerms terms;
+    for (const GaussianSsimTerms& sum : bandSums) {
+        terms.ssim += sum.ssim;
+        terms.cs += sum.cs;
     }
-    return (count > 0) ? (sum / count) : 0.0;
+    const double windows = static_cast<double>(outWidth) * outHeight;
+    terms.ssim /= windows;
+    terms.cs /= windows;
+    return terms;
 }
 
-static double getCovariance(const double* d1, const double* d2, int width, int height, int x, int y, int kernelSize, double mean1, double mean2) {
-    double sum = 0.0;
-    int count = 0;
-    int half = kernelSize / 2;
-
-    for (int j = -half; j <= half; ++j) {
-        for (int i = -half; i <= half; ++i) {
-            int cx = x + i;
-            int cy = y + j;
-            if (cx >= 0 && cx < width && cy >= 0 && cy < height) {
-                double diff1 = d1[cy * width + cx] - mean1;
-                double diff2 = d2[cy * width + cx] - mean2;
-                sum += diff1 * diff2;
-                count++;
-            }
-        }
+// Scales of MS-SSIM and their weights, finest first.
+static constexpr int MSSSIM_LEVELS = 5;
+static constexpr double MSSSIM_WEIGHTS[MSSSIM_LEVELS] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+
+// MS-SSIM of two single-channel planes (Wang, Simoncelli and Bovik, 2003):
+// contrast-structure at the first MSSSIM_LEVELS - 1 scales and full SSIM at
+// the coarsest, each raised to its weight. Each level's statistics pass also
+// builds the next level, so the pyramid is made once without extra passes.
+// Negative terms are clamped to zero so the fractional powers stay defined.
+static double planeMSSSIM(const double* d1, const double* d2, int width, int height,
+                          double C1, double C2) {
+    // Levels 1 and up, ping-ponging between two pairs of buffers.
+    const size_t halfSize = static_cast<size_t>(width / 2) * (height / 2);
+    std::vector<double> pyramid(4 * halfSize);
+    double* levelBuffers[2][2] = {{pyramid.data(), pyramid.data() + halfSize},
+                                  {pyramid.data() + 2 * halfSize, pyramid.data() + 3 * halfSize}};
+
+    double msssim = 1.0;
+    const double* a = d1;
+    const double* b = d2;
+    for (int level = 0; level < MSSSIM_LEVELS; ++level) {
+        const bool last = level == MSSSIM_LEVELS - 1;
+        double* next1 = last ? nullptr : levelBuffers[level % 2][0];
+        double* next2 = last ? nullptr : levelBuffers[level % 2][1];
+        const GaussianSsimTerms terms = gaussianPlaneSSIM(a, b, width, height, C1, C2, next1, next2);
+        const double term = last ? terms.ssim : terms.cs;
+        msssim *= std::pow(std::max(0.0, term), MSSSIM_WEIGHTS[level]);
+
+        a = next1;
+        b = next2;
+        width /= 2;
+        height /= 2;
     }
-    return (count > 0) ? (sum / count) : 0.0;
+    return msssim;
 }
 
-double CodecAnalysis::computeSSIM(const Image& I1, const Image& I2) {
+double CodecAnalysis::computeSSIM(const Image& I1, const Image& I2, int bitDepth, SsimWindow window) {
     if (I1.width() != I2.width() || I1.height() != I2.height() || I1.channels() != I2.channels()) {
         return 0.0;
     }
 
-    const double C1 = 6.5025;  // (0.01 * 255)^2
-    const double C2 = 58.5225; // (0.03 * 255)^2
-    
-    int width = I1.width();
-    int height = I1.height();
-    const double* d1 = I1.data();
-    const double* d2 = I2.data();
-    
-    // Using a simpler block-based approach for performance instead of full sliding window Gaussian
-    // But to be somewhat accurate we'll use a sliding window with stride
-    // For this implementation, let's do a basic sliding window with a small stride for speed
-    // or just checking every Nth pixel.
-    
-    // Let's do a proper sliding window but maybe with skip if needed. 
-    // For now, full sliding window.
-    
-    // NOTE: This is a simplified SSIM. A full Gaussian weighting is standard but slower.
-    // Using an 8x8 uniform window is a common approximation.
-    int kernelSize = 8;
-    int stride = 4; // Speed up calculation
-    
+    const double L = peakValue(bitDepth);
+    const double C1 = (0.01 * L) * (0.01 * L); // 6.5025 at 8 bits
+    const double C2 = (0.03 * L) * (0.03 * L); // 58.5225 at 8 bits
+
+    const int width = I1.width();
+    const int height = I1.height();
+    const int channels = I1.channels();
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        return 0.0;
+    }
+
+    if (window == SsimWindow::Box) {
+        // Uniform-window SSIM at every pixel, averaged over the channels.
+        const size_t rowSamples = static_cast<size_t>(width) * channels;
+        double mssim = 0.0;
+        for (int c = 0; c < channels; ++c) {
+            BoxSsimStream stream(width, height, L);
+            for (int y = 0; y < height; ++y)
+                stream.addRow(I1.data() + y * rowSamples + c, I2.data() + y * rowSamples + c, channels);
+            mssim += stream.mean();
+        }
+        return mssim / channels;
+    }
+
+    if (width < GAUSSIAN_TAPS || height < GAUSSIAN_TAPS)
+        throw std::invalid_argument("Gaussian SSIM needs images of at least 11x11 pixels");
+    if (channels == 1)
+        return gaussianPlaneSSIM(I1.data(), I2.data(), width, height, C1, C2).ssim;
+
+    // The convolutions want contiguous planes; split interleaved channels out.
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    std::vector<double> plane1(numPixels), plane2(numPixels);
     double mssim = 0.0;
-    int blocks = 0;
-    
-    for (int y = 0; y < height; y += stride) {
-        for (int x = 0; x < width; x += stride) {
-            double ux = getMean(d1, width, height, x, y, kernelSize);
-            double uy = getMean(d2, width, height, x, y, kernelSize);
-            
-            double sigx2 = getVariance(d1, width, height, x, y, kernelSize, ux);
-            double sigy2 = getVariance(d2, width, height, x, y, kernelSize, uy);
-            double sigxy = getCovariance(d1, d2, width, height, x, y, kernelSize, ux, uy);
-            
-            double num = (2 * ux * uy + C1) * (2 * sigxy + C2);
-            double den = (ux * ux + uy * uy + C1) * (sigx2 + sigy2 + C2);
-            
-            mssim += (num / den);
-            blocks++;
+    for (int c = 0; c < channels; ++c) {
+        for (size_t i = 0; i < numPixels; ++i) {
+            plane1[i] = I1.data()[i * channels + c];
+            plane2[i] = I2.data()[i * channels + c];
         }
+        mssim += gaussianPlaneSSIM(plane1.data(), plane2.data(), width, height, C1, C2).ssim;
     }
-    
-    return (blocks > 0) ? (mssim / blocks) : 0.0;
+    return mssim / channels;
+}
+
+double CodecAnalysis::computeMSSSIM(const Image& I1, const Image& I2, int bitDepth) {
+    if (I1.width() != I2.width() || I1.height() != I2.height() || I1.channels() != I2.channels()) {
+        return 0.0;
+    }
+
+    const double L = peakValue(bitDepth);
+    const double C1 = (0.01 * L) * (0.01 * L);
+    const double C2 = (0.03 * L) * (0.03 * L);
+
+    const int width = I1.width();
+    const int height = I1.height();
+    const int channels = I1.channels();
+    if (!supportsMSSSIM(width, height))
+        throw std::invalid_argument("MS-SSIM needs images of at least 176x176 pixels");
+    if (channels == 1)
+        return planeMSSSIM(I1.data(), I2.data(), width, height, C1, C2);
+
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    std::vector<double> plane1(numPixels), plane2(numPixels);
+    double msssim = 0.0;
+    for (int c = 0; c < channels; ++c) {
+        for (size_t i = 0; i < numPixels; ++i) {
+            plane1[i] = I1.data()[i * channels + c];
+            plane2[i] = I2.data()[i * channels + c];
+        }
+        msssim += planeMSSSIM(plane1.data(), plane2.data(), width, height, C1, C2);
+    }
+    return msssim / channels;
+}
+
+bool CodecAnalysis::supportsMSSSIM(int width, int height) {
+    // The coarsest level, 1/16 of the size, must still fit the 11x11 window.
+    const int scale = 1 << (MSSSIM_LEVELS - 1);
+    return width / scale >= GAUSSIAN_TAPS && height / scale >= GAUSSIAN_TAPS;
 }
 
-CodecMetrics CodecAnalysis::computeMetrics(const Image& originalBgr, const Image& reconstructedBgr) {
+CodecMetrics CodecAnalysis::computeMetrics(const Image& originalBgr, const Image& reconstructedBgr,
+                                           int bitDepth, const MetricsOptions& options) {
     CodecMetrics metrics;
+    computeMetrics(originalBgr, reconstructedBgr, metrics, bitDepth, options);
+    return metrics;
+}
+
+void CodecAnalysis::computeMetrics(const Image& originalBgr, const Image& reconstructedBgr, CodecMetrics& metrics,
+                                   int bitDepth, const MetricsOptions& options) {
+    if (originalBgr.width() != reconstructedBgr.width() ||
+        originalBgr.height() != reconstructedBgr.height() ||
+        originalBgr.channels() != reconstructedBgr.channels()) {
+        throw std::invalid_argument("Image size mismatch");
+    }
+
+    const int width = originalBgr.width();
+    const int height = originalBgr.height();
+    const double peak = peakValue(bitDepth);
+    const size_t rowLength = static_cast<size_t>(width);
+    const size_t numPixels = rowLength * height;
+
+    static constexpr unsigned PSNR_FLAGS[3] = {MetricsOptions::PSNR_Y, MetricsOptions::PSNR_CR, MetricsOptions::PSNR_CB};
+    static constexpr unsigned SSIM_FLAGS[3] = {MetricsOptions::SSIM_Y, MetricsOptions::SSIM_CR, MetricsOptions::SSIM_CB};
+    const unsigned requested = options.metrics;
+    const bool gaussian = options.ssimWindow == SsimWindow::Gaussian &&
+                          width >= GAUSSIAN_TAPS && height >= GAUSSIAN_TAPS;
+    const bool msssim = (requested & MetricsOptions::MSSSIM_Y) && supportsMSSSIM(width, height);
+    const bool artifactMap = (requested & MetricsOptions::ARTIFACT_MAP) != 0;
+    bool wantPsnr[3], wantSsim[3], keepPlane[3];
+    bool convert = false;
+    for (int c = 0; c < 3; ++c) {
+        wantPsnr[c] = (requested & PSNR_FLAGS[c]) != 0;
+        wantSsim[c] = (requested & SSIM_FLAGS[c]) != 0;
+        keepPlane[c] = (gaussian && wantSsim[c]) || (c == 0 && msssim);
+        convert = convert || wantPsnr[c] || wantSsim[c] || keepPlane[c];
+    }
+
+    // Everything is gathered in one sweep over the rows: each row of both
+    // images is converted to Y, Cr and Cb and feeds the squared errors, the
+    // box SSIM tables and the artifact map while it is in cache. Full planes
+    // are kept only for the metrics that need them afterwards (the Gaussian
+    // window and MS-SSIM); other channels live in a few rows of scratch.
+    Image originalPlanes[3];
+    Image reconPlanes[3];
+    std::vector<double> rowScratch(convert ? 6 * rowLength : 0);
+    for (int c = 0; c < 3; ++c) {
+        if (keepPlane[c]) {
+            originalPlanes[c].resize(width, height, 1);
+            reconPlanes[c].resize(width, height, 1);
+        }
+    }
 
-    // 1. Convert both images to YCrCb to analyze channels separately
-    Image originalYCrCb = bgrToYCrCb(originalBgr);
-    Image reconstructedYCrCb = bgrToYCrCb(reconstructedBgr);
-
-    // 2. Create single-channel images for original
-    Image originalY(originalBgr.width(), originalBgr.height(), 1);
-    Image originalCr(originalBgr.width(), originalBgr.height(), 1);
-    Image originalCb(originalBgr.width(), originalBgr.height(), 1);
-
-    // 3. Create single-channel images for reconstructed
-    Image reconY(originalBgr.width(), originalBgr.height(), 1);
-    Image reconCr(originalBgr.width(), originalBgr.height(), 1);
-    Image reconCb(originalBgr.width(), originalBgr.height(), 1);
-
-    const size_t numPixels = static_cast<size_t>(originalBgr.width()) * originalBgr.height();
-
-    // 4. Split channels for both images
-    const double* origYCrCbData = originalYCrCb.data();
-    const double* reconYCrCbData = reconstructedYCrCb.data();
-    double* origYData = originalY.data();
-    double* origCrData = originalCr.data();
-    double* origCbData = originalCb.data();
-    double* rYData = reconY.data();
-    double* rCrData = reconCr.data();
-    double* rCbData = reconCb.data();
-
-    for (size_t i = 0; i < numPixels; ++i) {
-        origYData[i]  = *origYCrCbData++;
-        origCrData[i] = *origYCrCbData++;
-        origCbData[i] = *origYCrCbData++;
-
-        rYData[i]  = *reconYCrCbData++;
-        rCrData[i] = *reconYCrCbData++;
-        rCbData[i] = *reconYCrCbData++;
+    // Box SSIM tables for the requested channels; boxSsim[stream[c]].
+    std::vector<BoxSsimStream> boxSsim;
+    int stream[3] = {-1, -1, -1};
+    for (int c = 0; c < 3; ++c) {
+        if (wantSsim[c] && !gaussian) {
+            stream[c] = static_cast<int>(boxSsim.size());
+            boxSsim.emplace_back(width, height, peak);
+        }
     }
 
-    // 5. Compute PSNR for each channel
-    metrics.psnrY = computePSNR(originalY, reconY);
-    metrics.psnrCr = computePSNR(originalCr, reconCr);
-    metrics.psnrCb = computePSNR(originalCb, reconCb);
+    // The artifact gain is divided by 2^(bitDepth - 8) to keep the map on
+    // the 8-bit display scale.
+    const double gain = 5.0 / static_cast<double>(1 << (bitDepth - 8));
+    if (artifactMap)
+        metrics.artifactMap.resize(width, height, 3);
+
+    double sse[3] = {0.0, 0.0, 0.0};
+    for (int y = 0; y < height && (convert || artifactMap); ++y) {
+        const size_t rowStart = static_cast<size_t>(y) * rowLength;
+        if (convert) {
+            double* originalRow[3];
+            double* reconRow[3];
+            for (int c = 0; c < 3; ++c) {
+                originalRow[c] = keepPlane[c] ? originalPlanes[c].data() + rowStart : rowScratch.data() + c * rowLength;
+                reconRow[c] = keepPlane[c] ? reconPlanes[c].data() + rowStart : rowScratch.data() + (3 + c) * rowLength;
+            }
 
-    // 6. Compute SSIM for each channel
-    metrics.ssimY = computeSSIM(originalY, reconY);
-    metrics.ssimCr = computeSSIM(originalCr, reconCr);
-    metrics.ssimCb = computeSSIM(originalCb, reconCb);
+            // Planes are in Y, Cr, Cb order.
+            bgrToYCrCbPlanar(originalBgr.data() + rowStart * 3, rowLength,
+                             originalRow[0], originalRow[1], originalRow[2], ColorFormat(), bitDepth);
+            bgrToYCrCbPlanar(reconstructedBgr.data() + rowStart * 3, rowLength,
+                             reconRow[0], reconRow[1], reconRow[2], ColorFormat(), bitDepth);
+
+            for (int c = 0; c < 3; ++c) {
+                const double* p1 = originalRow[c];
+                const double* p2 = reconRow[c];
+                if (wantPsnr[c]) {
+                    double channelSse = sse[c];
+                    for (size_t x = 0; x < rowLength; ++x) {
+                        const double diff = p1[x] - p2[x];
+                        channelSse += diff * diff;
+                    }
+                    sse[c] = channelSse;
+                }
+                if (stream[c] >= 0)
+                    boxSsim[stream[c]].addRow(p1, p2, 1);
+            }
+        }
 
-    // 7. Compute artifact map on the BGR images
-    metrics.artifactMap = computeArtifactMap(originalBgr, reconstructedBgr);
+        if (artifactMap)
+            artifactSamples(originalBgr.data() + rowStart * 3, reconstructedBgr.data() + rowStart * 3,
+                            metrics.artifactMap.data() + rowStart * 3, rowLength * 3, gain);
+    }
 
-    return metrics;
+    double* psnr[3] = {&metrics.psnrY, &metrics.psnrCr, &metrics.psnrCb};
+    double* ssim[3] = {&metrics.ssimY, &metrics.ssimCr, &metrics.ssimCb};
+    for (int c = 0; c < 3; ++c) {
+        *psnr[c] = wantPsnr[c] ? psnrFromSse(sse[c], numPixels, bitDepth) : 0.0;
+        if (!wantSsim[c])
+            *ssim[c] = 0.0;
+        else if (gaussian)
+            *ssim[c] = computeSSIM(originalPlanes[c], reconPlanes[c], bitDepth, SsimWindow::Gaussian);
+        else
+            *ssim[c] = boxSsim[stream[c]].mean();
+    }
+    metrics.msssimY = msssim ? computeMSSSIM(originalPlanes[0], reconPlanes[0], bitDepth) : 0.0;
 }
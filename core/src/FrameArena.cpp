@@ -0,0 +1,96 @@
+/*
+ * Codec Explorer: An interactive codec laboratory.
+ * Copyright (C) 2026 Abhinav Tanniru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "FrameArena.h"
+#include <algorithm>
+#include <cstdint>
+
+// Blocks start on a 64-byte line and allocations are rounded up to whole
+// lines, so every buffer is line-aligned and neighbouring buffers never
+// share a cache line.
+static const size_t ARENA_LINE_BYTES = 64;
+static const size_t ARENA_GRANULE = ARENA_LINE_BYTES / sizeof(double);
+static const size_t ARENA_MIN_BLOCK = 1 << 16;
+
+FrameArena::Block::Block(size_t count)
+    : storage(new double[count + ARENA_GRANULE - 1]), size(count)
+{
+    // operator new[] only guarantees alignof(std::max_align_t); skip ahead
+    // to the first line boundary inside the over-allocated storage.
+    const uintptr_t address = reinterpret_cast<uintptr_t>(storage.get());
+    const uintptr_t aligned = (address + ARENA_LINE_BYTES - 1) & ~uintptr_t(ARENA_LINE_BYTES - 1);
+    data = storage.get() + (aligned - address) / sizeof(double);
+}
+
+double* FrameArena::allocate(size_t count)
+{
+    count = (count + ARENA_GRANULE - 1) & ~(ARENA_GRANULE - 1);
+    if (count == 0) count = ARENA_GRANULE;
+
+    // Advance to the first block (current or later) with enough room.
+    while (m_block < m_blocks.size() &&
+           m_blocks[m_block].size - m_offset < count) {
+        ++m_block;
+        m_offset = 0;
+    }
+    if (m_block == m_blocks.size()) {
+        m_blocks.emplace_back(std::max(count, ARENA_MIN_BLOCK));
+        m_offset = 0;
+    }
+
+    double* ptr = m_blocks[m_block].data + m_offset;
+    m_offset += count;
+    m_used += count;
+    return ptr;
+}
+
+double* FrameArena::allocateZeroed(size_t count)
+{
+    double* ptr = allocate(count);
+    std::fill(ptr, ptr + count, 0.0);
+    return ptr;
+}
+
+void FrameArena::reset()
+{
+    // A frame spilled over several blocks: replace them with one block that
+    // fits the whole frame so the next frame of this size is served from it.
+    if (m_blocks.size() > 1) {
+        size_t total = capacity();
+        m_blocks.clear();
+        m_blocks.emplace_back(total);
+    }
+    m_block = 0;
+    m_offset = 0;
+    m_used = 0;
+}
+
+void FrameArena::rewind(const Mark& mark)
+{
+    // Later blocks stay allocated; allocate() walks into them again.
+    m_block = mark.block;
+    m_offset = mark.offset;
+    m_used = mark.used;
+}
+
+size_t FrameArena::capacity() const
+{
+    size_t total = 0;
+    for (const auto& block : m_blocks)
+        total += block.size;
+    return total;
+}
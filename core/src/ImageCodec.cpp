@@ -23,6 +23,9 @@
 
 #include <cmath>
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
 
 // Standard JPEG base quantization tables
 const int BASE_LUMA[8][8] = {
@@ -58,10 +61,27 @@ ImageCodec::ImageCodec(double quality, bool enableQuantization, ChromaSubsamplin
         generateQuantizationTables();
 }
 
+void ImageCodec::setQuality(double quality)
+{
+    m_quality = quality;
+    if (m_enableQuantization)
+        generateQuantizationTables();
+}
+
+void ImageCodec::setBitDepth(int bitDepth)
+{
+    if (bitDepth < 8 || bitDepth > 16)
+        throw std::invalid_argument("Sample bit depth must be between 8 and 16");
+    m_bitDepth = bitDepth;
+    if (m_enableQuantization)
+        generateQuantizationTables();
+}
+
 /*
 * Generates quantization tables based on the specified quality factor.
 * The quality factor should be in the range [1, 100], where higher values mean better quality (less compression).
 * The quantization tables are derived from the standard JPEG tables and scaled according to the quality factor.
+* Deeper samples scale every step by 2^(bitDepth - 8), as 12-bit JPEG does, so the same levels code them.
 */
 void ImageCodec::generateQuantizationTables()
 {
@@ -73,6 +93,7 @@ void ImageCodec::generateQuantizationTables()
         scale = 200.0 - 2.0 * m_quality;
 
     scale /= 100.0;
+    const double unit = sampleUnit();
 
     for (int i = 0; i < 8; ++i) {
         for (int j = 0; j < 8; ++j) {
@@ -80,20 +101,22 @@ void ImageCodec::generateQuantizationTables()
             double lq = std::round(BASE_LUMA[i][j] * scale);
             double cq = std::round(BASE_CHROMA[i][j] * scale);
 
-            m_lumaQuantTable[i][j]   = std::max(1.0, lq);
-            m_chromaQuantTable[i][j] = std::max(1.0, cq);
+            m_lumaQuantTable[i][j]   = std::max(1.0, lq) * unit;
+            m_chromaQuantTable[i][j] = std::max(1.0, cq) * unit;
         }
     }
 }
 
 /*
- * Estimates bit count for a block of quantized DCT coefficients.
+ * Estimates bit count for a block of quantized DCT coefficients. Magnitudes
+ * are measured in multiples of the sample unit 2^(bitDepth - 8), so deeper
+ * samples coded with the same levels cost the same.
  */
-static double estimateBlockBits(const double block[8][8]) {
+static double estimateBlockBits(const double block[8][8], double unit) {
     double bits = 0;
     for (int i = 0; i < 8; ++i) {
         for (int j = 0; j < 8; ++j) {
-            double val = std::abs(block[i][j]);
+            double val = std::abs(block[i][j]) / unit;
             if (val < 0.5) bits += 0.5;
             else bits += std::log2(val) + 3.0;
         }
@@ -101,71 +124,564 @@ static double estimateBlockBits(const double block[8][8]) {
     return bits;
 }
 
+/*
+ * Level-shifts one 8×8 block of a plane (row stride `stride`) and
+ * forward-transforms it.
+ */
+static inline void forwardBlock(const double* src, int stride, double levelShift, double coeffs[8][8])
+{
+    double block[8][8];
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+            block[i][j] = src[static_cast<size_t>(i) * stride + j] - levelShift;
+    dct8x8(block, coeffs);
+}
+
+/*
+ * Subtracts the prediction (the level shift 2^(bitDepth - 1) everywhere
+ * without intra prediction) from one 8×8 block into `block` and returns the
+ * residual's range (max - min), gathered during the same pass.
+ */
+static inline double loadBlock(const double* src, int stride, const double pred[8][8],
+                               double block[8][8])
+{
+    double lo = src[0] - pred[0][0], hi = lo;
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j) {
+            const double v = src[static_cast<size_t>(i) * stride + j] - pred[i][j];
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+            block[i][j] = v;
+        }
+    return hi - lo;
+}
+
+/*
+ * Largest sample range for which every AC coefficient is guaranteed to
+ * quantize to zero with `quantTable`. Each orthonormal DCT basis function
+ * other than DC is bounded by 1/4 in magnitude, and the absolute deviations
+ * from the block mean sum to at most 32 × range, so |AC| <= 8 × range. Plain
+ * rounding zeroes anything below half a step.
+ */
+static double flatBlockRange(const double quantTable[8][8])
+{
+    double minStep = quantTable[0][1];
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+            if (i != 0 || j != 0)
+                minStep = std::min(minStep, quantTable[i][j]);
+    return minStep / 16.0;
+}
+
+/*
+ * True if every AC coefficient of the block is zero.
+ */
+static inline bool isDcOnly(const double coeffs[8][8])
+{
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+            if (coeffs[i][j] != 0.0 && (i != 0 || j != 0))
+                return false;
+    return true;
+}
+
+/*
+ * Inverse-transforms one 8×8 block and writes it back with the prediction
+ * added. DC-only blocks skip the matrix products. Returns true if the block
+ * was DC-only.
+ */
+static inline bool inverseBlock(const double coeffs[8][8], const double pred[8][8],
+                                double* dst, int stride)
+{
+    double reconBlock[8][8];
+    const bool dcOnly = isDcOnly(coeffs);
+    if (dcOnly)
+        idctDc8x8(coeffs[0][0], reconBlock);
+    else
+        idct8x8(coeffs, reconBlock);
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+            dst[static_cast<size_t>(i) * stride + j] = reconBlock[i][j] + pred[i][j];
+    return dcOnly;
+}
+
+/*
+ * Prediction used for every block when intra prediction is off: the level
+ * shift.
+ */
+static inline void levelShiftPrediction(double pred[8][8], double levelShift)
+{
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+            pred[i][j] = levelShift;
+}
+
+/*
+ * Estimated cost of signalling one block's intra mode.
+ */
+static const double INTRA_MODE_BITS = 2.0;
+
+/*
+ * Fills `pred` with the given intra mode's prediction. `top` holds the eight
+ * reconstructed samples above the block followed by the above-right one
+ * (nullptr on the first row); `left` points at the sample left of the
+ * block's first row, with row stride `stride` (nullptr in the first column).
+ * DC falls back to `levelShift` without neighbours. Callers only request
+ * modes whose neighbours exist.
+ */
+static void predictIntra(ImageCodec::IntraMode mode, const double* top, const double* left,
+                         int stride, double levelShift, double pred[8][8])
+{
+    using IntraMode = ImageCodec::IntraMode;
+
+    switch (mode) {
+    case IntraMode::DC: {
+        double sum = 0.0;
+        int count = 0;
+        if (top) {
+            for (int j = 0; j < 8; ++j)
+                sum += top[j];
+            count += 8;
+        }
+        if (left) {
+            for (int i = 0; i < 8; ++i)
+                sum += left[static_cast<size_t>(i) * stride];
+            count += 8;
+        }
+        const double dc = count ? sum / count : levelShift;
+        for (int i = 0; i < 8; ++i)
+            for (int j = 0; j < 8; ++j)
+                pred[i][j] = dc;
+        break;
+    }
+    case IntraMode::Horizontal:
+        for (int i = 0; i < 8; ++i)
+            for (int j = 0; j < 8; ++j)
+                pred[i][j] = left[static_cast<size_t>(i) * stride];
+        break;
+    case IntraMode::Vertical:
+        for (int i = 0; i < 8; ++i)
+            for (int j = 0; j < 8; ++j)
+                pred[i][j] = top[j];
+        break;
+    case IntraMode::Planar: {
+        // The bottom-left neighbour is not reconstructed yet, so the last
+        // left sample stands in for it.
+        const double topRight = top[8];
+        const double bottomLeft = left[static_cast<size_t>(7) * stride];
+        for (int i = 0; i < 8; ++i)
+            for (int j = 0; j < 8; ++j)
+                pred[i][j] = ((7 - j) * left[static_cast<size_t>(i) * stride] + (j + 1) * topRight +
+                              (7 - i) * top[j] + (i + 1) * bottomLeft) / 16.0;
+        break;
+    }
+    }
+}
+
+/*
+ * Picks the available intra mode whose prediction has the lowest SAD
+ * against the source block and leaves that prediction in `pred`.
+ */
+static ImageCodec::IntraMode chooseIntraMode(const double* src, int stride, const double* top,
+                                             const double* left, double levelShift,
+                                             double pred[8][8])
+{
+    using IntraMode = ImageCodec::IntraMode;
+
+    IntraMode best = IntraMode::DC;
+    double bestSad = 0.0;
+    for (IntraMode mode : { IntraMode::DC, IntraMode::Horizontal, IntraMode::Vertical, IntraMode::Planar }) {
+        if ((mode == IntraMode::Horizontal && !left) || (mode == IntraMode::Vertical && !top) ||
+            (mode == IntraMode::Planar && !(top && left)))
+            continue;
+
+        double candidate[8][8];
+        predictIntra(mode, top, left, stride, levelShift, candidate);
+        double sad = 0.0;
+        for (int i = 0; i < 8; ++i)
+            for (int j = 0; j < 8; ++j)
+                sad += std::abs(src[static_cast<size_t>(i) * stride + j] - candidate[i][j]);
+
+        if (mode == IntraMode::DC || sad < bestSad) {
+            best = mode;
+            bestSad = sad;
+            std::copy(&candidate[0][0], &candidate[0][0] + 64, &pred[0][0]);
+        }
+    }
+    return best;
+}
+
+/*
+ * Quantizes and dequantizes a block in place; returns its bit estimate.
+ */
+static inline double quantizeBlock(double coeffs[8][8], const double quantTable[8][8], double unit)
+{
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j) {
+            double coeff = coeffs[i][j] / quantTable[i][j];
+            coeffs[i][j] = std::round(coeff) * quantTable[i][j];
+        }
+    return estimateBlockBits(coeffs, unit);
+}
+
+/*
+ * Rate-distortion trade-off for RDO quantization, in bits per unit of
+ * squared error normalised by the coefficient's quantizer step.
+ */
+static const double RDO_LAMBDA = 0.2;
+
+/*
+ * Picks the quantization level for one coefficient that minimises
+ * D + λR, trying round(|c| / q), one level lower, and zero. Distortion is
+ * the squared error in units of the step; rate follows estimateBlockBits().
+ * That model charges every coefficient on its own, so choosing levels
+ * coefficient by coefficient minimises the whole block's cost.
+ */
+static inline double rdoLevel(double coeff, double q, double unit)
+{
+    const double mag = std::abs(coeff) / q;
+    const double level = std::round(mag);
+    if (level == 0.0)
+        return 0.0;
+
+    auto cost = [&](double l) {
+        const double err = mag - l;
+        const double bits = (l == 0.0) ? 0.5 : std::log2(l * q / unit) + 3.0;
+        return err * err + RDO_LAMBDA * bits;
+    };
+
+    double best = level;
+    double bestCost = cost(level);
+    for (double candidate : {level - 1.0, 0.0}) {
+        const double c = cost(candidate);
+        if (c < bestCost) {
+            best = candidate;
+            bestCost = c;
+        }
+    }
+    return std::copysign(best, coeff);
+}
+
+/*
+ * RDO variant of quantizeBlock(). The DC coefficient keeps plain rounding:
+ * a wrong DC level shifts the whole block and is the most visible error.
+ */
+static inline double quantizeBlockRdo(double coeffs[8][8], const double quantTable[8][8], double unit)
+{
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j) {
+            const double level = (i == 0 && j == 0)
+                ? std::round(coeffs[i][j] / quantTable[i][j])
+                : rdoLevel(coeffs[i][j], quantTable[i][j], unit);
+            coeffs[i][j] = level * quantTable[i][j];
+        }
+    return estimateBlockBits(coeffs, unit);
+}
+
+/*
+ * Adaptive quantization: QP offset per log2 of block variance, the variance
+ * at which a block keeps the base table, and the largest offset applied.
+ */
+static const double AQ_REFERENCE_LOG2_VARIANCE = 6.4;
+static const double AQ_MAX_QP_OFFSET = 6.0;
+
+/*
+ * Quantizer scale for one block from its AC energy. The DCT is orthonormal,
+ * so the AC energy over 64 equals the block's pixel variance, and the cached
+ * coefficient path sees exactly the same activity as the pixel path. The
+ * variance is taken on the 8-bit scale (`unit` = 2^(bitDepth - 8)).
+ */
+static inline double aqScale(const double coeffs[8][8], double strength, double unit)
+{
+    double energy = -coeffs[0][0] * coeffs[0][0];
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+            energy += coeffs[i][j] * coeffs[i][j];
+    const double variance = std::max(0.0, energy / (64.0 * unit * unit));
+
+    double offset = strength * (std::log2(variance + 1.0) - AQ_REFERENCE_LOG2_VARIANCE);
+    offset = std::max(-AQ_MAX_QP_OFFSET, std::min(AQ_MAX_QP_OFFSET, offset));
+    return std::exp2(offset / 6.0);
+}
+
+/*
+ * Recovers the levels of a dequantized block in zigzag order and returns the
+ * end-of-block index (one past the last non-zero level).
+ */
+static inline uint8_t storeZigzagLevels(const double coeffs[8][8], const double quantTable[8][8],
+                                        int16_t levels[64])
+{
+    uint8_t eob = 0;
+    for (int k = 0; k < 64; ++k) {
+        const int i = ZIGZAG_ORDER[k] >> 3;
+        const int j = ZIGZAG_ORDER[k] & 7;
+        levels[k] = static_cast<int16_t>(std::lround(coeffs[i][j] / quantTable[i][j]));
+        if (levels[k] != 0)
+            eob = static_cast<uint8_t>(k + 1);
+    }
+    return eob;
+}
+
+/*
+ * Quantizes one DCT block with the plain or RDO quantizer. When `qpScale` is
+ * given (luma blocks with adaptive quantization on), the table is first
+ * scaled by the block's activity and the scale is stored there. `levels`, if
+ * set, receives the block's quantized levels.
+ */
+double ImageCodec::quantizeDctBlock(double coeffs[8][8], const double quantTable[8][8],
+                                    double* qpScale, LevelOutput levels) const
+{
+    const double unit = sampleUnit();
+    double scaledTable[8][8];
+    const double (*table)[8] = quantTable;
+    if (qpScale) {
+        const double scale = aqScale(coeffs, m_aqStrength, unit);
+        *qpScale = scale;
+        for (int i = 0; i < 8; ++i)
+            for (int j = 0; j < 8; ++j)
+                scaledTable[i][j] = std::max(unit, quantTable[i][j] * scale);
+        table = scaledTable;
+    }
+
+    const double bits = m_rdoQuantization ? quantizeBlockRdo(coeffs, table, unit)
+                                          : quantizeBlock(coeffs, table, unit);
+    if (levels.levels)
+        *levels.eob = storeZigzagLevels(coeffs, table, levels.levels);
+    return bits;
+}
+
+void ImageCodec::setAdaptiveQuantization(bool enable, double strength)
+{
+    if (strength < 0.0)
+        throw std::invalid_argument("Adaptive quantization strength must be non-negative");
+    m_adaptiveQuantization = enable;
+    m_aqStrength = strength;
+    if (!enable)
+        m_qpScaleMap = Image();
+}
+
+/*
+ * Sizes the luma QP scale map for a width×height frame and returns it, or
+ * nullptr when adaptive quantization is off.
+ */
+double* ImageCodec::prepareQpScaleMap(int width, int height)
+{
+    if (!m_adaptiveQuantization || !m_enableQuantization || m_transformType != TransformType::DCT)
+        return nullptr;
+    m_qpScaleMap.resize((width + 7) / 8, (height + 7) / 8, 1);
+    std::fill(m_qpScaleMap.data(), m_qpScaleMap.data() + m_qpScaleMap.size(), 1.0);
+    return m_qpScaleMap.data();
+}
+
+void ImageCodec::setIntraPrediction(bool enable)
+{
+    m_intraPrediction = enable;
+    if (!enable)
+        m_intraModeMap = Image();
+}
+
+bool ImageCodec::usesIntraPrediction() const
+{
+    return m_intraPrediction && m_transformType == TransformType::DCT;
+}
+
+/*
+ * Sizes the luma intra mode map for a width×height frame and returns it, or
+ * nullptr when intra prediction is off.
+ */
+double* ImageCodec::prepareIntraModeMap(int width, int height)
+{
+    if (!usesIntraPrediction())
+        return nullptr;
+    m_intraModeMap.resize((width + 7) / 8, (height + 7) / 8, 1);
+    std::fill(m_intraModeMap.data(), m_intraModeMap.data() + m_intraModeMap.size(),
+              static_cast<double>(IntraMode::DC));
+    return m_intraModeMap.data();
+}
+
+void ImageCodec::setCoefficientOutput(bool enable)
+{
+    m_coefficientOutput = enable;
+    if (!enable)
+        m_quantized = QuantizedCoefficients();
+}
+
+/*
+ * Sizes `plane` for a width×height plane with every level zero and returns
+ * where processChannel() should store its levels, or an empty output (and an
+ * empty plane) when there are no levels to record.
+ */
+ImageCodec::LevelOutput ImageCodec::prepareQuantizedPlane(QuantizedPlane& plane, int width, int height)
+{
+    if (!m_coefficientOutput || !m_enableQuantization || m_transformType != TransformType::DCT) {
+        plane.blocksX = plane.blocksY = 0;
+        plane.levels.clear();
+        plane.eob.clear();
+        return {};
+    }
+    plane.blocksX = (width + 7) / 8;
+    plane.blocksY = (height + 7) / 8;
+    const size_t blocks = static_cast<size_t>(plane.blocksX) * plane.blocksY;
+    plane.levels.assign(blocks * 64, 0);
+    plane.eob.assign(blocks, 0);
+    return { plane.levels.data(), plane.eob.data() };
+}
+
+/*
+ * Copies a boundary block that does not fill a whole 8×8 tile unchanged.
+ */
+static inline void copyPartialBlock(const double* src, int width, int x, int y,
+                                    int blockWidth, int blockHeight, double* dst)
+{
+    for (int i = 0; i < blockHeight; ++i) {
+        const size_t rowOffset = static_cast<size_t>(y + i) * width + x;
+        std::copy(src + rowOffset, src + rowOffset + blockWidth, dst + rowOffset);
+    }
+}
+
 /*
  * Processes a single channel using the block-DCT pipeline (JPEG-style).
  * Each 8×8 block is forward-transformed, quantized with the supplied table,
  * dequantized, and inverse-transformed independently.
+ * `src` and `dst` are width×height planes.
+ * Blocks whose sample range is too small for any AC coefficient to survive
+ * quantization only compute the DC coefficient; the result is identical.
+ * With intra prediction, each block is predicted from `dst` (already
+ * reconstructed above and to the left) and only the residual is coded;
+ * `above`, if given, is the reconstructed row preceding the plane.
  */
-Image ImageCodec::processChannel(const Image& channel,
-                                 const double quantTable[8][8])
+template <bool Quantize>
+void ImageCodec::processChannel(const double* src, int width, int height, double* dst,
+                                const double quantTable[8][8], double* qpMap,
+                                double* modeMap, const double* above, LevelOutput levels)
 {
-    Image reconstructed(channel.width(),
-                        channel.height(),
-                        1);
+    const int blocksX = (width + 7) / 8;
+    const bool intra = usesIntraPrediction();
+
+    // Adaptive quantization rescales the table per block, so the flat-block
+    // bound is only known up front for a fixed table.
+    const double flatRange = (Quantize && !qpMap) ? flatBlockRange(quantTable) : -1.0;
 
-    for (int y = 0; y < channel.height(); y += 8) {
-        for (int x = 0; x < channel.width(); x += 8) {
+    double pred[8][8];
+    levelShiftPrediction(pred, levelShift());
 
-            int blockWidth = std::min(8, channel.width() - x);
-            int blockHeight = std::min(8, channel.height() - y);
+    for (int y = 0; y < height; y += 8) {
+        for (int x = 0; x < width; x += 8) {
+
+            int blockWidth = std::min(8, width - x);
+            int blockHeight = std::min(8, height - y);
             if (blockWidth < 8 || blockHeight < 8) {
                 // Copy boundary blocks without processing.
-                const double* channelData = channel.data();
-                double* reconData = reconstructed.data();
-                const int channelWidth = channel.width();
-                for (int i = 0; i < blockHeight; ++i) {
-                    const double* src_row = &channelData[(y + i) * channelWidth + x];
-                    double* dst_row = &reconData[(y + i) * channelWidth + x];
-                    std::copy(src_row, src_row + blockWidth, dst_row);
-                }
+                copyPartialBlock(src, width, x, y, blockWidth, blockHeight, dst);
                 continue;
             }
 
+            const size_t offset = static_cast<size_t>(y) * width + x;
+            const size_t blockIndex = static_cast<size_t>(y / 8) * blocksX + x / 8;
+            if (intra) {
+                const double* topRow = (y > 0) ? dst + offset - width : (above ? above + x : nullptr);
+                double top[9];
+                if (topRow) {
+                    std::copy(topRow, topRow + 8, top);
+                    top[8] = (x + 8 < width) ? topRow[8] : topRow[7];
+                }
+                const IntraMode mode = chooseIntraMode(src + offset, width, topRow ? top : nullptr,
+                                                       (x > 0) ? dst + offset - 1 : nullptr,
+                                                       levelShift(), pred);
+                if (modeMap)
+                    modeMap[blockIndex] = static_cast<double>(mode);
+                if (Quantize)
+                    m_lastBitEstimate += INTRA_MODE_BITS;
+            }
+
             double block[8][8];
             double dctBlock[8][8];
-            double reconBlock[8][8];
-            const double* channelData = channel.data();
-            const int channelWidth = channel.width();
+            if (loadBlock(src + offset, width, pred, block) < flatRange) {
+                for (int i = 0; i < 8; ++i)
+                    for (int j = 0; j < 8; ++j)
+                        dctBlock[i][j] = 0.0;
+                dctBlock[0][0] = dctDc8x8(block);
+                ++m_blockStats.flatBlocks;
+            } else {
+                dct8x8(block, dctBlock);
+            }
 
-            for (int i = 0; i < 8; ++i)
-                for (int j = 0; j < 8; ++j)
-                    block[i][j] = channelData[(y + i) * channelWidth + (x + j)] - 128.0;
+            if (Quantize)
+                m_lastBitEstimate += quantizeDctBlock(dctBlock, quantTable,
+                    qpMap ? &qpMap[blockIndex] : nullptr, levels.atBlock(blockIndex));
 
-            dct8x8(block, dctBlock);
+            ++m_blockStats.blocks;
+            if (inverseBlock(dctBlock, pred, dst + offset, width))
+                ++m_blockStats.dcOnlyBlocks;
+        }
+    }
+}
 
-            if (m_enableQuantization) {
-                for (int i = 0; i < 8; ++i)
-                    for (int j = 0; j < 8; ++j) {
-                        double coeff = dctBlock[i][j] / quantTable[i][j];
-                        dctBlock[i][j] = std::round(coeff) * quantTable[i][j];
-                    }
-                m_lastBitEstimate += estimateBlockBits(dctBlock);
-            }
+/*
+ * Second half of processChannel(): `coeffs` is a width×height plane holding
+ * each full 8×8 block's DCT coefficients in place of its samples, and the
+ * raw samples of boundary blocks. With intra prediction it holds the samples
+ * themselves and the whole of processChannel() runs.
+ */
+template <bool Quantize>
+void ImageCodec::reconstructChannel(const double* coeffs, int width, int height, double* dst,
+                                    const double quantTable[8][8], double* qpMap,
+                                    double* modeMap, LevelOutput levels)
+{
+    if (usesIntraPrediction()) {
+        processChannel<Quantize>(coeffs, width, height, dst, quantTable, qpMap, modeMap,
+                                 nullptr, levels);
+        return;
+    }
 
-            idct8x8(dctBlock, reconBlock);
+    const int blocksX = (width + 7) / 8;
+    double pred[8][8];
+    levelShiftPrediction(pred, levelShift());
+
+    for (int y = 0; y < height; y += 8) {
+        for (int x = 0; x < width; x += 8) {
+
+            int blockWidth = std::min(8, width - x);
+            int blockHeight = std::min(8, height - y);
+            if (blockWidth < 8 || blockHeight < 8) {
+                copyPartialBlock(coeffs, width, x, y, blockWidth, blockHeight, dst);
+                continue;
+            }
 
-            double* reconData = reconstructed.data();
-            const int reconWidth = reconstructed.width();
+            const size_t offset = static_cast<size_t>(y) * width + x;
+            double dctBlock[8][8];
             for (int i = 0; i < 8; ++i)
                 for (int j = 0; j < 8; ++j)
-                    reconData[(y + i) * reconWidth + (x + j)] =
-                        reconBlock[i][j] + 128.0;
+                    dctBlock[i][j] = coeffs[offset + static_cast<size_t>(i) * width + j];
+
+            const size_t blockIndex = static_cast<size_t>(y / 8) * blocksX + x / 8;
+            if (Quantize)
+                m_lastBitEstimate += quantizeDctBlock(dctBlock, quantTable,
+                    qpMap ? &qpMap[blockIndex] : nullptr, levels.atBlock(blockIndex));
+
+            ++m_blockStats.blocks;
+            if (inverseBlock(dctBlock, pred, dst + offset, width))
+                ++m_blockStats.dcOnlyBlocks;
         }
     }
-
-    return reconstructed;
 }
 
+/*
+ * Padded working size of the full-image DWT for a width×height plane, such
+ * that every level can be halved evenly without leaving "original" edges.
+ */
+struct DwtLayout {
+    int levels;
+    int width;
+    int height;
+};
+
+static DwtLayout dwtLayout(int width, int height)
+{
+    const int levels = calcDwtLevels(width, height);
+    const int stride = (1 << levels);
+    return { levels, (width + stride - 1) & ~(stride - 1), (height + stride - 1) & ~(stride - 1) };
+}
 
 /*
  * Processes a single channel using the full-image Haar DWT pipeline.
@@ -175,17 +691,45 @@ Image ImageCodec::processChannel(const Image& channel,
  * smaller steps (higher fidelity); finer (high-frequency) subbands receive
  * larger steps (more compression).
  */
-Image ImageCodec::processChannelDWT(const Image& channel)
+template <bool Quantize>
+void ImageCodec::processChannelDWT(const double* src, int W_orig, int H_orig, double* dst)
 {
-    const int W_orig = channel.width();
-    const int H_orig = channel.height();
-    const int levels = calcDwtLevels(W_orig, H_orig);
+    const DwtLayout layout = dwtLayout(W_orig, H_orig);
+    double* buf = m_arena.allocate(static_cast<size_t>(layout.width) * layout.height);
+    forwardChannelDWT(src, W_orig, H_orig, buf);
+    inverseChannelDWT<Quantize>(buf, W_orig, H_orig, dst);
+}
+
+/*
+ * Forward half of processChannelDWT(): writes the padded, level-shifted
+ * plane's wavelet coefficients to `buf` (dwtLayout() size).
+ */
+void ImageCodec::forwardChannelDWT(const double* src, int W_orig, int H_orig, double* buf)
+{
+    const DwtLayout layout = dwtLayout(W_orig, H_orig);
+    const int W = layout.width;
+    const int H = layout.height;
+
+    // Copy to the working buffer with DC level shift and edge mirroring.
+    const double shift = levelShift();
+    for (int y = 0; y < H; ++y) {
+        int srcY = std::min(y, H_orig - 1);
+        for (int x = 0; x < W; ++x) {
+            int srcX = std::min(x, W_orig - 1);
+            buf[(size_t)y * W + x] = src[(size_t)srcY * W_orig + srcX] - shift;
+        }
+    }
 
-    // Padding to ensure every level can be halved evenly without leaving "original" edges.
-    int stride = (1 << levels);
-    int W = (W_orig + stride - 1) & ~(stride - 1);
-    int H = (H_orig + stride - 1) & ~(stride - 1);
+    // Full-image forward DWT.
+    double* scratch = m_arena.allocate(dwtScratchSize(W, H));
+    dwtImage(buf, W, H, layout.levels, scratch);
+}
 
+/*
+ * Subband-adaptive quantization of a padded W×H coefficient buffer, in place.
+ */
+void ImageCodec::quantizeChannelDWT(double* buf, int W, int H, int levels) const
+{
     // Quality → base quantization step for the finest detail subband.
     double qualScale;
     if (m_quality < 50.0)
@@ -193,213 +737,979 @@ Image ImageCodec::processChannelDWT(const Image& channel)
     else
         qualScale = 200.0 - 2.0 * m_quality;
     qualScale /= 100.0;
-    const double baseStep = 32.0 * qualScale; 
+    const double baseStep = 32.0 * qualScale * sampleUnit();
 
-    // Copy to a flat working buffer with DC level shift and edge mirroring.
-    std::vector<double> buf(static_cast<size_t>(W) * H, 0.0);
-    const double* src = channel.data();
     for (int y = 0; y < H; ++y) {
-        int srcY = std::min(y, H_orig - 1);
         for (int x = 0; x < W; ++x) {
-            int srcX = std::min(x, W_orig - 1);
-            buf[(size_t)y * W + x] = src[(size_t)srcY * W_orig + srcX] - 128.0;
+            double step = dwtQuantStep(x, y, W, H, levels, baseStep);
+            double& c = buf[(size_t)y * W + x];
+            c = std::round(c / step) * step;
         }
     }
+}
 
-    // Full-image forward DWT.
-    dwtImage(buf.data(), W, H, levels);
+/*
+ * Inverse half of processChannelDWT(): quantizes the coefficients in `buf`
+ * in place, inverse-transforms them and writes the cropped, clamped plane.
+ */
+template <bool Quantize>
+void ImageCodec::inverseChannelDWT(double* buf, int W_orig, int H_orig, double* dst)
+{
+    const DwtLayout layout = dwtLayout(W_orig, H_orig);
+    const int levels = layout.levels;
+    const int W = layout.width;
+    const int H = layout.height;
 
-    // Subband-adaptive quantization.
-    if (m_enableQuantization) {
-        for (int y = 0; y < H; ++y) {
-            for (int x = 0; x < W; ++x) {
-                double step = dwtQuantStep(x, y, W, H, levels, baseStep);
-                double& c = buf[(size_t)y * W + x];
-                c = std::round(c / step) * step;
-            }
-        }
-    }
+    if (Quantize)
+        quantizeChannelDWT(buf, W, H, levels);
 
     // Accumulate bit estimate.
-    m_lastBitEstimate += dwtEstimateBits(buf.data(), W, H);
+    m_lastBitEstimate += dwtEstimateBits(buf, W, H, sampleUnit());
 
     // Full-image inverse DWT.
-    idwtImage(buf.data(), W, H, levels);
+    double* scratch = m_arena.allocate(dwtScratchSize(W, H));
+    idwtImage(buf, W, H, levels, scratch);
 
     // Write back with reverse level shift and pixel-value clamping, cropping back to original size.
-    Image result(W_orig, H_orig, 1);
-    double* dst = result.data();
+    const double shift = levelShift();
+    const double maxValue = maxSample();
     for (int y = 0; y < H_orig; ++y) {
         for (int x = 0; x < W_orig; ++x) {
-            dst[(size_t)y * W_orig + x] = std::max(0.0, std::min(255.0, buf[(size_t)y * W + x] + 128.0));
+            dst[(size_t)y * W_orig + x] = std::max(0.0, std::min(maxValue, buf[(size_t)y * W + x] + shift));
+        }
+    }
+}
+
+/*
+ * Estimated cost of signalling one region's mode under TransformType::Adaptive.
+ */
+static const double REGION_MODE_BITS = 2.0;
+
+/*
+ * Rate of coding a width×height region losslessly: each sample is predicted
+ * from its left neighbour (the sample above in the first column) and the
+ * residual is costed with the coefficient rate model (in multiples of
+ * `unit`; the very first sample is predicted from the level shift).
+ */
+static double estimateSkipBits(const double* src, int width, int height, double levelShift,
+                               double unit)
+{
+    double bits = 0.0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            const double pred = (x > 0) ? src[i - 1] : (y > 0 ? src[i - width] : levelShift);
+            const double residual = std::abs(src[i] - pred) / unit;
+            bits += (residual < 0.5) ? 0.5 : std::log2(residual) + 3.0;
         }
     }
+    return bits;
+}
 
-    return result;
+/*
+ * Lagrange multiplier trading squared error against bits when comparing
+ * region modes: at high rate, dD/dR = -2 ln 2 · D with D = step² / 12,
+ * taken at the table's mean step.
+ */
+static double regionLambda(const double quantTable[8][8])
+{
+    double sum = 0.0;
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j)
+            sum += quantTable[i][j];
+    const double step = sum / 64.0;
+    return 2.0 * std::log(2.0) * step * step / 12.0;
 }
 
 /*
-* Downsamples a single channel (Cr or Cb) based on the specified chroma subsampling mode.
-* Uses simple averaging for downsampling.
-*/
-Image ImageCodec::downsampleChannel(const Image& channel, ChromaSubsampling cs) const {
-    if (cs == ChromaSubsampling::CS_444) {
-        return channel; // No subsampling
+ * Codes one region held as a contiguous width×height plane with the given
+ * mode. Scratch taken from the arena is released on return, so coding every
+ * region of a frame needs no more than the largest region does.
+ */
+template <bool Quantize>
+void ImageCodec::processRegion(RegionMode mode, const double* src, int width, int height,
+                               double* dst, const double quantTable[8][8])
+{
+    const FrameArena::Mark mark = m_arena.mark();
+    switch (mode) {
+    case RegionMode::DCT:
+        processChannel<Quantize>(src, width, height, dst, quantTable);
+        break;
+    case RegionMode::DWT:
+        processChannelDWT<Quantize>(src, width, height, dst);
+        break;
+    case RegionMode::Skip:
+        std::copy(src, src + static_cast<size_t>(width) * height, dst);
+        m_lastBitEstimate += estimateSkipBits(src, width, height, levelShift(), sampleUnit());
+        break;
     }
+    m_arena.rewind(mark);
+}
 
-    int originalWidth = channel.width();
-    int originalHeight = channel.height();
-    int newWidth = originalWidth;
-    int newHeight = originalHeight;
+/*
+ * Chooses the RegionMode of every region for TransformType::Adaptive. A
+ * region's cost covers its luma and co-located chroma samples, and a cheap
+ * pre-analysis pass over its luma limits the trial encodes:
+ * - regions whose range keeps every 8×8 luma block DC-only go straight to
+ *   DCT;
+ * - regions where at least half the horizontal neighbours repeat exactly
+ *   (text, UI, line art) weigh DCT against lossless skip, which needs no
+ *   trial;
+ * - all others (natural content) trial both DCT and DWT.
+ * The mode with the lowest SSE + λ · bits wins. `cr` and `cb` are
+ * chromaWidth×chromaHeight planes.
+ */
+template <bool Quantize>
+void ImageCodec::selectRegionModes(const double* luma, const double* cr, const double* cb,
+                                   int width, int height, int chromaWidth, int chromaHeight)
+{
+    const int cols = (width + REGION_SIZE - 1) / REGION_SIZE;
+    const int rows = (height + REGION_SIZE - 1) / REGION_SIZE;
+    m_regionMap.resize(cols, rows, 1);
+    m_regionFrameWidth = width;
+    m_regionFrameHeight = height;
+
+    // Tables only exist with quantization on; lossless trials compare bits.
+    const double lambda = Quantize ? regionLambda(m_lumaQuantTable) : 1.0;
+    const double flatRange = Quantize ? flatBlockRange(m_lumaQuantTable) : -1.0;
+
+    struct Plane {
+        const double* samples;
+        int width;
+        int height;
+        int regionWidth;
+        int regionHeight;
+        const double (*quantTable)[8];
+    };
+    const int chromaRegionWidth = (chromaWidth < width) ? REGION_SIZE / 2 : REGION_SIZE;
+    const int chromaRegionHeight = (chromaHeight < height) ? REGION_SIZE / 2 : REGION_SIZE;
+    const Plane planes[3] = {
+        { luma, width, height, REGION_SIZE, REGION_SIZE, m_lumaQuantTable },
+        { cr, chromaWidth, chromaHeight, chromaRegionWidth, chromaRegionHeight, m_chromaQuantTable },
+        { cb, chromaWidth, chromaHeight, chromaRegionWidth, chromaRegionHeight, m_chromaQuantTable },
+    };
+
+    const size_t tilePixels = static_cast<size_t>(REGION_SIZE) * REGION_SIZE;
+    double* tiles[3];
+    for (double*& tile : tiles)
+        tile = m_arena.allocate(tilePixels);
+    double* trial = m_arena.allocate(tilePixels);
+    int tileWidths[3], tileHeights[3];
+
+    const double lastBitEstimate = m_lastBitEstimate;
+    const BlockStats blockStats = m_blockStats;
+
+    auto trialCost = [&](RegionMode mode) {
+        m_lastBitEstimate = 0.0;
+        double sse = 0.0;
+        for (int p = 0; p < 3; ++p) {
+            if (tileWidths[p] <= 0 || tileHeights[p] <= 0)
+                continue;
+            processRegion<Quantize>(mode, tiles[p], tileWidths[p], tileHeights[p], trial, planes[p].quantTable);
+            for (size_t i = 0; i < static_cast<size_t>(tileWidths[p]) * tileHeights[p]; ++i)
+                sse += (trial[i] - tiles[p][i]) * (trial[i] - tiles[p][i]);
+        }
+        return sse + lambda * m_lastBitEstimate;
+    };
+
+    for (int ry = 0; ry < rows; ++ry) {
+        for (int rx = 0; rx < cols; ++rx) {
+            for (int p = 0; p < 3; ++p) {
+                const Plane& plane = planes[p];
+                const int x0 = rx * plane.regionWidth;
+                const int y0 = ry * plane.regionHeight;
+                tileWidths[p] = std::min(plane.regionWidth, plane.width - x0);
+                tileHeights[p] = std::min(plane.regionHeight, plane.height - y0);
+                for (int y = 0; y < tileHeights[p]; ++y) {
+                    const double* row = plane.samples + static_cast<size_t>(y0 + y) * plane.width + x0;
+                    std::copy(row, row + tileWidths[p], tiles[p] + static_cast<size_t>(y) * tileWidths[p]);
+                }
+            }
 
-    if (cs == ChromaSubsampling::CS_422 || cs == ChromaSubsampling::CS_420) {
-        newWidth = (originalWidth + 1) / 2; // Ceiling division
+            // Pre-analysis: luma range and exact horizontal repeats.
+            const double* tile = tiles[0];
+            const int tileWidth = tileWidths[0];
+            const size_t count = static_cast<size_t>(tileWidth) * tileHeights[0];
+            double lo = tile[0], hi = tile[0];
+            size_t repeats = 0;
+            for (size_t i = 0; i < count; ++i) {
+                lo = std::min(lo, tile[i]);
+                hi = std::max(hi, tile[i]);
+                if (i % tileWidth != 0 && tile[i] == tile[i - 1])
+                    ++repeats;
+            }
+            const size_t pairs = count - tileHeights[0];
+
+            RegionMode mode = RegionMode::DCT;
+            if (hi - lo >= flatRange) {
+                const double dctCost = trialCost(RegionMode::DCT);
+                if (pairs > 0 && 2 * repeats >= pairs) {
+                    double skipBits = 0.0;
+                    for (int p = 0; p < 3; ++p)
+                        if (tileWidths[p] > 0 && tileHeights[p] > 0)
+                            skipBits += estimateSkipBits(tiles[p], tileWidths[p], tileHeights[p],
+                                                         levelShift(), sampleUnit());
+                    if (lambda * skipBits < dctCost)
+                        mode = RegionMode::Skip;
+                } else if (trialCost(RegionMode::DWT) < dctCost) {
+                    mode = RegionMode::DWT;
+                }
+            }
+            m_regionMap.at(rx, ry, 0) = static_cast<double>(mode);
+        }
     }
-    if (cs == ChromaSubsampling::CS_420) {
-        newHeight = (originalHeight + 1) / 2; // Ceiling division
+
+    m_lastBitEstimate = lastBitEstimate + REGION_MODE_BITS * cols * rows;
+    m_blockStats = blockStats;
+}
+
+/*
+ * Codes one plane region by region with the modes picked by
+ * selectRegionModes(). Chroma planes use the co-located luma regions, which
+ * are half as wide (tall) when chroma is subsampled horizontally
+ * (vertically); that is exactly when the plane is narrower (shorter) than
+ * the frame.
+ */
+template <bool Quantize>
+void ImageCodec::processChannelAdaptive(const double* src, int width, int height, double* dst,
+                                        const double quantTable[8][8])
+{
+    const int regionWidth = (width < m_regionFrameWidth) ? REGION_SIZE / 2 : REGION_SIZE;
+    const int regionHeight = (height < m_regionFrameHeight) ? REGION_SIZE / 2 : REGION_SIZE;
+
+    const size_t tilePixels = static_cast<size_t>(regionWidth) * regionHeight;
+    double* tile = m_arena.allocate(tilePixels);
+    double* recon = m_arena.allocate(tilePixels);
+
+    for (int ry = 0; ry < m_regionMap.height(); ++ry) {
+        for (int rx = 0; rx < m_regionMap.width(); ++rx) {
+            const int x0 = rx * regionWidth;
+            const int y0 = ry * regionHeight;
+            const int w = std::min(regionWidth, width - x0);
+            const int h = std::min(regionHeight, height - y0);
+            if (w <= 0 || h <= 0)
+                continue;
+
+            for (int y = 0; y < h; ++y) {
+                const double* row = src + static_cast<size_t>(y0 + y) * width + x0;
+                std::copy(row, row + w, tile + static_cast<size_t>(y) * w);
+            }
+
+            const auto mode = static_cast<RegionMode>(static_cast<int>(m_regionMap.at(rx, ry, 0)));
+            processRegion<Quantize>(mode, tile, w, h, recon, quantTable);
+
+            for (int y = 0; y < h; ++y) {
+                const double* row = recon + static_cast<size_t>(y) * w;
+                std::copy(row, row + w, dst + static_cast<size_t>(y0 + y) * width + x0);
+            }
+        }
     }
+}
 
-    Image downsampled(newWidth, newHeight, 1);
+/*
+ * Runs one plane through the transform selected at compile time.
+ */
+template <ImageCodec::TransformType TT, bool Quantize>
+void ImageCodec::processPlane(const double* src, int width, int height, double* dst,
+                              const double quantTable[8][8], double* qpMap, double* modeMap,
+                              LevelOutput levels)
+{
+    if constexpr (TT == TransformType::DWT)
+        processChannelDWT<Quantize>(src, width, height, dst);
+    else if constexpr (TT == TransformType::Adaptive)
+        processChannelAdaptive<Quantize>(src, width, height, dst, quantTable);
+    else
+        processChannel<Quantize>(src, width, height, dst, quantTable, qpMap, modeMap, nullptr, levels);
+}
 
-    for (int y = 0; y < newHeight; ++y) {
-        for (int x = 0; x < newWidth; ++x) {
-            double sum = 0.0;
-            int count = 0;
-
-            // Calculate the top-left corner of the 2x2 or 2x1 block in the original image
-            int startX = x * (cs == ChromaSubsampling::CS_444 ? 1 : 2);
-            int startY = y * (cs == ChromaSubsampling::CS_420 ? 2 : 1);
-
-            // Calculate the bottom-right corner (exclusive) of the block
-            int endX = startX + (cs == ChromaSubsampling::CS_444 ? 1 : 2);
-            int endY = startY + (cs == ChromaSubsampling::CS_420 ? 2 : 1);
-
-            for (int sy = startY; sy < endY && sy < originalHeight; ++sy) {
-                for (int sx = startX; sx < endX && sx < originalWidth; ++sx) {
-                    sum += channel.at(sx, sy, 0);
-                    count++;
+/*
+ * Forward half of processPlane(): stores the plane's coefficients in
+ * `coeffs`, resized to the transform's working size. Region-adaptive and
+ * intra-predicted planes keep their samples (see CoefficientCache).
+ */
+template <ImageCodec::TransformType TT>
+void ImageCodec::forwardPlane(const double* src, int width, int height, std::vector<double>& coeffs)
+{
+    if constexpr (TT == TransformType::DWT) {
+        const DwtLayout layout = dwtLayout(width, height);
+        coeffs.resize(static_cast<size_t>(layout.width) * layout.height);
+        forwardChannelDWT(src, width, height, coeffs.data());
+    } else if (TT == TransformType::Adaptive || usesIntraPrediction()) {
+        coeffs.assign(src, src + static_cast<size_t>(width) * height);
+    } else {
+        coeffs.resize(static_cast<size_t>(width) * height);
+        double* dst = coeffs.data();
+        for (int y = 0; y < height; y += 8) {
+            for (int x = 0; x < width; x += 8) {
+                int blockWidth = std::min(8, width - x);
+                int blockHeight = std::min(8, height - y);
+                if (blockWidth < 8 || blockHeight < 8) {
+                    copyPartialBlock(src, width, x, y, blockWidth, blockHeight, dst);
+                    continue;
                 }
-            }
-            if (count > 0) {
-                downsampled.at(x, y, 0) = sum / count;
-            } else {
-                // Fallback for edge cases where no pixels are covered (should ideally not happen with correct dimensions)
-                downsampled.at(x, y, 0) = channel.at(std::min(startX, originalWidth - 1), std::min(startY, originalHeight - 1), 0);
+
+                const size_t offset = static_cast<size_t>(y) * width + x;
+                double dctBlock[8][8];
+                forwardBlock(src + offset, width, levelShift(), dctBlock);
+                for (int i = 0; i < 8; ++i)
+                    for (int j = 0; j < 8; ++j)
+                        dst[offset + static_cast<size_t>(i) * width + j] = dctBlock[i][j];
             }
         }
     }
-    return downsampled;
 }
 
 /*
-* Upsamples a single channel (Cr or Cb) back to target dimensions using nearest-neighbor interpolation.
+ * Inverse half of processPlane() for coefficients produced by forwardPlane().
+ */
+template <ImageCodec::TransformType TT, bool Quantize>
+void ImageCodec::reconstructPlane(const double* coeffs, int width, int height, double* dst,
+                                  const double quantTable[8][8], double* qpMap, double* modeMap,
+                                  LevelOutput levels)
+{
+    if constexpr (TT == TransformType::DWT) {
+        // The inverse works in place, so quantize a copy of the cached plane.
+        const DwtLayout layout = dwtLayout(width, height);
+        const size_t count = static_cast<size_t>(layout.width) * layout.height;
+        double* buf = m_arena.allocate(count);
+        std::copy(coeffs, coeffs + count, buf);
+        inverseChannelDWT<Quantize>(buf, width, height, dst);
+    } else if constexpr (TT == TransformType::Adaptive) {
+        processChannelAdaptive<Quantize>(coeffs, width, height, dst, quantTable);
+    } else {
+        reconstructChannel<Quantize>(coeffs, width, height, dst, quantTable, qpMap, modeMap, levels);
+    }
+}
+
+/*
+ * Horizontal / vertical chroma decimation factors (as shifts) for each mode.
+ */
+template <ImageCodec::ChromaSubsampling CS>
+struct ChromaShift {
+    static constexpr int x = (CS == ImageCodec::ChromaSubsampling::CS_444) ? 0 : 1;
+    static constexpr int y = (CS == ImageCodec::ChromaSubsampling::CS_420) ? 1 : 0;
+};
+
+/*
+* Downsamples a single channel (Cr or Cb) by averaging each 2x1 (4:2:2) or
+* 2x2 (4:2:0) cell. A trailing odd column/row averages only the samples that
+* exist. `dst` must hold ((width + 1) / 2) × height or ((height + 1) / 2) rows.
 */
-Image ImageCodec::upsampleChannel(const Image& channel, int targetWidth, int targetHeight, ChromaSubsampling cs) const {
-    if (cs == ChromaSubsampling::CS_444) {
-        return channel; // No upsampling needed
+template <ImageCodec::ChromaSubsampling CS>
+void ImageCodec::downsampleChannel(const double* src, int width, int height, double* dst)
+{
+    constexpr int sy = ChromaShift<CS>::y;
+    const int newWidth = (width + 1) >> 1;
+    const int newHeight = (height + (1 << sy) - 1) >> sy;
+    const int pairs = width >> 1; // Columns with a complete horizontal pair
+
+    for (int y = 0; y < newHeight; ++y) {
+        const double* row0 = src + static_cast<size_t>(y << sy) * width;
+        double* out = dst + static_cast<size_t>(y) * newWidth;
+
+        if (sy == 1 && (y << 1) + 1 < height) {
+            const double* row1 = row0 + width;
+            for (int x = 0; x < pairs; ++x)
+                out[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1]) / 4;
+            if (pairs < newWidth)
+                out[pairs] = (row0[2 * pairs] + row1[2 * pairs]) / 2;
+        } else {
+            for (int x = 0; x < pairs; ++x)
+                out[x] = (row0[2 * x] + row0[2 * x + 1]) / 2;
+            if (pairs < newWidth)
+                out[pairs] = row0[2 * pairs];
+        }
     }
+}
 
-    Image upsampled(targetWidth, targetHeight, 1);
-    int currentWidth = channel.width();
-    int currentHeight = channel.height();
+ImageCodec::PixelSource ImageCodec::imageSource(const Image& bgrImage)
+{
+    PixelSource source;
+    source.bgr = bgrImage.data();
+    source.stride = static_cast<size_t>(bgrImage.width()) * 3;
+    return source;
+}
 
-    for (int y = 0; y < targetHeight; ++y) {
-        for (int x = 0; x < targetWidth; ++x) {
-            int srcX = x;
-            int srcY = y;
+ImageCodec::PixelSink ImageCodec::imageSink(Image& out)
+{
+    PixelSink sink;
+    sink.bgr = out.data();
+    sink.stride = static_cast<size_t>(out.width()) * 3;
+    return sink;
+}
 
-            if (cs == ChromaSubsampling::CS_422 || cs == ChromaSubsampling::CS_420) {
-                srcX /= 2;
-            }
-            if (cs == ChromaSubsampling::CS_420) {
-                srcY /= 2;
+/*
+ * 16-bit samples are read in place, so their buffer and stride must keep
+ * every row 2-byte aligned, and 8-bit layouts cannot carry deeper samples.
+ */
+static void checkPackedBuffer(const void* data, size_t stride, PixelLayout layout, int bitDepth)
+{
+    if (bytesPerSample(layout) == 1 && bitDepth != 8)
+        throw std::invalid_argument("8-bit pixel layouts need a codec bit depth of 8");
+    if (bytesPerSample(layout) == 2 &&
+        (reinterpret_cast<uintptr_t>(data) % alignof(uint16_t) != 0 || stride % alignof(uint16_t) != 0))
+        throw std::invalid_argument("16-bit packed rows must be 2-byte aligned");
+}
+
+ImageCodec::PixelSource ImageCodec::packedSource(const PackedImage& in, int bitDepth)
+{
+    if (!in.data || in.width <= 0 || in.height <= 0)
+        throw std::invalid_argument("Invalid packed image");
+    if (in.stride < static_cast<size_t>(in.width) * bytesPerPixel(in.layout))
+        throw std::invalid_argument("Packed image stride is shorter than a row");
+    checkPackedBuffer(in.data, in.stride, in.layout, bitDepth);
+    PixelSource source;
+    source.bytes = in.data;
+    source.stride = in.stride;
+    source.layout = in.layout;
+    return source;
+}
+
+ImageCodec::PixelSink ImageCodec::packedSink(const PackedTarget& out, int width, int bitDepth)
+{
+    if (!out.data)
+        throw std::invalid_argument("Invalid packed target");
+    if (out.stride < static_cast<size_t>(width) * bytesPerPixel(out.layout))
+        throw std::invalid_argument("Packed target stride is shorter than a row");
+    checkPackedBuffer(out.data, out.stride, out.layout, bitDepth);
+    PixelSink sink;
+    sink.bytes = out.data;
+    sink.stride = out.stride;
+    sink.layout = out.layout;
+    return sink;
+}
+
+// Converts `rows` input rows into planar Y/Cr/Cb (each plane `width` wide).
+// Image rows are contiguous and convert in one call; packed rows go one at
+// a time to honour the stride.
+void ImageCodec::convertRows(const PixelSource& in, int width, int rows,
+                             double* y, double* cr, double* cb, const ColorFormat& format,
+                             int bitDepth)
+{
+    if (in.bgr) {
+        bgrToYCrCbPlanar(in.bgr, static_cast<size_t>(rows) * width, y, cr, cb, format, bitDepth);
+        return;
+    }
+    for (int row = 0; row < rows; ++row) {
+        const size_t offset = static_cast<size_t>(row) * width;
+        packedToYCrCbPlanar(in.bytes + row * in.stride, in.layout, static_cast<size_t>(width),
+                            y + offset, cr + offset, cb + offset, format, bitDepth);
+    }
+}
+
+void ImageCodec::writeRows(const double* y, const double* cr, const double* cb, int width, int rows,
+                           const PixelSink& out, const ColorFormat& format, int bitDepth)
+{
+    if (out.bgr) {
+        yCrCbPlanarToBgr(y, cr, cb, static_cast<size_t>(rows) * width, out.bgr, format, bitDepth);
+        return;
+    }
+    for (int row = 0; row < rows; ++row) {
+        const size_t offset = static_cast<size_t>(row) * width;
+        yCrCbPlanarToPacked(y + offset, cr + offset, cb + offset, static_cast<size_t>(width),
+                            out.bytes + row * out.stride, out.layout, format, bitDepth);
+    }
+}
+
+/*
+* Converts `height` input rows into a full-resolution Y plane and
+* Cr/Cb planes at the coded chroma resolution. Chroma is converted one cell
+* row (1 or 2 image rows) at a time into `scratch` (4 × width samples) and
+* box-filtered straight away, so it never exists at full resolution.
+*/
+template <ImageCodec::ChromaSubsampling CS>
+void ImageCodec::convertAndDownsample(const PixelSource& in, int width, int height,
+                                      double* y, double* cr, double* cb, double* scratch,
+                                      const ColorFormat& format, int bitDepth)
+{
+    if constexpr (CS == ChromaSubsampling::CS_444) {
+        convertRows(in, width, height, y, cr, cb, format, bitDepth);
+    } else {
+        constexpr int cellRows = 1 << ChromaShift<CS>::y;
+        const int chromaWidth = (width + 1) >> 1;
+        double* crRows = scratch;
+        double* cbRows = scratch + 2 * static_cast<size_t>(width);
+
+        for (int y0 = 0, row = 0; y0 < height; y0 += cellRows, ++row) {
+            const int rows = std::min(cellRows, height - y0);
+            const size_t offset = static_cast<size_t>(y0) * width;
+            convertRows(in.rowsFrom(y0), width, rows, y + offset, crRows, cbRows, format, bitDepth);
+            downsampleChannel<CS>(crRows, width, rows, cr + static_cast<size_t>(row) * chromaWidth);
+            downsampleChannel<CS>(cbRows, width, rows, cb + static_cast<size_t>(row) * chromaWidth);
+        }
+    }
+}
+
+/*
+* Triangle ("fancy") 2× horizontal upsampling of one chroma row: every output
+* sample is 3/4 of its own chroma sample plus 1/4 of the nearer neighbour,
+* which matches the centred siting of the 2:1 box filter. Edges repeat.
+*/
+static void upsampleRowFancy(const double* in, int chromaWidth, double* out, int width)
+{
+    if (chromaWidth == 1) {
+        std::fill(out, out + width, in[0]);
+        return;
+    }
+
+    out[0] = in[0];
+    out[1] = 0.75 * in[0] + 0.25 * in[1];
+    // Branch-free interior so the loop vectorises.
+    for (int x = 1; x < chromaWidth - 1; ++x) {
+        const double centre = 0.75 * in[x];
+        out[2 * x]     = centre + 0.25 * in[x - 1];
+        out[2 * x + 1] = centre + 0.25 * in[x + 1];
+    }
+    const int last = chromaWidth - 1;
+    out[2 * last] = 0.75 * in[last] + 0.25 * in[last - 1];
+    if (2 * last + 1 < width)
+        out[2 * last + 1] = in[last];
+}
+
+/*
+* Upsamples the coded chroma of `height` image rows with the triangle filter
+* (vertically too for 4:2:0) and converts straight into the rows of `out`,
+* one row at a time: chroma only ever exists at full resolution as one row in
+* `scratch` (2 × width + 2 × chromaWidth samples). For 4:2:0, `chromaAbove`
+* and `chromaBelow` may hold the {Cr, Cb} chroma rows just outside the
+* block so that strips blend across their edges; without them the edge
+* rows repeat.
+*/
+template <ImageCodec::ChromaSubsampling CS>
+void ImageCodec::upsampleToBgr(const double* y, const double* cr, const double* cb,
+                               int width, int height, int chromaWidth,
+                               const double* const* chromaAbove, const double* const* chromaBelow,
+                               double* scratch, const PixelSink& out, const ColorFormat& format,
+                               int bitDepth)
+{
+    if constexpr (CS == ChromaSubsampling::CS_444) {
+        writeRows(y, cr, cb, width, height, out, format, bitDepth);
+    } else {
+        constexpr int sy = ChromaShift<CS>::y;
+        const int chromaHeight = (height + (1 << sy) - 1) >> sy;
+        double* crRow = scratch;
+        double* cbRow = scratch + width;
+        double* crBlend = scratch + 2 * static_cast<size_t>(width);
+        double* cbBlend = crBlend + chromaWidth;
+
+        for (int row = 0; row < height; ++row) {
+            const int c = row >> sy;
+            const double* crNear = cr + static_cast<size_t>(c) * chromaWidth;
+            const double* cbNear = cb + static_cast<size_t>(c) * chromaWidth;
+            const double* crIn = crNear;
+            const double* cbIn = cbNear;
+
+            if constexpr (sy == 1) {
+                // Even rows lean on the chroma row above, odd rows on the one below.
+                const double* crFar = crNear;
+                const double* cbFar = cbNear;
+                if (!(row & 1)) {
+                    if (c > 0) {
+                        crFar = crNear - chromaWidth;
+                        cbFar = cbNear - chromaWidth;
+                    } else if (chromaAbove) {
+                        crFar = chromaAbove[0];
+                        cbFar = chromaAbove[1];
+                    }
+                } else {
+                    if (c + 1 < chromaHeight) {
+                        crFar = crNear + chromaWidth;
+                        cbFar = cbNear + chromaWidth;
+                    } else if (chromaBelow) {
+                        crFar = chromaBelow[0];
+                        cbFar = chromaBelow[1];
+                    }
+                }
+                for (int x = 0; x < chromaWidth; ++x) {
+                    crBlend[x] = 0.75 * crNear[x] + 0.25 * crFar[x];
+                    cbBlend[x] = 0.75 * cbNear[x] + 0.25 * cbFar[x];
+                }
+                crIn = crBlend;
+                cbIn = cbBlend;
             }
-            
-            // Clamp to valid source coordinates
-            srcX = std::min(srcX, currentWidth - 1);
-            srcY = std::min(srcY, currentHeight - 1);
 
-            upsampled.at(x, y, 0) = channel.at(srcX, srcY, 0);
+            upsampleRowFancy(crIn, chromaWidth, crRow, width);
+            upsampleRowFancy(cbIn, chromaWidth, cbRow, width);
+            const size_t offset = static_cast<size_t>(row) * width;
+            writeRows(y + offset, crRow, cbRow, width, 1, out.rowsFrom(row), format, bitDepth);
         }
     }
-    return upsampled;
 }
 
 /*
 * Main processing function that takes a BGR image, converts it to YCrCb, processes each channel, and then converts it back to BGR.
 */
 Image ImageCodec::process(const Image& bgrImage)
+{
+    Image out;
+    process(bgrImage, out);
+    return out;
+}
+
+void ImageCodec::process(const Image& bgrImage, Image& out)
+{
+    const int width = bgrImage.width();
+    const int height = bgrImage.height();
+    out.resize(width, height, 3);
+    processPixels(imageSource(bgrImage), width, height, imageSink(out));
+}
+
+void ImageCodec::process(const PackedImage& in, const PackedTarget& out)
+{
+    processPixels(packedSource(in, m_bitDepth), in.width, in.height, packedSink(out, in.width, m_bitDepth));
+}
+
+void ImageCodec::processPixels(const PixelSource& in, int width, int height, const PixelSink& out)
+{
+    using Pipeline = void (ImageCodec::*)(const PixelSource&, int, int, const PixelSink&);
+    using CS = ChromaSubsampling;
+    using TT = TransformType;
+
+    // Indexed by [transform][subsampling][quantize].
+    static const Pipeline PIPELINES[3][3][2] = {
+        {
+            { &ImageCodec::runPipeline<TT::DCT, CS::CS_444, false>, &ImageCodec::runPipeline<TT::DCT, CS::CS_444, true> },
+            { &ImageCodec::runPipeline<TT::DCT, CS::CS_422, false>, &ImageCodec::runPipeline<TT::DCT, CS::CS_422, true> },
+            { &ImageCodec::runPipeline<TT::DCT, CS::CS_420, false>, &ImageCodec::runPipeline<TT::DCT, CS::CS_420, true> },
+        },
+        {
+            { &ImageCodec::runPipeline<TT::DWT, CS::CS_444, false>, &ImageCodec::runPipeline<TT::DWT, CS::CS_444, true> },
+            { &ImageCodec::runPipeline<TT::DWT, CS::CS_422, false>, &ImageCodec::runPipeline<TT::DWT, CS::CS_422, true> },
+            { &ImageCodec::runPipeline<TT::DWT, CS::CS_420, false>, &ImageCodec::runPipeline<TT::DWT, CS::CS_420, true> },
+        },
+        {
+            { &ImageCodec::runPipeline<TT::Adaptive, CS::CS_444, false>, &ImageCodec::runPipeline<TT::Adaptive, CS::CS_444, true> },
+            { &ImageCodec::runPipeline<TT::Adaptive, CS::CS_422, false>, &ImageCodec::runPipeline<TT::Adaptive, CS::CS_422, true> },
+            { &ImageCodec::runPipeline<TT::Adaptive, CS::CS_420, false>, &ImageCodec::runPipeline<TT::Adaptive, CS::CS_420, true> },
+        },
+    };
+
+    // Strip variants of the block-DCT pipeline, indexed by [subsampling][quantize].
+    static const Pipeline STRIP_PIPELINES[3][2] = {
+        { &ImageCodec::runStripPipeline<CS::CS_444, false>, &ImageCodec::runStripPipeline<CS::CS_444, true> },
+        { &ImageCodec::runStripPipeline<CS::CS_422, false>, &ImageCodec::runStripPipeline<CS::CS_422, true> },
+        { &ImageCodec::runStripPipeline<CS::CS_420, false>, &ImageCodec::runStripPipeline<CS::CS_420, true> },
+    };
+
+    const int cs = static_cast<int>(m_chromaSubsampling);
+    const int quantize = m_enableQuantization ? 1 : 0;
+    const Pipeline pipeline = (m_stripProcessing && m_transformType == TransformType::DCT)
+                            ? STRIP_PIPELINES[cs][quantize]
+                            : PIPELINES[static_cast<int>(m_transformType)][cs][quantize];
+    (this->*pipeline)(in, width, height, out);
+}
+
+template <ImageCodec::TransformType TT, ImageCodec::ChromaSubsampling CS, bool Quantize>
+void ImageCodec::runPipeline(const PixelSource& in, int width, int height, const PixelSink& out)
 {
     m_lastBitEstimate = 0.0; // Reset for new process
-    Image ycrcbImage = bgrToYCrCb(bgrImage);
+    m_blockStats = BlockStats();
+    m_arena.reset();
 
-    Image Y_orig (bgrImage.width(), bgrImage.height(), 1);
-    Image Cr_orig(bgrImage.width(), bgrImage.height(), 1);
-    Image Cb_orig(bgrImage.width(), bgrImage.height(), 1);
+    const size_t numPixels = static_cast<size_t>(width) * height; // Total pixels in original image
 
-    const size_t numPixels = static_cast<size_t>(bgrImage.width()) * bgrImage.height(); // Total pixels in original image
-    const double* ycrcbData = ycrcbImage.data();
-    double* yData = Y_orig.data();
-    double* crData = Cr_orig.data();
-    double* cbData = Cb_orig.data();
+    // Colour convert straight into planar Y and coded-resolution Cr, Cb, so
+    // region selection sees the chroma that will be coded.
+    const int chromaWidth = (width + (1 << ChromaShift<CS>::x) - 1) >> ChromaShift<CS>::x;
+    const int chromaHeight = (height + (1 << ChromaShift<CS>::y) - 1) >> ChromaShift<CS>::y;
+    const size_t chromaPixels = static_cast<size_t>(chromaWidth) * chromaHeight;
+    double* yPlane  = m_arena.allocate(numPixels);
+    double* codedCr = m_arena.allocate(chromaPixels);
+    double* codedCb = m_arena.allocate(chromaPixels);
+    double* scratch = m_arena.allocate(4 * static_cast<size_t>(width));
+    convertAndDownsample<CS>(in, width, height, yPlane, codedCr, codedCb, scratch, m_colorFormat, m_bitDepth);
 
-    // Split channels
-    for (size_t i = 0; i < numPixels; ++i) {
-        yData[i]  = *ycrcbData++;
-        crData[i] = *ycrcbData++;
-        cbData[i] = *ycrcbData++;
-    }
+    if constexpr (TT == TransformType::Adaptive)
+        selectRegionModes<Quantize>(yPlane, codedCr, codedCb, width, height, chromaWidth, chromaHeight);
 
     // Process Y channel (always at full resolution)
-    Image reconY = (m_transformType == TransformType::DWT)
-                   ? processChannelDWT(Y_orig)
-                   : processChannel(Y_orig, m_lumaQuantTable);
-
-    Image reconCr_final;
-    Image reconCb_final;
-
-    if (m_chromaSubsampling == ChromaSubsampling::CS_444) {
-        reconCr_final = (m_transformType == TransformType::DWT)
-                        ? processChannelDWT(Cr_orig)
-                        : processChannel(Cr_orig, m_chromaQuantTable);
-        reconCb_final = (m_transformType == TransformType::DWT)
-                        ? processChannelDWT(Cb_orig)
-                        : processChannel(Cb_orig, m_chromaQuantTable);
-    } else {
-        // Downsample Cr and Cb
-        Image downsampledCr = downsampleChannel(Cr_orig, m_chromaSubsampling);
-        Image downsampledCb = downsampleChannel(Cb_orig, m_chromaSubsampling);
-
-        // Process subsampled Cr and Cb
-        Image reconCr_sub = (m_transformType == TransformType::DWT)
-                            ? processChannelDWT(downsampledCr)
-                            : processChannel(downsampledCr, m_chromaQuantTable);
-        Image reconCb_sub = (m_transformType == TransformType::DWT)
-                            ? processChannelDWT(downsampledCb)
-                            : processChannel(downsampledCb, m_chromaQuantTable);
-
-        // Upsample Cr and Cb back to original dimensions
-        reconCr_final = upsampleChannel(reconCr_sub, bgrImage.width(), bgrImage.height(), m_chromaSubsampling);
-        reconCb_final = upsampleChannel(reconCb_sub, bgrImage.width(), bgrImage.height(), m_chromaSubsampling);
-    }
-
-    // Merge channels
-    Image merged(bgrImage.width(),
-                 bgrImage.height(),
-                 3);
-    
-    double* mergedData = merged.data();
-    const double* reconYData = reconY.data();
-    const double* reconCrData = reconCr_final.data();
-    const double* reconCbData = reconCb_final.data();
-    
-    for (size_t i = 0; i < numPixels; ++i) {
-        *mergedData++ = reconYData[i];
-        *mergedData++ = reconCrData[i];
-        *mergedData++ = reconCbData[i];
+    double* reconY = m_arena.allocate(numPixels);
+    processPlane<TT, Quantize>(yPlane, width, height, reconY, m_lumaQuantTable,
+                               prepareQpScaleMap(width, height), prepareIntraModeMap(width, height),
+                               prepareQuantizedPlane(m_quantized.y, width, height));
+
+    double* reconCr = m_arena.allocate(chromaPixels);
+    double* reconCb = m_arena.allocate(chromaPixels);
+    processPlane<TT, Quantize>(codedCr, chromaWidth, chromaHeight, reconCr, m_chromaQuantTable,
+                               nullptr, nullptr,
+                               prepareQuantizedPlane(m_quantized.cr, chromaWidth, chromaHeight));
+    processPlane<TT, Quantize>(codedCb, chromaWidth, chromaHeight, reconCb, m_chromaQuantTable,
+                               nullptr, nullptr,
+                               prepareQuantizedPlane(m_quantized.cb, chromaWidth, chromaHeight));
+
+    // Upsample chroma and convert back to BGR in a single pass.
+    double* upsampleScratch = m_arena.allocate(2 * static_cast<size_t>(width + chromaWidth));
+    upsampleToBgr<CS>(reconY, reconCr, reconCb, width, height, chromaWidth, nullptr, nullptr,
+                      upsampleScratch, out, m_colorFormat, m_bitDepth);
+}
+
+void ImageCodec::analyze(const Image& bgrImage, CoefficientCache& cache)
+{
+    analyzePixels(imageSource(bgrImage), bgrImage.width(), bgrImage.height(), cache);
+}
+
+void ImageCodec::analyze(const PackedImage& in, CoefficientCache& cache)
+{
+    analyzePixels(packedSource(in, m_bitDepth), in.width, in.height, cache);
+}
+
+void ImageCodec::analyzePixels(const PixelSource& in, int width, int height, CoefficientCache& cache)
+{
+    using Analysis = void (ImageCodec::*)(const PixelSource&, int, int, CoefficientCache&);
+    using CS = ChromaSubsampling;
+    using TT = TransformType;
+
+    // Indexed by [transform][subsampling].
+    static const Analysis ANALYSES[3][3] = {
+        { &ImageCodec::runAnalysis<TT::DCT, CS::CS_444>, &ImageCodec::runAnalysis<TT::DCT, CS::CS_422>,
+          &ImageCodec::runAnalysis<TT::DCT, CS::CS_420> },
+        { &ImageCodec::runAnalysis<TT::DWT, CS::CS_444>, &ImageCodec::runAnalysis<TT::DWT, CS::CS_422>,
+          &ImageCodec::runAnalysis<TT::DWT, CS::CS_420> },
+        { &ImageCodec::runAnalysis<TT::Adaptive, CS::CS_444>, &ImageCodec::runAnalysis<TT::Adaptive, CS::CS_422>,
+          &ImageCodec::runAnalysis<TT::Adaptive, CS::CS_420> },
+    };
+
+    const Analysis analysis = ANALYSES[static_cast<int>(m_transformType)]
+                                      [static_cast<int>(m_chromaSubsampling)];
+    (this->*analysis)(in, width, height, cache);
+}
+
+bool ImageCodec::canReconstruct(const CoefficientCache& cache) const
+{
+    return !cache.empty() &&
+           cache.chromaSubsampling == m_chromaSubsampling &&
+           cache.transformType == m_transformType &&
+           cache.intraPrediction == usesIntraPrediction() &&
+           cache.bitDepth == m_bitDepth &&
+           cache.colorFormat == m_colorFormat;
+}
+
+void ImageCodec::reconstruct(const CoefficientCache& cache, Image& out)
+{
+    if (!canReconstruct(cache))
+        throw std::invalid_argument("Coefficient cache does not match the codec's subsampling, transform, prediction, bit depth and colour format");
+    out.resize(cache.width, cache.height, 3);
+    reconstructPixels(cache, imageSink(out));
+}
+
+void ImageCodec::reconstruct(const CoefficientCache& cache, const PackedTarget& out)
+{
+    if (!canReconstruct(cache))
+        throw std::invalid_argument("Coefficient cache does not match the codec's subsampling, transform, prediction, bit depth and colour format");
+    reconstructPixels(cache, packedSink(out, cache.width, m_bitDepth));
+}
+
+void ImageCodec::reconstructPixels(const CoefficientCache& cache, const PixelSink& out)
+{
+    using Reconstruction = void (ImageCodec::*)(const CoefficientCache&, const PixelSink&);
+    using CS = ChromaSubsampling;
+    using TT = TransformType;
+
+    // Indexed by [transform][subsampling][quantize].
+    static const Reconstruction RECONSTRUCTIONS[3][3][2] = {
+        {
+            { &ImageCodec::runReconstruction<TT::DCT, CS::CS_444, false>, &ImageCodec::runReconstruction<TT::DCT, CS::CS_444, true> },
+            { &ImageCodec::runReconstruction<TT::DCT, CS::CS_422, false>, &ImageCodec::runReconstruction<TT::DCT, CS::CS_422, true> },
+            { &ImageCodec::runReconstruction<TT::DCT, CS::CS_420, false>, &ImageCodec::runReconstruction<TT::DCT, CS::CS_420, true> },
+        },
+        {
+            { &ImageCodec::runReconstruction<TT::DWT, CS::CS_444, false>, &ImageCodec::runReconstruction<TT::DWT, CS::CS_444, true> },
+            { &ImageCodec::runReconstruction<TT::DWT, CS::CS_422, false>, &ImageCodec::runReconstruction<TT::DWT, CS::CS_422, true> },
+            { &ImageCodec::runReconstruction<TT::DWT, CS::CS_420, false>, &ImageCodec::runReconstruction<TT::DWT, CS::CS_420, true> },
+        },
+        {
+            { &ImageCodec::runReconstruction<TT::Adaptive, CS::CS_444, false>, &ImageCodec::runReconstruction<TT::Adaptive, CS::CS_444, true> },
+            { &ImageCodec::runReconstruction<TT::Adaptive, CS::CS_422, false>, &ImageCodec::runReconstruction<TT::Adaptive, CS::CS_422, true> },
+            { &ImageCodec::runReconstruction<TT::Adaptive, CS::CS_420, false>, &ImageCodec::runReconstruction<TT::Adaptive, CS::CS_420, true> },
+        },
+    };
+
+    const Reconstruction reconstruction = RECONSTRUCTIONS[static_cast<int>(m_transformType)]
+                                                         [static_cast<int>(m_chromaSubsampling)]
+                                                         [m_enableQuantization ? 1 : 0];
+    (this->*reconstruction)(cache, out);
+}
+
+double ImageCodec::estimateBits(const CoefficientCache& cache)
+{
+    if (!canReconstruct(cache))
+        throw std::invalid_argument("Coefficient cache does not match the codec's subsampling, transform, prediction, bit depth and colour format");
+
+    m_arena.reset();
+
+    const int sx = (cache.chromaSubsampling == ChromaSubsampling::CS_444) ? 0 : 1;
+    const int sy = (cache.chromaSubsampling == ChromaSubsampling::CS_420) ? 1 : 0;
+    const int chromaWidth = (cache.width + (1 << sx) - 1) >> sx;
+    const int chromaHeight = (cache.height + (1 << sy) - 1) >> sy;
+
+    // Region modes are chosen into a local map that is swapped in for the
+    // estimate, so getRegionMap() keeps describing the last coded frame.
+    Image regionMap;
+    const int regionFrameWidth = m_regionFrameWidth;
+    const int regionFrameHeight = m_regionFrameHeight;
+    std::swap(regionMap, m_regionMap);
+
+    // Accumulate in reconstruct()'s order so both report identical totals.
+    double bits = 0.0;
+    if (m_transformType == TransformType::Adaptive) {
+        accumulateBitsOf(bits, [&] {
+            if (m_enableQuantization)
+                selectRegionModes<true>(cache.y.data(), cache.cr.data(), cache.cb.data(),
+                                        cache.width, cache.height, chromaWidth, chromaHeight);
+            else
+                selectRegionModes<false>(cache.y.data(), cache.cr.data(), cache.cb.data(),
+                                         cache.width, cache.height, chromaWidth, chromaHeight);
+        });
+    }
+    accumulatePlaneBits(cache.y.data(), cache.width, cache.height, m_lumaQuantTable, m_adaptiveQuantization, bits);
+    accumulatePlaneBits(cache.cr.data(), chromaWidth, chromaHeight, m_chromaQuantTable, false, bits);
+    accumulatePlaneBits(cache.cb.data(), chromaWidth, chromaHeight, m_chromaQuantTable, false, bits);
+
+    std::swap(regionMap, m_regionMap);
+    m_regionFrameWidth = regionFrameWidth;
+    m_regionFrameHeight = regionFrameHeight;
+    return bits;
+}
+
+/*
+ * Runs `run` with the bit estimate continuing from `bits`, so the sum matches
+ * reconstruct()'s order exactly, and stores the result back in `bits`. The
+ * last call's estimate and block statistics are left untouched.
+ */
+template <typename Fn>
+void ImageCodec::accumulateBitsOf(double& bits, Fn&& run)
+{
+    const double lastBitEstimate = m_lastBitEstimate;
+    const BlockStats blockStats = m_blockStats;
+    m_lastBitEstimate = bits;
+    run();
+    bits = m_lastBitEstimate;
+    m_lastBitEstimate = lastBitEstimate;
+    m_blockStats = blockStats;
+}
+
+/*
+ * Adds the bits reconstructPlane() would estimate for one cached plane.
+ */
+void ImageCodec::accumulatePlaneBits(const double* coeffs, int width, int height,
+                                     const double quantTable[8][8], bool adaptive, double& bits)
+{
+    if (m_transformType == TransformType::DWT) {
+        const DwtLayout layout = dwtLayout(width, height);
+        const size_t count = static_cast<size_t>(layout.width) * layout.height;
+        double* buf = m_arena.allocate(count);
+        std::copy(coeffs, coeffs + count, buf);
+        if (m_enableQuantization)
+            quantizeChannelDWT(buf, layout.width, layout.height, layout.levels);
+        bits += dwtEstimateBits(buf, layout.width, layout.height, sampleUnit());
+        return;
     }
 
-    return ycrcbToBgr(merged);
+    if (m_transformType == TransformType::Adaptive) {
+        // DWT and skip regions are costed even without quantization.
+        double* scratch = m_arena.allocate(static_cast<size_t>(width) * height);
+        accumulateBitsOf(bits, [&] {
+            if (m_enableQuantization)
+                processChannelAdaptive<true>(coeffs, width, height, scratch, quantTable);
+            else
+                processChannelAdaptive<false>(coeffs, width, height, scratch, quantTable);
+        });
+        return;
+    }
+
+    // Unquantized DCT frames carry no bit estimate.
+    if (!m_enableQuantization)
+        return;
+
+    if (usesIntraPrediction()) {
+        // Residuals depend on the reconstruction, so run the full block loop.
+        double* scratch = m_arena.allocate(static_cast<size_t>(width) * height);
+        const size_t blocks = static_cast<size_t>((width + 7) / 8) * ((height + 7) / 8);
+        double* qpMap = adaptive ? m_arena.allocate(blocks) : nullptr;
+        accumulateBitsOf(bits, [&] {
+            processChannel<true>(coeffs, width, height, scratch, quantTable, qpMap);
+        });
+        return;
+    }
+
+    for (int y = 0; y + 8 <= height; y += 8) {
+        for (int x = 0; x + 8 <= width; x += 8) {
+            const size_t offset = static_cast<size_t>(y) * width + x;
+            double dctBlock[8][8];
+            for (int i = 0; i < 8; ++i)
+                for (int j = 0; j < 8; ++j)
+                    dctBlock[i][j] = coeffs[offset + static_cast<size_t>(i) * width + j];
+            double qpScale;
+            bits += quantizeDctBlock(dctBlock, quantTable, adaptive ? &qpScale : nullptr);
+        }
+    }
+}
+
+template <ImageCodec::TransformType TT, ImageCodec::ChromaSubsampling CS>
+void ImageCodec::runAnalysis(const PixelSource& in, int width, int height, CoefficientCache& cache)
+{
+    m_arena.reset();
+
+    const size_t numPixels = static_cast<size_t>(width) * height;
+
+    const int chromaWidth = (width + (1 << ChromaShift<CS>::x) - 1) >> ChromaShift<CS>::x;
+    const int chromaHeight = (height + (1 << ChromaShift<CS>::y) - 1) >> ChromaShift<CS>::y;
+    const size_t chromaPixels = static_cast<size_t>(chromaWidth) * chromaHeight;
+    double* yPlane  = m_arena.allocate(numPixels);
+    double* crPlane = m_arena.allocate(chromaPixels);
+    double* cbPlane = m_arena.allocate(chromaPixels);
+    double* scratch = m_arena.allocate(4 * static_cast<size_t>(width));
+    convertAndDownsample<CS>(in, width, height, yPlane, crPlane, cbPlane, scratch, m_colorFormat, m_bitDepth);
+
+    forwardPlane<TT>(yPlane, width, height, cache.y);
+    forwardPlane<TT>(crPlane, chromaWidth, chromaHeight, cache.cr);
+    forwardPlane<TT>(cbPlane, chromaWidth, chromaHeight, cache.cb);
+
+    cache.width = width;
+    cache.height = height;
+    cache.chromaSubsampling = CS;
+    cache.transformType = TT;
+    cache.intraPrediction = usesIntraPrediction();
+    cache.bitDepth = m_bitDepth;
+    cache.colorFormat = m_colorFormat;
+}
+
+template <ImageCodec::TransformType TT, ImageCodec::ChromaSubsampling CS, bool Quantize>
+void ImageCodec::runReconstruction(const CoefficientCache& cache, const PixelSink& out)
+{
+    m_lastBitEstimate = 0.0; // Reset for new process
+    m_blockStats = BlockStats();
+    m_arena.reset();
+
+    const int width = cache.width;
+    const int height = cache.height;
+    const size_t numPixels = static_cast<size_t>(width) * height;
+
+    const int chromaWidth = (width + (1 << ChromaShift<CS>::x) - 1) >> ChromaShift<CS>::x;
+    const int chromaHeight = (height + (1 << ChromaShift<CS>::y) - 1) >> ChromaShift<CS>::y;
+
+    if constexpr (TT == TransformType::Adaptive)
+        selectRegionModes<Quantize>(cache.y.data(), cache.cr.data(), cache.cb.data(),
+                                    width, height, chromaWidth, chromaHeight);
+
+    double* reconY = m_arena.allocate(numPixels);
+    reconstructPlane<TT, Quantize>(cache.y.data(), width, height, reconY, m_lumaQuantTable,
+                                   prepareQpScaleMap(width, height), prepareIntraModeMap(width, height),
+                                   prepareQuantizedPlane(m_quantized.y, width, height));
+
+    const size_t chromaPixels = static_cast<size_t>(chromaWidth) * chromaHeight;
+    double* reconCr = m_arena.allocate(chromaPixels);
+    double* reconCb = m_arena.allocate(chromaPixels);
+    reconstructPlane<TT, Quantize>(cache.cr.data(), chromaWidth, chromaHeight, reconCr, m_chromaQuantTable,
+                                   nullptr, nullptr,
+                                   prepareQuantizedPlane(m_quantized.cr, chromaWidth, chromaHeight));
+    reconstructPlane<TT, Quantize>(cache.cb.data(), chromaWidth, chromaHeight, reconCb, m_chromaQuantTable,
+                                   nullptr, nullptr,
+                                   prepareQuantizedPlane(m_quantized.cb, chromaWidth, chromaHeight));
+
+    double* upsampleScratch = m_arena.allocate(2 * static_cast<size_t>(width + chromaWidth));
+    upsampleToBgr<CS>(reconY, reconCr, reconCb, width, height, chromaWidth, nullptr, nullptr,
+                      upsampleScratch, out, m_colorFormat, m_bitDepth);
 }
 
 ImageCodec::BlockDebugData ImageCodec::inspectBlock(const Image& channel, int blockX, int blockY, bool isChroma) {
@@ -438,7 +1748,7 @@ ImageCodec::BlockDebugData ImageCodec::inspectBlock(const Image& channel, int bl
             int y = startY + i;
             int x = startX + j;
             if (x < width && y < height) {
-                data.original[i][j] = channelData[y * width + x];
+                data.original[i][j] = channelData[static_cast<size_t>(y) * width + x];
             }
         }
     }
@@ -447,19 +1757,30 @@ ImageCodec::BlockDebugData ImageCodec::inspectBlock(const Image& channel, int bl
     double blockCentered[8][8];
     for(int i=0; i<8; ++i)
         for(int j=0; j<8; ++j)
-            blockCentered[i][j] = data.original[i][j] - 128.0;
+            blockCentered[i][j] = data.original[i][j] - levelShift();
 
     if (m_transformType == TransformType::DWT)
         dwt8x8(blockCentered, data.coefficients);
     else
         dct8x8(blockCentered, data.coefficients);
 
+    // Adaptive quantization scales luma blocks' tables by their activity.
+    if (m_adaptiveQuantization && m_enableQuantization && !isChroma) {
+        const double scale = aqScale(data.coefficients, m_aqStrength, sampleUnit());
+        for(int i=0; i<8; ++i)
+            for(int j=0; j<8; ++j)
+                data.quantTable[i][j] = std::max(sampleUnit(), quantTable[i][j] * scale);
+    }
+
     // 4. Quantization
     if (m_enableQuantization) {
         for(int i=0; i<8; ++i) {
             for(int j=0; j<8; ++j) {
-                double coeff = data.coefficients[i][j] / quantTable[i][j];
-                data.quantized[i][j] = std::round(coeff); // Store integer index
+                double coeff = data.coefficients[i][j] / data.quantTable[i][j];
+                if (m_rdoQuantization && (i != 0 || j != 0))
+                    data.quantized[i][j] = rdoLevel(data.coefficients[i][j], data.quantTable[i][j], sampleUnit());
+                else
+                    data.quantized[i][j] = std::round(coeff); // Store integer index
             }
         }
     } else {
@@ -473,7 +1794,7 @@ ImageCodec::BlockDebugData ImageCodec::inspectBlock(const Image& channel, int bl
     for(int i=0; i<8; ++i) {
         for(int j=0; j<8; ++j) {
             if (m_enableQuantization)
-                dequantized[i][j] = data.quantized[i][j] * quantTable[i][j];
+                dequantized[i][j] = data.quantized[i][j] * data.quantTable[i][j];
             else
                 dequantized[i][j] = data.quantized[i][j];
         }
@@ -487,7 +1808,201 @@ ImageCodec::BlockDebugData ImageCodec::inspectBlock(const Image& channel, int bl
 
     for(int i=0; i<8; ++i)
         for(int j=0; j<8; ++j)
-            data.reconstructed[i][j] = reconBlock[i][j] + 128.0;
+            data.reconstructed[i][j] = reconBlock[i][j] + levelShift();
 
     return data;
-}
\ No newline at end of file
+}
+
+void ImageCodec::processStream(int width, int height, const RowReader& read, const RowWriter& write)
+{
+    if (width <= 0 || height <= 0)
+        throw std::invalid_argument("Invalid image dimensions");
+    if (m_transformType != TransformType::DCT)
+        throw std::logic_error("Only the block-DCT pipeline can be streamed");
+
+    using Pipeline = void (ImageCodec::*)(int, int, const RowReader&, const RowWriter&);
+    using CS = ChromaSubsampling;
+
+    // Indexed by [subsampling][quantize].
+    static const Pipeline STREAM_PIPELINES[3][2] = {
+        { &ImageCodec::runStreamPipeline<CS::CS_444, false>, &ImageCodec::runStreamPipeline<CS::CS_444, true> },
+        { &ImageCodec::runStreamPipeline<CS::CS_422, false>, &ImageCodec::runStreamPipeline<CS::CS_422, true> },
+        { &ImageCodec::runStreamPipeline<CS::CS_420, false>, &ImageCodec::runStreamPipeline<CS::CS_420, true> },
+    };
+
+    const Pipeline pipeline = STREAM_PIPELINES[static_cast<int>(m_chromaSubsampling)]
+                                              [m_enableQuantization ? 1 : 0];
+    (this->*pipeline)(width, height, read, write);
+}
+
+template <ImageCodec::ChromaSubsampling CS, bool Quantize>
+void ImageCodec::runStripPipeline(const PixelSource& in, int width, int height, const PixelSink& out)
+{
+    m_lastBitEstimate = 0.0; // Reset for new process
+    m_blockStats = BlockStats();
+    m_arena.reset();
+
+    // Read and write strips in place.
+    auto source = [&](int y0, int) { return in.rowsFrom(y0); };
+    auto sink = [&](int y0, int, auto&& fill) { fill(out.rowsFrom(y0)); };
+    runStrips<CS, Quantize>(width, height, source, sink);
+}
+
+template <ImageCodec::ChromaSubsampling CS, bool Quantize>
+void ImageCodec::runStreamPipeline(int width, int height, const RowReader& read, const RowWriter& write)
+{
+    m_lastBitEstimate = 0.0; // Reset for new process
+    m_blockStats = BlockStats();
+    m_arena.reset();
+
+    constexpr int MCU_ROWS = 8 << ChromaShift<CS>::y;
+    const size_t stripSamples = static_cast<size_t>(width) * MCU_ROWS * 3;
+    double* inStrip = m_arena.allocate(stripSamples);
+    double* outStrip = m_arena.allocate(stripSamples);
+
+    auto source = [&](int y0, int rows) {
+        read(y0, rows, inStrip);
+        PixelSource strip;
+        strip.bgr = inStrip;
+        strip.stride = static_cast<size_t>(width) * 3;
+        return strip;
+    };
+    auto sink = [&](int y0, int rows, auto&& fill) {
+        PixelSink strip;
+        strip.bgr = outStrip;
+        strip.stride = static_cast<size_t>(width) * 3;
+        fill(strip);
+        write(y0, rows, outStrip);
+    };
+    runStrips<CS, Quantize>(width, height, source, sink);
+}
+
+/*
+ * Block-DCT pipeline that walks the image one MCU row at a time. Every 8×8
+ * block, every chroma cell and every colour conversion only depends on rows
+ * inside its own MCU row, so running all stages strip by strip produces
+ * exactly the frame pipeline's output while touching only a few strips of
+ * working memory. Chroma upsampling is the exception: 4:2:0 blends with the
+ * chroma rows on either side of a strip, so each strip is written out once
+ * the next one has been coded. `source(y0, rows)` returns the strip's input
+ * rows as a PixelSource; `sink(y0, rows, fill)` calls `fill` with the
+ * PixelSink the strip's reconstruction is to be written to.
+ */
+template <ImageCodec::ChromaSubsampling CS, bool Quantize, typename Source, typename Sink>
+void ImageCodec::runStrips(int width, int height, Source& source, Sink& sink)
+{
+    constexpr int sy = ChromaShift<CS>::y;
+    constexpr int MCU_ROWS = 8 << sy;
+
+    const int chromaWidth = (width + (1 << ChromaShift<CS>::x) - 1) >> ChromaShift<CS>::x;
+    const size_t stripPixels = static_cast<size_t>(width) * MCU_ROWS;
+    const size_t chromaStripPixels = static_cast<size_t>(chromaWidth) * (MCU_ROWS >> sy);
+
+    double* yStrip  = m_arena.allocate(stripPixels);
+    double* crStrip = m_arena.allocate(chromaStripPixels);
+    double* cbStrip = m_arena.allocate(chromaStripPixels);
+    double* convertScratch = m_arena.allocate(4 * static_cast<size_t>(width));
+    double* upsampleScratch = m_arena.allocate(2 * static_cast<size_t>(width + chromaWidth));
+
+    // Reconstructions of the strip being coded and of the one waiting to be
+    // written out.
+    double* reconY[2];
+    double* reconCr[2];
+    double* reconCb[2];
+    for (int b = 0; b < 2; ++b) {
+        reconY[b]  = m_arena.allocate(stripPixels);
+        reconCr[b] = m_arena.allocate(chromaStripPixels);
+        reconCb[b] = m_arena.allocate(chromaStripPixels);
+    }
+
+    double* qpMap = prepareQpScaleMap(width, height);
+    double* modeMap = prepareIntraModeMap(width, height);
+    const size_t blocksX = static_cast<size_t>((width + 7) / 8);
+
+    // Intra prediction reaches into the previous MCU row; keep the last
+    // reconstructed row of each plane for the next strip.
+    const bool intra = usesIntraPrediction();
+    const int planeWidths[3] = { width, chromaWidth, chromaWidth };
+    double* aboveRows[3] = {};
+    if (intra)
+        for (int p = 0; p < 3; ++p)
+            aboveRows[p] = m_arena.allocate(static_cast<size_t>(planeWidths[p]));
+    const double* above[3] = {};
+
+    // Quantized levels of whole planes; each strip fills its block rows.
+    const int chromaHeight = (height + (1 << sy) - 1) >> sy;
+    const LevelOutput levels[3] = {
+        prepareQuantizedPlane(m_quantized.y, width, height),
+        prepareQuantizedPlane(m_quantized.cr, chromaWidth, chromaHeight),
+        prepareQuantizedPlane(m_quantized.cb, chromaWidth, chromaHeight),
+    };
+    const size_t chromaBlocksX = static_cast<size_t>((chromaWidth + 7) / 8);
+
+    auto keepLastRow = [&](int plane, const double* recon, int rows) {
+        if (!intra)
+            return;
+        const double* last = recon + static_cast<size_t>(rows - 1) * planeWidths[plane];
+        std::copy(last, last + planeWidths[plane], aboveRows[plane]);
+        above[plane] = aboveRows[plane];
+    };
+
+    // The last chroma row of the strip before the pending one, for 4:2:0
+    // upsampling across the strip edge.
+    double* chromaAboveRows[2] = {
+        m_arena.allocate(static_cast<size_t>(chromaWidth)),
+        m_arena.allocate(static_cast<size_t>(chromaWidth)),
+    };
+    bool haveChromaAbove = false;
+    int pending = -1; // Buffer of the coded strip not yet written out
+    int pendingY0 = 0, pendingRows = 0;
+
+    auto writePending = [&](const double* const* chromaBelow) {
+        const double* chromaAbove[2] = { chromaAboveRows[0], chromaAboveRows[1] };
+        sink(pendingY0, pendingRows, [&](const PixelSink& target) {
+            upsampleToBgr<CS>(reconY[pending], reconCr[pending], reconCb[pending], width, pendingRows,
+                              chromaWidth, haveChromaAbove ? chromaAbove : nullptr, chromaBelow,
+                              upsampleScratch, target, m_colorFormat, m_bitDepth);
+        });
+
+        const size_t lastRow = static_cast<size_t>(((pendingRows + (1 << sy) - 1) >> sy) - 1) * chromaWidth;
+        std::copy(reconCr[pending] + lastRow, reconCr[pending] + lastRow + chromaWidth, chromaAboveRows[0]);
+        std::copy(reconCb[pending] + lastRow, reconCb[pending] + lastRow + chromaWidth, chromaAboveRows[1]);
+        haveChromaAbove = true;
+        pending = -1;
+    };
+
+    for (int y0 = 0; y0 < height; y0 += MCU_ROWS) {
+        const int rows = std::min(MCU_ROWS, height - y0);
+        const int chromaRows = (rows + (1 << sy) - 1) >> sy;
+        const int b = (pending == 0) ? 1 : 0;
+
+        convertAndDownsample<CS>(source(y0, rows), width, rows, yStrip, crStrip, cbStrip, convertScratch,
+                                 m_colorFormat, m_bitDepth);
+
+        const size_t blockRow = static_cast<size_t>(y0 / 8) * blocksX;
+        const size_t chromaBlockRow = static_cast<size_t>(y0 / MCU_ROWS) * chromaBlocksX;
+        processChannel<Quantize>(yStrip, width, rows, reconY[b], m_lumaQuantTable,
+                                 qpMap ? qpMap + blockRow : nullptr,
+                                 modeMap ? modeMap + blockRow : nullptr, above[0],
+                                 levels[0].atBlock(blockRow));
+        processChannel<Quantize>(crStrip, chromaWidth, chromaRows, reconCr[b], m_chromaQuantTable,
+                                 nullptr, nullptr, above[1], levels[1].atBlock(chromaBlockRow));
+        processChannel<Quantize>(cbStrip, chromaWidth, chromaRows, reconCb[b], m_chromaQuantTable,
+                                 nullptr, nullptr, above[2], levels[2].atBlock(chromaBlockRow));
+        keepLastRow(0, reconY[b], rows);
+        keepLastRow(1, reconCr[b], chromaRows);
+        keepLastRow(2, reconCb[b], chromaRows);
+
+        if (pending >= 0) {
+            const double* chromaBelow[2] = { reconCr[b], reconCb[b] };
+            writePending(chromaBelow);
+        }
+        pending = b;
+        pendingY0 = y0;
+        pendingRows = rows;
+        if constexpr (sy == 0)
+            writePending(nullptr); // Nothing to wait for without vertical upsampling
+    }
+    if (pending >= 0)
+        writePending(nullptr);
+}
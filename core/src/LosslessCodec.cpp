@@ -0,0 +1,447 @@
+/*
+ * Codec Explorer: An interactive codec laboratory.
+ * Copyright (C) 2026 Abhinav Tanniru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "LosslessCodec.h"
+#include "colorspace.h"
+#include "wavelet.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint8_t MAGIC[4] = {'C', 'L', '5', '3'};
+constexpr uint8_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 15;
+constexpr uint32_t MAX_DIMENSION = 1u << 16;
+
+/*
+ * Binary range coder in the style of LZMA: 15-bit probabilities adapted
+ * with a shift of 5, carries propagated through a cached output byte.
+ * bit() codes `bit` against the probability of a zero and returns it, so
+ * the same modelling code drives the encoder and the decoder.
+ */
+constexpr int PROB_BITS = 15;
+constexpr uint16_t PROB_INIT = 1 << (PROB_BITS - 1);
+constexpr int ADAPT_SHIFT = 5;
+constexpr uint32_t TOP = 1u << 24;
+
+class RangeEncoder {
+public:
+    explicit RangeEncoder(std::vector<uint8_t>& out) : m_out(out) {}
+
+    int bit(uint16_t& prob, int bit) {
+        const uint32_t bound = (m_range >> PROB_BITS) * prob;
+        if (!bit) {
+            m_range = bound;
+            prob += ((1 << PROB_BITS) - prob) >> ADAPT_SHIFT;
+        } else {
+            m_low += bound;
+            m_range -= bound;
+            prob -= prob >> ADAPT_SHIFT;
+        }
+        normalize();
+        return bit;
+    }
+
+    // Equiprobable bit, no model.
+    int direct(int bit) {
+        m_range >>= 1;
+        if (bit) m_low += m_range;
+        normalize();
+        return bit;
+    }
+
+    void finish() {
+        for (int i = 0; i < 5; ++i) shiftLow();
+    }
+
+private:
+    void normalize() {
+        while (m_range < TOP) {
+            m_range <<= 8;
+            shiftLow();
+        }
+    }
+
+    void shiftLow() {
+        if (static_cast<uint32_t>(m_low) < 0xFF000000u || (m_low >> 32) != 0) {
+            const uint8_t carry = static_cast<uint8_t>(m_low >> 32);
+            uint8_t temp = m_cache;
+            do {
+                m_out.push_back(static_cast<uint8_t>(temp + carry));
+                temp = 0xFF;
+            } while (--m_cacheSize != 0);
+            m_cache = static_cast<uint8_t>(m_low >> 24);
+        }
+        ++m_cacheSize;
+        m_low = (m_low & 0x00FFFFFFu) << 8;
+    }
+
+    std::vector<uint8_t>& m_out;
+    uint64_t m_low = 0;
+    uint32_t m_range = 0xFFFFFFFFu;
+    uint8_t m_cache = 0;
+    uint64_t m_cacheSize = 1;
+};
+
+class RangeDecoder {
+public:
+    RangeDecoder(const uint8_t* data, size_t size) : m_data(data), m_size(size) {
+        for (int i = 0; i < 5; ++i) m_code = (m_code << 8) | next();
+    }
+
+    int bit(uint16_t& prob, int /*ignored*/) {
+        const uint32_t bound = (m_range >> PROB_BITS) * prob;
+        int bit;
+        if (m_code < bound) {
+            m_range = bound;
+            prob += ((1 << PROB_BITS) - prob) >> ADAPT_SHIFT;
+            bit = 0;
+        } else {
+            m_code -= bound;
+            m_range -= bound;
+            prob -= prob >> ADAPT_SHIFT;
+            bit = 1;
+        }
+        normalize();
+        return bit;
+    }
+
+    int direct(int /*ignored*/) {
+        m_range >>= 1;
+        int bit = 0;
+        if (m_code >= m_range) {
+            m_code -= m_range;
+            bit = 1;
+        }
+        normalize();
+        return bit;
+    }
+
+private:
+    uint8_t next() {
+        if (m_pos >= m_size) throw std::runtime_error("Lossless stream is truncated");
+        return m_data[m_pos++];
+    }
+
+    void normalize() {
+        while (m_range < TOP) {
+            m_range <<= 8;
+            m_code = (m_code << 8) | next();
+        }
+    }
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+    uint32_t m_code = 0;
+    uint32_t m_range = 0xFFFFFFFFu;
+};
+
+/*
+ * Adaptive model for one class of coefficients. Contexts bucket the
+ * magnitude of the already-coded neighbours: 0, 1-2, 3-6, 7-14, 15-30,
+ * 31-62, 63+.
+ */
+constexpr int CONTEXTS = 7;
+constexpr int PREFIX_CONTEXTS = 20;
+
+struct ValueModel {
+    uint16_t zero[CONTEXTS];
+    uint16_t sign[CONTEXTS];
+    uint16_t prefix[CONTEXTS][PREFIX_CONTEXTS];
+
+    ValueModel() {
+        std::fill_n(zero, CONTEXTS, PROB_INIT);
+        std::fill_n(sign, CONTEXTS, PROB_INIT);
+        std::fill_n(&prefix[0][0], CONTEXTS * PREFIX_CONTEXTS, PROB_INIT);
+    }
+};
+
+// One model for the LL band and one per decomposition level.
+struct PlaneModels {
+    ValueModel band[LosslessCodec::MAX_LEVELS + 1];
+};
+
+inline int contextOf(uint32_t magnitude) {
+    int ctx = 0;
+    for (uint32_t m = magnitude + 1; m > 1 && ctx < CONTEXTS - 1; m >>= 1) ++ctx;
+    return ctx;
+}
+
+/*
+ * Codes one value: zero flag, sign, then Exp-Golomb on the magnitude with an
+ * adaptive unary prefix and raw suffix bits. Returns the value coded (the
+ * decoder ignores `v`).
+ */
+template <class Coder>
+int32_t codeValue(Coder& rc, ValueModel& m, int ctx, int32_t v) {
+    if (!rc.bit(m.zero[ctx], v != 0)) return 0;
+    const int negative = rc.bit(m.sign[ctx], v < 0);
+
+    const uint32_t magnitude = static_cast<uint32_t>(std::abs(v));
+    int k = 0;
+    while ((magnitude >> (k + 1)) != 0) ++k;
+
+    // Valid streams never exceed 2^12; the cap keeps corrupt ones from
+    // overflowing the inverse wavelet.
+    int bits = 0;
+    while (rc.bit(m.prefix[ctx][std::min(bits, PREFIX_CONTEXTS - 1)], bits < k)) {
+        if (++bits > 24) throw std::runtime_error("Lossless stream is malformed");
+    }
+    uint32_t out = 1;
+    for (int i = bits - 1; i >= 0; --i)
+        out = (out << 1) | static_cast<uint32_t>(rc.direct((magnitude >> i) & 1));
+    return negative ? -static_cast<int32_t>(out) : static_cast<int32_t>(out);
+}
+
+inline int32_t medPredict(int32_t a, int32_t b, int32_t c) {
+    if (c >= std::max(a, b)) return std::min(a, b);
+    if (c <= std::min(a, b)) return std::max(a, b);
+    return a + b - c;
+}
+
+/*
+ * Codes the LL band of a `stride`-wide plane as MED prediction residuals.
+ * On decode `c` is filled in place.
+ */
+template <class Coder>
+void codeLowBand(Coder& rc, ValueModel& m, int32_t* c, int stride, int w, int h) {
+    std::vector<int32_t> residual(static_cast<size_t>(w) * h);
+    for (int y = 0; y < h; ++y) {
+        int32_t* row = c + static_cast<size_t>(y) * stride;
+        const int32_t* above = (y > 0) ? row - stride : row;
+        int32_t* res = residual.data() + static_cast<size_t>(y) * w;
+        const int32_t* resAbove = (y > 0) ? res - w : res;
+        for (int x = 0; x < w; ++x) {
+            int32_t pred;
+            if (y == 0) pred = (x > 0) ? row[x - 1] : 0;
+            else if (x == 0) pred = above[0];
+            else pred = medPredict(row[x - 1], above[x], above[x - 1]);
+
+            uint32_t mag = 0;
+            if (x > 0) mag += static_cast<uint32_t>(std::abs(res[x - 1]));
+            if (y > 0) mag += static_cast<uint32_t>(std::abs(resAbove[x]));
+            res[x] = codeValue(rc, m, contextOf(mag), row[x] - pred);
+            row[x] = pred + res[x];
+        }
+    }
+}
+
+/*
+ * Codes the [x0, x1) × [y0, y1) detail subband. The context is the
+ * magnitude of the left and top neighbours plus half of the two diagonal
+ * ones above.
+ */
+template <class Coder>
+void codeDetailBand(Coder& rc, ValueModel& m, int32_t* c, int stride,
+                    int x0, int x1, int y0, int y1) {
+    for (int y = y0; y < y1; ++y) {
+        int32_t* row = c + static_cast<size_t>(y) * stride;
+        const int32_t* above = (y > y0) ? row - stride : row;
+        for (int x = x0; x < x1; ++x) {
+            uint32_t mag = 0, diag = 0;
+            if (x > x0) mag += static_cast<uint32_t>(std::abs(row[x - 1]));
+            if (y > y0) {
+                mag += static_cast<uint32_t>(std::abs(above[x]));
+                if (x > x0) diag += static_cast<uint32_t>(std::abs(above[x - 1]));
+                if (x + 1 < x1) diag += static_cast<uint32_t>(std::abs(above[x + 1]));
+            }
+            row[x] = codeValue(rc, m, contextOf(mag + (diag >> 1)), row[x]);
+        }
+    }
+}
+
+/*
+ * Codes a wavelet-transformed plane: the LL band, then every level from the
+ * coarsest to the finest as HL, LH and HH.
+ */
+template <class Coder>
+void codePlane(Coder& rc, PlaneModels& models, int32_t* c, int w, int h, int levels) {
+    int ws[LosslessCodec::MAX_LEVELS + 1], hs[LosslessCodec::MAX_LEVELS + 1];
+    ws[0] = w;
+    hs[0] = h;
+    for (int lev = 0; lev < levels; ++lev) {
+        ws[lev + 1] = (ws[lev] + 1) / 2;
+        hs[lev + 1] = (hs[lev] + 1) / 2;
+    }
+
+    codeLowBand(rc, models.band[0], c, w, ws[levels], hs[levels]);
+    for (int lev = levels - 1; lev >= 0; --lev) {
+        ValueModel& m = models.band[lev + 1];
+        const int lw = ws[lev + 1], lh = hs[lev + 1];
+        codeDetailBand(rc, m, c, w, lw, ws[lev], 0, lh);       // HL
+        codeDetailBand(rc, m, c, w, 0, lw, lh, hs[lev]);       // LH
+        codeDetailBand(rc, m, c, w, lw, ws[lev], lh, hs[lev]); // HH
+    }
+}
+
+/*
+ * Rough coded size of a value, used only to choose between the wavelet and
+ * the spatial mode: zeros are nearly free, anything else costs about a bit
+ * plus its magnitude in bits.
+ */
+struct CostTable {
+    static constexpr int SIZE = 1024;
+    float cost[SIZE];
+
+    CostTable() {
+        cost[0] = 0.15f;
+        for (int i = 1; i < SIZE; ++i) cost[i] = 1.0f + std::log2(static_cast<float>(i));
+    }
+};
+
+inline double valueCost(int32_t v) {
+    static const CostTable table;
+    const uint32_t magnitude = static_cast<uint32_t>(std::abs(v));
+    return magnitude < CostTable::SIZE ? table.cost[magnitude]
+                                       : 1.0 + std::log2(static_cast<double>(magnitude));
+}
+
+double predictionCost(const int32_t* c, int w, int h) {
+    double cost = 0.0;
+    for (int y = 0; y < h; ++y) {
+        const int32_t* row = c + static_cast<size_t>(y) * w;
+        const int32_t* above = (y > 0) ? row - w : row;
+        for (int x = 0; x < w; ++x) {
+            int32_t pred;
+            if (y == 0) pred = (x > 0) ? row[x - 1] : 0;
+            else if (x == 0) pred = above[0];
+            else pred = medPredict(row[x - 1], above[x], above[x - 1]);
+            cost += valueCost(row[x] - pred);
+        }
+    }
+    return cost;
+}
+
+int levelsFor(int width, int height) {
+    int levels = 0;
+    while (levels < LosslessCodec::MAX_LEVELS && (width >= 2 || height >= 2)) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        ++levels;
+    }
+    return levels;
+}
+
+void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+uint32_t getU32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+} // namespace
+
+std::vector<uint8_t> LosslessCodec::encode(const Image& image) {
+    const int width = image.width(), height = image.height(), channels = image.channels();
+    if (image.empty() || (channels != 1 && channels != 3))
+        throw std::invalid_argument("LosslessCodec expects a 1- or 3-channel image");
+    if (static_cast<uint32_t>(width) > MAX_DIMENSION || static_cast<uint32_t>(height) > MAX_DIMENSION)
+        throw std::invalid_argument("LosslessCodec supports at most 65536 pixels per side");
+
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    const double* src = image.data();
+    for (size_t i = 0; i < numPixels * channels; ++i) {
+        if (!(src[i] >= 0.0 && src[i] <= 255.0) || src[i] != std::floor(src[i]))
+            throw std::invalid_argument("LosslessCodec expects integer samples in [0, 255]");
+    }
+
+    std::vector<int32_t> planes(numPixels * channels);
+    if (channels == 3) {
+        bgrToYCoCgR(src, numPixels, planes.data(), planes.data() + numPixels,
+                    planes.data() + 2 * numPixels);
+    } else {
+        for (size_t i = 0; i < numPixels; ++i) planes[i] = static_cast<int32_t>(src[i]);
+    }
+
+    // The wavelet wins on photographic content; flat graphics and sharp
+    // synthetic edges code better with spatial prediction alone (level 0:
+    // the whole plane is one MED-coded LL band).
+    std::vector<int32_t> coeffs(planes);
+    double waveletCost = 0.0, spatialCost = 0.0;
+    const int waveletLevels = levelsFor(width, height);
+    for (int ch = 0; ch < channels; ++ch) {
+        int32_t* plane = coeffs.data() + ch * numPixels;
+        dwt53Image(plane, width, height, waveletLevels);
+        for (size_t i = 0; i < numPixels; ++i) waveletCost += valueCost(plane[i]);
+        spatialCost += predictionCost(planes.data() + ch * numPixels, width, height);
+    }
+    const int levels = (waveletCost < spatialCost) ? waveletLevels : 0;
+    if (levels != 0) planes.swap(coeffs);
+
+    std::vector<uint8_t> out(MAGIC, MAGIC + 4);
+    out.push_back(VERSION);
+    out.push_back(static_cast<uint8_t>(channels));
+    putU32(out, static_cast<uint32_t>(width));
+    putU32(out, static_cast<uint32_t>(height));
+    out.push_back(static_cast<uint8_t>(levels));
+    out.reserve(HEADER_SIZE + numPixels * channels / 2);
+
+    RangeEncoder rc(out);
+    PlaneModels luma, chroma;
+    for (int ch = 0; ch < channels; ++ch) {
+        codePlane(rc, ch == 0 ? luma : chroma, planes.data() + ch * numPixels,
+                  width, height, levels);
+    }
+    rc.finish();
+    return out;
+}
+
+Image LosslessCodec::decode(const std::vector<uint8_t>& stream) {
+    if (stream.size() < HEADER_SIZE || !std::equal(MAGIC, MAGIC + 4, stream.begin()))
+        throw std::runtime_error("Not a lossless stream");
+    if (stream[4] != VERSION)
+        throw std::runtime_error("Unsupported lossless stream version");
+
+    const int channels = stream[5];
+    const uint32_t width = getU32(stream.data() + 6);
+    const uint32_t height = getU32(stream.data() + 10);
+    const int levels = stream[14];
+    if ((channels != 1 && channels != 3) || width == 0 || height == 0 ||
+        width > MAX_DIMENSION || height > MAX_DIMENSION ||
+        (levels != 0 && levels != levelsFor(static_cast<int>(width), static_cast<int>(height))))
+        throw std::runtime_error("Lossless stream header is malformed");
+
+    const size_t numPixels = static_cast<size_t>(width) * height;
+    std::vector<int32_t> planes(numPixels * channels, 0);
+
+    RangeDecoder rc(stream.data() + HEADER_SIZE, stream.size() - HEADER_SIZE);
+    PlaneModels luma, chroma;
+    for (int ch = 0; ch < channels; ++ch) {
+        int32_t* plane = planes.data() + ch * numPixels;
+        codePlane(rc, ch == 0 ? luma : chroma, plane, width, height, levels);
+        idwt53Image(plane, width, height, levels);
+    }
+
+    Image out(static_cast<int>(width), static_cast<int>(height), channels);
+    double* dst = out.data();
+    if (channels == 3) {
+        yCoCgRToBgr(planes.data(), planes.data() + numPixels, planes.data() + 2 * numPixels,
+                    numPixels, dst);
+    } else {
+        for (size_t i = 0; i < numPixels; ++i) dst[i] = planes[i];
+    }
+    for (size_t i = 0; i < numPixels * channels; ++i) {
+        if (dst[i] < 0.0 || dst[i] > 255.0)
+            throw std::runtime_error("Lossless stream is malformed");
+    }
+    return out;
+}
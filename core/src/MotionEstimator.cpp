@@ -91,7 +91,7 @@ std::vector<MotionVector> MotionEstimator::fullSearch(int blockSize,
     int rows = m_height / blockSize;
 
     std::vector<MotionVector> mvs;
-    mvs.reserve(static_cast<size_t>(cols * rows));
+    mvs.reserve(static_cast<size_t>(cols) * rows);
 
     for (int row = 0; row < rows; ++row) {
         for (int col = 0; col < cols; ++col) {
@@ -137,7 +137,7 @@ std::vector<MotionVector> MotionEstimator::threeStepSearch(int blockSize,
     int rows = m_height / blockSize;
 
     std::vector<MotionVector> mvs;
-    mvs.reserve(static_cast<size_t>(cols * rows));
+    mvs.reserve(static_cast<size_t>(cols) * rows);
 
     for (int row = 0; row < rows; ++row) {
         for (int col = 0; col < cols; ++col) {
@@ -210,7 +210,7 @@ Image MotionEstimator::computeResidual(int blockSize,
 
     for (int row = 0; row < rows; ++row) {
         for (int col = 0; col < cols; ++col) {
-            const MotionVector& mv = mvs[static_cast<size_t>(row * cols + col)];
+            const MotionVector& mv = mvs[static_cast<size_t>(row) * cols + col];
             int curX = col * blockSize;
             int curY = row * blockSize;
             int refX = curX + mv.dx;
@@ -245,7 +245,7 @@ std::vector<std::pair<int,int>> MotionEstimator::getSearchSteps(
         throw std::runtime_error("MotionEstimator: frames not loaded");
 
     std::vector<std::pair<int,int>> steps;
-    steps.reserve(static_cast<size_t>((2 * searchRange + 1) * (2 * searchRange + 1)));
+    steps.reserve(static_cast<size_t>(2 * searchRange + 1) * (2 * searchRange + 1));
 
     for (int dy = -searchRange; dy <= searchRange; ++dy) {
         for (int dx = -searchRange; dx <= searchRange; ++dx) {
@@ -0,0 +1,216 @@
+/*
+ * Codec Explorer: An interactive codec laboratory.
+ * Copyright (C) 2026 Abhinav Tanniru
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "RateDistortion.h"
+#include "CodecAnalysis.h"
+#include "colorspace.h"
+#include "parallel.h"
+#include <memory>
+#include <stdexcept>
+
+std::vector<RdPoint> RateDistortion::sweep(
+    const Image& bgrImage,
+    ImageCodec::ChromaSubsampling cs,
+    ImageCodec::TransformType transform,
+    int minQuality,
+    int maxQuality
+) {
+    ImageCodec::CoefficientCache cache;
+    ImageCodec(50.0, true, cs, transform).analyze(bgrImage, cache);
+    return sweep(bgrImage, cache, minQuality, maxQuality);
+}
+
+// Codec configured like the one that analysed `cache`, so it can
+// reconstruct it. Throws std::invalid_argument if the cache does not match
+// `bgrImage`; callers build one before starting any worker threads.
+static std::unique_ptr<ImageCodec> makeCodec(
+    const Image& bgrImage,
+    const ImageCodec::CoefficientCache& cache,
+    int quality
+) {
+    if (cache.empty() || cache.width != bgrImage.width() || cache.height != bgrImage.height())
+        throw std::invalid_argument("Coefficient cache does not match the image");
+
+    auto codec = std::make_unique<ImageCodec>(quality, true, cache.chromaSubsampling, cache.transformType);
+    codec->setBitDepth(cache.bitDepth);
+    codec->setIntraPrediction(cache.intraPrediction);
+    codec->setColorFormat(cache.colorFormat);
+    if (!codec->canReconstruct(cache))
+        throw std::invalid_argument("Coefficient cache cannot be reconstructed");
+    return codec;
+}
+
+std::vector<RdPoint> RateDistortion::sweep(
+    const Image& bgrImage,
+    const ImageCodec::CoefficientCache& cache,
+    int minQuality,
+    int maxQuality
+) {
+    if (minQuality < 1 || maxQuality > 100 || minQuality > maxQuality)
+        throw std::invalid_argument("Quality range must lie within [1, 100]");
+
+    std::vector<int> qualities(maxQuality - minQuality + 1);
+    for (size_t i = 0; i < qualities.size(); ++i)
+        qualities[i] = minQuality + static_cast<int>(i);
+    return sweep(bgrImage, cache, qualities);
+}
+
+std::vector<RdPoint> RateDistortion::sweep(
+    const Image& bgrImage,
+    const ImageCodec::CoefficientCache& cache,
+    const std::vector<int>& qualities
+) {
+    if (qualities.empty())
+        throw std::invalid_argument("Quality list must not be empty");
+    for (int quality : qualities)
+        if (quality < 1 || quality > 100)
+            throw std::invalid_argument("Qualities must lie within [1, 100]");
+
+    // Per-worker codec and buffers, reused across the qualities it handles.
+    // The first codec is built here so a bad cache throws before any thread
+    // starts.
+    struct Worker {
+        std::unique_ptr<ImageCodec> codec;
+        Image reconstructed;
+        CodecMetrics metrics;
+    };
+    std::vector<Worker> workers(parallelWorkerCount());
+    workers[0].codec = makeCodec(bgrImage, cache, qualities[0]);
+
+    // Points carry PSNR and SSIM only; skip the artifact map.
+    MetricsOptions options;
+    options.metrics = MetricsOptions::PSNR | MetricsOptions::SSIM;
+
+    const int count = static_cast<int>(qualities.size());
+    std::vector<RdPoint> points(count);
+
+    parallelFor(count, [&](int index, int w) {
+        Worker& worker = workers[w];
+        const int quality = qualities[index];
+        if (!worker.codec)
+            worker.codec = makeCodec(bgrImage, cache, quality);
+        else
+            worker.codec->setQuality(quality);
+
+        worker.codec->reconstruct(cache, worker.reconstructed);
+        CodecAnalysis::computeMetrics(bgrImage, worker.reconstructed, worker.metrics, cache.bitDepth, options);
+
+        RdPoint& point = points[index];
+        point.quality = quality;
+        point.bits = worker.codec->getLastBitEstimate();
+        point.psnrY = worker.metrics.psnrY;
+        point.psnrCr = worker.metrics.psnrCr;
+        point.psnrCb = worker.metrics.psnrCb;
+        point.ssimY = worker.metrics.ssimY;
+        point.ssimCr = worker.metrics.ssimCr;
+        point.ssimCb = worker.metrics.ssimCb;
+    });
+
+    return points;
+}
+
+RdTargetResult RateDistortion::encodeToTarget(
+    const Image& bgrImage,
+    ImageCodec::ChromaSubsampling cs,
+    ImageCodec::TransformType transform,
+    const RdTarget& target,
+    Image& out
+) {
+    ImageCodec::CoefficientCache cache;
+    ImageCodec(50.0, true, cs, transform).analyze(bgrImage, cache);
+    return encodeToTarget(bgrImage, cache, target, out);
+}
+
+// Luma plane of a BGR image as a single-channel Image.
+static void extractLuma(const Image& bgr, Image& luma, Image& scratch, int bitDepth)
+{
+    const size_t numPixels = static_cast<size_t>(bgr.width()) * bgr.height();
+    luma.resize(bgr.width(), bgr.height(), 1);
+    scratch.resize(bgr.width(), bgr.height(), 2);
+    bgrToYCrCbPlanar(bgr.data(), numPixels, luma.data(), scratch.data(), scratch.data() + numPixels,
+                     ColorFormat(), bitDepth);
+}
+
+RdTargetResult RateDistortion::encodeToTarget(
+    const Image& bgrImage,
+    const ImageCodec::CoefficientCache& cache,
+    const RdTarget& target,
+    Image& out
+) {
+    RdTargetResult result;
+    const std::unique_ptr<ImageCodec> codecPtr = makeCodec(bgrImage, cache, 50);
+    ImageCodec& codec = *codecPtr;
+    const int bitDepth = cache.bitDepth;
+    int quality;
+
+    if (target.kind == RdTarget::Kind::MaxBits) {
+        // Highest feasible quality in [lo, hi]; lo == 0 means none so far.
+        int lo = 0, hi = 100;
+        while (lo < hi) {
+            const int mid = (lo + hi + 1) / 2;
+            codec.setQuality(mid);
+            ++result.iterations;
+            if (codec.estimateBits(cache) <= target.value)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        result.met = (lo > 0);
+        quality = result.met ? lo : 1;
+    } else {
+        Image originalY, reconY, scratch, recon;
+        extractLuma(bgrImage, originalY, scratch, bitDepth);
+
+        // Lowest feasible quality in [lo, hi]; hi == 101 means none so far.
+        int lo = 1, hi = 101;
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            codec.setQuality(mid);
+            ++result.iterations;
+            codec.reconstruct(cache, recon);
+            extractLuma(recon, reconY, scratch, bitDepth);
+            const double score = (target.kind == RdTarget::Kind::MinPsnrY)
+                ? CodecAnalysis::computePSNR(originalY, reconY, bitDepth)
+                : CodecAnalysis::computeSSIM(originalY, reconY, bitDepth);
+            if (score >= target.value)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        result.met = (lo <= 100);
+        quality = result.met ? lo : 100;
+    }
+
+    // Final encode at the chosen quality; identical to ImageCodec::process().
+    codec.setQuality(quality);
+    codec.reconstruct(cache, out);
+    CodecMetrics metrics;
+    MetricsOptions options;
+    options.metrics = MetricsOptions::PSNR | MetricsOptions::SSIM;
+    CodecAnalysis::computeMetrics(bgrImage, out, metrics, bitDepth, options);
+
+    RdPoint& point = result.point;
+    point.quality = quality;
+    point.bits = codec.getLastBitEstimate();
+    point.psnrY = metrics.psnrY;
+    point.psnrCr = metrics.psnrCr;
+    point.psnrCb = metrics.psnrCb;
+    point.ssimY = metrics.ssimY;
+    point.ssimCr = metrics.ssimCr;
+    point.ssimCb = metrics.ssimCb;
+    return result;
+}
@@ -17,51 +17,551 @@
  */
 #include "colorspace.h"
 #include <algorithm> // For std::min/max
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
 
-Image bgrToYCrCb(const Image& input)
+namespace {
+
+// Matrix coefficients: luma weights, the forward chroma scales
+// 0.5 / (1 - Kr) and 0.5 / (1 - Kb), and the inverse chroma terms, all to
+// six decimals so forward and inverse stay consistent at 16-bit depth.
+// BT.601 used to round its forward scales to 0.713 and 0.564. Those are
+// 0.04% off the inverse, which costs about 11 codes in a 16-bit round
+// trip. The exact values move default 8-bit chroma by under 0.08.
+struct MatrixCoefficients {
+    double kr, kg, kb;
+    double crScale, cbScale;
+    double rCr, gCb, gCr, bCb;
+};
+
+const MatrixCoefficients MATRICES[] = {
+    // BT.601
+    { 0.299,  0.587,  0.114,  0.713267, 0.564334, 1.402,  0.344136, 0.714136, 1.772  },
+    // BT.709
+    { 0.2126, 0.7152, 0.0722, 0.635001, 0.538909, 1.5748, 0.187324, 0.468124, 1.8556 },
+    // BT.2020 (non-constant luminance)
+    { 0.2627, 0.6780, 0.0593, 0.678150, 0.531519, 1.4746, 0.164553, 0.571353, 1.8814 },
+};
+
+// A matrix with the range scaling folded in, for samples of `bitDepth` bits.
+struct Conversion {
+    double kr, kg, kb;
+    double yScale, yOffset;     // Y = Yfull * yScale + yOffset
+    double crScale, cbScale;    // C = (X - Yfull) * scale + chromaOffset
+    double yInvScale;           // Yfull = (Y - yOffset) * yInvScale
+    double rCr, gCb, gCr, bCb;
+    double chromaOffset;
+    double maxValue;
+};
+
+Conversion makeConversion(const ColorFormat& format, int bitDepth)
 {
-    Image output(input.width(), input.height(), 3);
-    const double* pIn = input.data();
-    double* pOut = output.data();
-    const size_t numPixels = static_cast<size_t>(input.width()) * input.height();
+    const MatrixCoefficients& m = MATRICES[static_cast<int>(format.matrix)];
+    const double unit = static_cast<double>(1 << (bitDepth - 8));
+    const double maxValue = static_cast<double>((1 << bitDepth) - 1);
+
+    double yScale = 1.0, yOffset = 0.0, chromaScale = 1.0;
+    if (format.range == ColorRange::Limited) {
+        yScale = 219.0 * unit / maxValue;
+        yOffset = 16.0 * unit;
+        chromaScale = 224.0 * unit / maxValue;
+    }
+
+    Conversion c;
+    c.kr = m.kr;
+    c.kg = m.kg;
+    c.kb = m.kb;
+    c.yScale = yScale;
+    c.yOffset = yOffset;
+    c.crScale = m.crScale * chromaScale;
+    c.cbScale = m.cbScale * chromaScale;
+    c.yInvScale = 1.0 / yScale;
+    c.rCr = m.rCr / chromaScale;
+    c.gCb = m.gCb / chromaScale;
+    c.gCr = m.gCr / chromaScale;
+    c.bCb = m.bCb / chromaScale;
+    c.chromaOffset = 128.0 * unit;
+    c.maxValue = maxValue;
+    return c;
+}
+
+// Floating-point kernels shared by the interleaved, planar, double, float
+// and packed entry points. `Stride` is the pixel size in samples and
+// `B` the index of blue (red sits at 2 - B). Coefficients are copied to
+// locals so the loops carry no aliasing hazards and vectorise.
+template <int Stride, int B, typename In, typename T>
+void forwardFloat(const In* pixels, size_t numPixels,
+                  T* y, T* cr, T* cb, size_t planeStride, const Conversion& c)
+{
+    constexpr int R = 2 - B;
+    const T kr = static_cast<T>(c.kr), kg = static_cast<T>(c.kg), kb = static_cast<T>(c.kb);
+    const T yScale = static_cast<T>(c.yScale), yOffset = static_cast<T>(c.yOffset);
+    const T crScale = static_cast<T>(c.crScale), cbScale = static_cast<T>(c.cbScale);
+    const T offset = static_cast<T>(c.chromaOffset);
+
+    for (size_t i = 0; i < numPixels; ++i) {
+        const T Bv = static_cast<T>(pixels[i * Stride + B]);
+        const T Gv = static_cast<T>(pixels[i * Stride + 1]);
+        const T Rv = static_cast<T>(pixels[i * Stride + R]);
+        const T Y = kr * Rv + kg * Gv + kb * Bv;
+        y[i * planeStride]  = Y * yScale + yOffset;
+        cr[i * planeStride] = (Rv - Y) * crScale + offset;
+        cb[i * planeStride] = (Bv - Y) * cbScale + offset;
+    }
+}
+
+// Integer outputs are rounded to nearest after clamping.
+template <int Stride, int B, typename T, typename Out>
+void inverseFloat(const T* y, const T* cr, const T* cb, size_t planeStride,
+                  size_t numPixels, Out* pixels, const Conversion& c)
+{
+    constexpr int R = 2 - B;
+    const T yOffset = static_cast<T>(c.yOffset), yInvScale = static_cast<T>(c.yInvScale);
+    const T rCr = static_cast<T>(c.rCr), gCb = static_cast<T>(c.gCb);
+    const T gCr = static_cast<T>(c.gCr), bCb = static_cast<T>(c.bCb);
+    const T offset = static_cast<T>(c.chromaOffset);
+    const T maxValue = static_cast<T>(c.maxValue);
+    auto clamp = [maxValue](T val) { return std::max(T(0), std::min(maxValue, val)); };
+    auto store = [](T val) {
+        if constexpr (std::is_integral<Out>::value)
+            return static_cast<Out>(val + T(0.5));
+        else
+            return static_cast<Out>(val);
+    };
+
+    for (size_t i = 0; i < numPixels; ++i) {
+        const T Y = (y[i * planeStride] - yOffset) * yInvScale;
+        const T Cr = cr[i * planeStride] - offset;
+        const T Cb = cb[i * planeStride] - offset;
+        pixels[i * Stride + R] = store(clamp(Y + rCr * Cr));
+        pixels[i * Stride + 1] = store(clamp(Y - gCb * Cb - gCr * Cr));
+        pixels[i * Stride + B] = store(clamp(Y + bCb * Cb));
+    }
+}
+
+// Calls `fn` with the pixel stride and blue index of `layout` as template
+// constants and a value of its sample type.
+template <typename Fn>
+void withLayout(PixelLayout layout, Fn&& fn)
+{
+    using Three = std::integral_constant<int, 3>;
+    using Four = std::integral_constant<int, 4>;
+    using BlueFirst = std::integral_constant<int, 0>;
+    using BlueLast = std::integral_constant<int, 2>;
+    switch (layout) {
+        case PixelLayout::BGR8:   fn(Three(), BlueFirst(), uint8_t());  break;
+        case PixelLayout::RGB8:   fn(Three(), BlueLast(),  uint8_t());  break;
+        case PixelLayout::BGRA8:  fn(Four(),  BlueFirst(), uint8_t());  break;
+        case PixelLayout::RGBA8:  fn(Four(),  BlueLast(),  uint8_t());  break;
+        case PixelLayout::BGR16:  fn(Three(), BlueFirst(), uint16_t()); break;
+        case PixelLayout::RGB16:  fn(Three(), BlueLast(),  uint16_t()); break;
+        case PixelLayout::BGRA16: fn(Four(),  BlueFirst(), uint16_t()); break;
+        case PixelLayout::RGBA16: fn(Four(),  BlueLast(),  uint16_t()); break;
+    }
+}
+
+// Fixed-point kernels. `Acc` must hold |sample| * 2^(Bits + 2) without
+// overflow. The luma weights are rounded so they sum to exactly one and the
+// chroma rows so they sum to exactly zero, keeping greys neutral.
+template <typename Acc, int Bits>
+struct FixedConversion {
+    Acc yR, yG, yB, yOffset;
+    Acc crR, crG, crB, cbR, cbG, cbB, chromaOffset;
+    Acc yInv, yBias, rCr, gCb, gCr, bCb;
+    Acc maxValue;
+
+    explicit FixedConversion(const Conversion& c)
+    {
+        const double one = static_cast<double>(Acc(1) << Bits);
+        auto fix = [one](double v) { return static_cast<Acc>(std::llround(v * one)); };
+        const Acc half = Acc(1) << (Bits - 1);
+
+        yR = fix(c.kr * c.yScale);
+        yB = fix(c.kb * c.yScale);
+        yG = fix(c.yScale) - yR - yB;
+        yOffset = fix(c.yOffset) + half;
+        crR = fix((1.0 - c.kr) * c.crScale);
+        crB = fix(-c.kb * c.crScale);
+        crG = -crR - crB;
+        cbB = fix((1.0 - c.kb) * c.cbScale);
+        cbR = fix(-c.kr * c.cbScale);
+        cbG = -cbR - cbB;
+        chromaOffset = static_cast<Acc>(c.chromaOffset);
+
+        yInv = fix(c.yInvScale);
+        yBias = static_cast<Acc>(c.yOffset);
+        rCr = fix(c.rCr);
+        gCb = fix(c.gCb);
+        gCr = fix(c.gCr);
+        bCb = fix(c.bCb);
+        maxValue = static_cast<Acc>(c.maxValue);
+    }
+};
+
+template <typename Acc, int Bits, typename T>
+void forwardFixed(const T* bgr, size_t numPixels, T* y, T* cr, T* cb, const Conversion& conv)
+{
+    const FixedConversion<Acc, Bits> f(conv);
+    const Acc yR = f.yR, yG = f.yG, yB = f.yB, yOffset = f.yOffset;
+    const Acc crR = f.crR, crG = f.crG, crB = f.crB;
+    const Acc cbR = f.cbR, cbG = f.cbG, cbB = f.cbB;
+    const Acc chroma = (f.chromaOffset << Bits) + (Acc(1) << (Bits - 1));
+    const Acc maxValue = f.maxValue;
+    auto clamp = [maxValue](Acc v) { return std::max(Acc(0), std::min(maxValue, v)); };
 
     for (size_t i = 0; i < numPixels; ++i) {
-        // BGR order
-        const double B = *pIn++;
-        const double G = *pIn++;
-        const double R = *pIn++;
-
-        double Y  =  0.299 * R + 0.587 * G + 0.114 * B;
-        double Cr = (R - Y) * 0.713 + 128;
-        double Cb = (B - Y) * 0.564 + 128;
-
-        *pOut++ = Y;
-        *pOut++ = Cr;
-        *pOut++ = Cb;
+        const Acc B = bgr[i * 3];
+        const Acc G = bgr[i * 3 + 1];
+        const Acc R = bgr[i * 3 + 2];
+        y[i]  = static_cast<T>(clamp((yR * R + yG * G + yB * B + yOffset) >> Bits));
+        cr[i] = static_cast<T>(clamp((crR * R + crG * G + crB * B + chroma) >> Bits));
+        cb[i] = static_cast<T>(clamp((cbR * R + cbG * G + cbB * B + chroma) >> Bits));
+    }
+}
+
+template <typename Acc, int Bits, typename T>
+void inverseFixed(const T* y, const T* cr, const T* cb, size_t numPixels, T* bgr,
+                  const Conversion& conv)
+{
+    const FixedConversion<Acc, Bits> f(conv);
+    const Acc yInv = f.yInv, yBias = f.yBias;
+    const Acc rCr = f.rCr, gCb = f.gCb, gCr = f.gCr, bCb = f.bCb;
+    const Acc chromaOffset = f.chromaOffset;
+    const Acc half = Acc(1) << (Bits - 1);
+    const Acc maxValue = f.maxValue;
+    auto clamp = [maxValue](Acc v) { return std::max(Acc(0), std::min(maxValue, v)); };
+
+    for (size_t i = 0; i < numPixels; ++i) {
+        const Acc Y = (static_cast<Acc>(y[i]) - yBias) * yInv + half;
+        const Acc Cr = static_cast<Acc>(cr[i]) - chromaOffset;
+        const Acc Cb = static_cast<Acc>(cb[i]) - chromaOffset;
+        bgr[i * 3 + 2] = static_cast<T>(clamp((Y + rCr * Cr) >> Bits));
+        bgr[i * 3 + 1] = static_cast<T>(clamp((Y - gCb * Cb - gCr * Cr) >> Bits));
+        bgr[i * 3]     = static_cast<T>(clamp((Y + bCb * Cb) >> Bits));
+    }
+}
+
+// Table-driven 8-bit conversion in the style of libjpeg's jccolor.c and
+// jdcolor.c: every product of a fixed-point coefficient and an 8-bit sample
+// is looked up instead of multiplied, with the rounding bias and offsets
+// folded into one table per output. The entries are the terms
+// forwardFixed<int32_t, 16>() and inverseFixed<int32_t, 16>() compute, so
+// the results are bit-identical to theirs. Loads and adds only, so the
+// kernels stay fast where no vector multiply is available (SSE2 has no
+// 32-bit one, WebAssembly without SIMD none at all). Only the uint8_t
+// planar overloads use them: for double output the float kernel vectorises
+// and matches a table lookup of the same products, so packed ingest keeps
+// it.
+struct ForwardTables {
+    int32_t yR[256], yG[256], yB[256];
+    int32_t crR[256], crG[256], crB[256];
+    int32_t cbR[256], cbG[256], cbB[256];
+};
+
+struct InverseTables {
+    int32_t y[256];              // Scaled luma plus rounding bias
+    int32_t rCr[256], bCb[256];
+    int32_t gCb[256], gCr[256];  // Negated, so green is a plain sum
+};
+
+constexpr int MATRIX_COUNT = 3;
+constexpr int FORMAT_COUNT = MATRIX_COUNT * 2;
+
+ColorFormat formatAt(int index)
+{
+    ColorFormat format;
+    format.matrix = static_cast<ColorMatrix>(index % MATRIX_COUNT);
+    format.range = static_cast<ColorRange>(index / MATRIX_COUNT);
+    return format;
+}
+
+int formatIndex(const ColorFormat& format)
+{
+    return static_cast<int>(format.range) * MATRIX_COUNT + static_cast<int>(format.matrix);
+}
+
+// Tables for every format are built on first use (about 86 KB in all) in
+// static storage; the guarded static makes the build thread-safe.
+const ForwardTables& forwardTables(const ColorFormat& format)
+{
+    static ForwardTables tables[FORMAT_COUNT];
+    static const bool built = [] {
+        for (int f = 0; f < FORMAT_COUNT; ++f) {
+            const FixedConversion<int32_t, 16> c(makeConversion(formatAt(f), 8));
+            const int32_t chroma = (c.chromaOffset << 16) + (1 << 15);
+            ForwardTables& t = tables[f];
+            for (int32_t v = 0; v < 256; ++v) {
+                t.yR[v] = c.yR * v + c.yOffset;
+                t.yG[v] = c.yG * v;
+                t.yB[v] = c.yB * v;
+                t.crR[v] = c.crR * v + chroma;
+                t.crG[v] = c.crG * v;
+                t.crB[v] = c.crB * v;
+                t.cbR[v] = c.cbR * v;
+                t.cbG[v] = c.cbG * v;
+                t.cbB[v] = c.cbB * v + chroma;
+            }
+        }
+        return true;
+    }();
+    (void)built;
+    return tables[formatIndex(format)];
+}
+
+const InverseTables& inverseTables(const ColorFormat& format)
+{
+    static InverseTables tables[FORMAT_COUNT];
+    static const bool built = [] {
+        for (int f = 0; f < FORMAT_COUNT; ++f) {
+            const FixedConversion<int32_t, 16> c(makeConversion(formatAt(f), 8));
+            InverseTables& t = tables[f];
+            for (int32_t v = 0; v < 256; ++v) {
+                const int32_t chroma = v - c.chromaOffset;
+                t.y[v] = (v - c.yBias) * c.yInv + (1 << 15);
+                t.rCr[v] = c.rCr * chroma;
+                t.bCb[v] = c.bCb * chroma;
+                t.gCb[v] = -c.gCb * chroma;
+                t.gCr[v] = -c.gCr * chroma;
+            }
+        }
+        return true;
+    }();
+    (void)built;
+    return tables[formatIndex(format)];
+}
+
+inline uint8_t clampToByte(int32_t v)
+{
+    return static_cast<uint8_t>(std::max(0, std::min(255, v)));
+}
+
+void forwardLut(const uint8_t* bgr, size_t numPixels, uint8_t* y, uint8_t* cr, uint8_t* cb,
+                const ForwardTables& t)
+{
+    for (size_t i = 0; i < numPixels; ++i) {
+        const uint8_t B = bgr[i * 3];
+        const uint8_t G = bgr[i * 3 + 1];
+        const uint8_t R = bgr[i * 3 + 2];
+        y[i]  = clampToByte((t.yR[R] + t.yG[G] + t.yB[B]) >> 16);
+        cr[i] = clampToByte((t.crR[R] + t.crG[G] + t.crB[B]) >> 16);
+        cb[i] = clampToByte((t.cbR[R] + t.cbG[G] + t.cbB[B]) >> 16);
+    }
+}
+
+void inverseLut(const uint8_t* y, const uint8_t* cr, const uint8_t* cb, size_t numPixels,
+                uint8_t* bgr, const InverseTables& t)
+{
+    for (size_t i = 0; i < numPixels; ++i) {
+        const int32_t Y = t.y[y[i]];
+        bgr[i * 3 + 2] = clampToByte((Y + t.rCr[cr[i]]) >> 16);
+        bgr[i * 3 + 1] = clampToByte((Y + t.gCb[cb[i]] + t.gCr[cr[i]]) >> 16);
+        bgr[i * 3]     = clampToByte((Y + t.bCb[cb[i]]) >> 16);
     }
+}
+
+void checkBitDepth(int bitDepth)
+{
+    if (bitDepth < 8 || bitDepth > 16)
+        throw std::invalid_argument("Sample bit depth must be between 8 and 16");
+}
+
+void checkLayout(PixelLayout layout, int bitDepth)
+{
+    checkBitDepth(bitDepth);
+    if (bytesPerSample(layout) == 1 && bitDepth != 8)
+        throw std::invalid_argument("8-bit pixel layouts hold 8-bit samples");
+}
+
+Conversion floatConversion(const ColorFormat& format, int bitDepth)
+{
+    checkBitDepth(bitDepth);
+    return makeConversion(format, bitDepth);
+}
+
+} // namespace
+
+Image bgrToYCrCb(const Image& input, const ColorFormat& format, int bitDepth)
+{
+    Image output;
+    bgrToYCrCb(input, output, format, bitDepth);
     return output;
 }
 
-Image ycrcbToBgr(const Image& input)
+Image ycrcbToBgr(const Image& input, const ColorFormat& format, int bitDepth)
 {
-    Image output(input.width(), input.height(), 3);
-    auto clamp = [](double val) { return std::max(0.0, std::min(255.0, val)); };
-    const double* pIn = input.data();
+    Image output;
+    ycrcbToBgr(input, output, format, bitDepth);
+    return output;
+}
+
+void bgrToYCrCb(const Image& input, Image& output, const ColorFormat& format, int bitDepth)
+{
+    const Conversion conv = floatConversion(format, bitDepth);
+    output.resize(input.width(), input.height(), 3);
     double* pOut = output.data();
     const size_t numPixels = static_cast<size_t>(input.width()) * input.height();
+    // BGR order in, Y/Cr/Cb interleaved out
+    forwardFloat<3, 0>(input.data(), numPixels, pOut, pOut + 1, pOut + 2, 3, conv);
+}
 
-    for (size_t i = 0; i < numPixels; ++i) {
-        const double Y  = *pIn++;
-        const double Cr = *pIn++;
-        const double Cb = *pIn++;
+void ycrcbToBgr(const Image& input, Image& output, const ColorFormat& format, int bitDepth)
+{
+    const Conversion conv = floatConversion(format, bitDepth);
+    output.resize(input.width(), input.height(), 3);
+    const double* pIn = input.data();
+    const size_t numPixels = static_cast<size_t>(input.width()) * input.height();
+    inverseFloat<3, 0>(pIn, pIn + 1, pIn + 2, 3, numPixels, output.data(), conv);
+}
+
+void bgrToYCrCbPlanar(const double* bgr, size_t numPixels,
+                      double* y, double* cr, double* cb, const ColorFormat& format, int bitDepth)
+{
+    forwardFloat<3, 0>(bgr, numPixels, y, cr, cb, 1, floatConversion(format, bitDepth));
+}
+
+void bgrToYCrCbPlanar(const float* bgr, size_t numPixels,
+                      float* y, float* cr, float* cb, const ColorFormat& format, int bitDepth)
+{
+    forwardFloat<3, 0>(bgr, numPixels, y, cr, cb, 1, floatConversion(format, bitDepth));
+}
+
+void yCrCbPlanarToBgr(const double* y, const double* cr, const double* cb,
+                      size_t numPixels, double* bgr, const ColorFormat& format, int bitDepth)
+{
+    inverseFloat<3, 0>(y, cr, cb, 1, numPixels, bgr, floatConversion(format, bitDepth));
+}
+
+void yCrCbPlanarToBgr(const float* y, const float* cr, const float* cb,
+                      size_t numPixels, float* bgr, const ColorFormat& format, int bitDepth)
+{
+    inverseFloat<3, 0>(y, cr, cb, 1, numPixels, bgr, floatConversion(format, bitDepth));
+}
+
+void packedToYCrCbPlanar(const uint8_t* pixels, PixelLayout layout, size_t numPixels,
+                         double* y, double* cr, double* cb, const ColorFormat& format,
+                         int bitDepth)
+{
+    checkLayout(layout, bitDepth);
+    const Conversion conv = makeConversion(format, bitDepth);
+    withLayout(layout, [&](auto stride, auto blue, auto sample) {
+        using Sample = decltype(sample);
+        forwardFloat<stride, blue>(reinterpret_cast<const Sample*>(pixels), numPixels,
+                                   y, cr, cb, 1, conv);
+    });
+}
+
+void yCrCbPlanarToPacked(const double* y, const double* cr, const double* cb,
+                         size_t numPixels, uint8_t* pixels, PixelLayout layout,
+                         const ColorFormat& format, int bitDepth)
+{
+    checkLayout(layout, bitDepth);
+    const Conversion conv = makeConversion(format, bitDepth);
+    withLayout(layout, [&](auto stride, auto blue, auto sample) {
+        using Sample = decltype(sample);
+        Sample* out = reinterpret_cast<Sample*>(pixels);
+        inverseFloat<stride, blue>(y, cr, cb, 1, numPixels, out, conv);
+        if constexpr (stride == 4)
+            for (size_t i = 0; i < numPixels; ++i)
+                out[i * 4 + 3] = static_cast<Sample>(conv.maxValue);
+    });
+}
+
+void unpackPixels(const uint8_t* pixels, PixelLayout layout, size_t numPixels, double* bgr)
+{
+    withLayout(layout, [&](auto stride, auto blue, auto sample) {
+        using Sample = decltype(sample);
+        const Sample* in = reinterpret_cast<const Sample*>(pixels);
+        for (size_t i = 0; i < numPixels; ++i) {
+            bgr[i * 3]     = in[i * stride + blue];
+            bgr[i * 3 + 1] = in[i * stride + 1];
+            bgr[i * 3 + 2] = in[i * stride + 2 - blue];
+        }
+    });
+}
+
+void packPixels(const double* bgr, size_t numPixels, uint8_t* pixels, PixelLayout layout,
+                int bitDepth)
+{
+    checkLayout(layout, bitDepth);
+    const double maxValue = static_cast<double>((1 << bitDepth) - 1);
+    withLayout(layout, [&](auto stride, auto blue, auto sample) {
+        using Sample = decltype(sample);
+        auto toSample = [maxValue](double v) {
+            return static_cast<Sample>(std::max(0.0, std::min(maxValue, v)) + 0.5);
+        };
+        Sample* out = reinterpret_cast<Sample*>(pixels);
+        for (size_t i = 0; i < numPixels; ++i) {
+            out[i * stride + blue]     = toSample(bgr[i * 3]);
+            out[i * stride + 1]        = toSample(bgr[i * 3 + 1]);
+            out[i * stride + 2 - blue] = toSample(bgr[i * 3 + 2]);
+            if constexpr (stride == 4)
+                out[i * stride + 3] = static_cast<Sample>(maxValue);
+        }
+    });
+}
+
+void bgrToYCrCbPlanar(const uint8_t* bgr, size_t numPixels,
+                      uint8_t* y, uint8_t* cr, uint8_t* cb, const ColorFormat& format)
+{
+    forwardLut(bgr, numPixels, y, cr, cb, forwardTables(format));
+}
 
-        double R = Y + 1.402 * (Cr - 128);
-        double G = Y - 0.344136 * (Cb - 128) - 0.714136 * (Cr - 128);
-        double B = Y + 1.772 * (Cb - 128);
+void yCrCbPlanarToBgr(const uint8_t* y, const uint8_t* cr, const uint8_t* cb,
+                      size_t numPixels, uint8_t* bgr, const ColorFormat& format)
+{
+    inverseLut(y, cr, cb, numPixels, bgr, inverseTables(format));
+}
+
+void bgrToYCrCbPlanar(const uint16_t* bgr, size_t numPixels,
+                      uint16_t* y, uint16_t* cr, uint16_t* cb, int bitDepth,
+                      const ColorFormat& format)
+{
+    checkBitDepth(bitDepth);
+    const Conversion conv = makeConversion(format, bitDepth);
+    // 32-bit accumulators hold 12-bit samples times the largest inverse
+    // coefficient (~2.02 * 2^16); deeper samples need 64 bits.
+    if (bitDepth <= 12)
+        forwardFixed<int32_t, 16>(bgr, numPixels, y, cr, cb, conv);
+    else
+        forwardFixed<int64_t, 24>(bgr, numPixels, y, cr, cb, conv);
+}
 
-        *pOut++ = clamp(B);
-        *pOut++ = clamp(G);
-        *pOut++ = clamp(R);
+void yCrCbPlanarToBgr(const uint16_t* y, const uint16_t* cr, const uint16_t* cb,
+                      size_t numPixels, uint16_t* bgr, int bitDepth,
+                      const ColorFormat& format)
+{
+    checkBitDepth(bitDepth);
+    const Conversion conv = makeConversion(format, bitDepth);
+    if (bitDepth <= 12)
+        inverseFixed<int32_t, 16>(y, cr, cb, numPixels, bgr, conv);
+    else
+        inverseFixed<int64_t, 24>(y, cr, cb, numPixels, bgr, conv);
+}
+
+void bgrToYCoCgR(const double* bgr, size_t numPixels,
+                 int32_t* y, int32_t* co, int32_t* cg)
+{
+    for (size_t i = 0; i < numPixels; ++i) {
+        const int32_t B = static_cast<int32_t>(bgr[i * 3]);
+        const int32_t G = static_cast<int32_t>(bgr[i * 3 + 1]);
+        const int32_t R = static_cast<int32_t>(bgr[i * 3 + 2]);
+        co[i] = R - B;
+        const int32_t t = B + (co[i] >> 1);
+        cg[i] = G - t;
+        y[i] = t + (cg[i] >> 1);
     }
-    return output;
-}
\ No newline at end of file
+}
+
+void yCoCgRToBgr(const int32_t* y, const int32_t* co, const int32_t* cg,
+                 size_t numPixels, double* bgr)
+{
+    for (size_t i = 0; i < numPixels; ++i) {
+        const int32_t t = y[i] - (cg[i] >> 1);
+        const int32_t G = cg[i] + t;
+        const int32_t B = t - (co[i] >> 1);
+        bgr[i * 3] = B;
+        bgr[i * 3 + 1] = G;
+        bgr[i * 3 + 2] = B + co[i];
+    }
+}
@@ -28,44 +28,111 @@ static double C(int u) {
     return (u == 0) ? (1.0 / std::sqrt(2.0)) : 1.0;
 }
 
+/*
+* Orthonormal 1D DCT-II basis: BASIS[u][x] = 0.5 * C(u) * cos((2x+1)uπ/16).
+* The 2D transform is separable, F = B·f·Bᵀ, so with the basis tabulated once
+* each block costs two 8×8 matrix products instead of 4096 cosine evaluations.
+*/
+struct DctBasis {
+    double m[8][8];
+    DctBasis() {
+        for (int u = 0; u < 8; ++u)
+            for (int x = 0; x < 8; ++x)
+                m[u][x] = 0.5 * C(u) * std::cos(((2 * x + 1) * u * PI) / 16.0);
+    }
+};
+
+static const double (*dctBasis())[8] {
+    static const DctBasis basis;
+    return basis.m;
+}
+
 /*
 * Performs the Discrete Cosine Transform (DCT) on an 8x8 block.
-* The input block should be of type CV_64F and the output will also be CV_64F.
 * 2D DCT is computed using the formula:
 * F(u, v) = 1/4 * C(u) * C(v) * sum_{x=0}^{7} sum_{y=0}^{7} f(x, y) * cos((2x+1)uπ/16) * cos((2y+1)vπ/16)
+* evaluated separably: rows first (tmp = f·Bᵀ), then columns (F = B·tmp).
 */
 void dct8x8(const double src[8][8], double dst[8][8]) {
-    for (int u = 0; u < 8; ++u) {
+    const double (*B)[8] = dctBasis();
+    double tmp[8][8];
+
+    for (int x = 0; x < 8; ++x)
         for (int v = 0; v < 8; ++v) {
             double sum = 0.0;
-            for (int x = 0; x < 8; ++x) {
-                for (int y = 0; y < 8; ++y) {
-                    sum += src[x][y] *
-                           std::cos(((2 * x + 1) * u * PI) / 16.0) *
-                           std::cos(((2 * y + 1) * v * PI) / 16.0);
-                }
-            }
-            dst[u][v] = 0.25 * C(u) * C(v) * sum;
+            for (int y = 0; y < 8; ++y)
+                sum += src[x][y] * B[v][y];
+            tmp[x][v] = sum;
+        }
+
+    for (int u = 0; u < 8; ++u)
+        for (int v = 0; v < 8; ++v) {
+            double sum = 0.0;
+            for (int x = 0; x < 8; ++x)
+                sum += B[u][x] * tmp[x][v];
+            dst[u][v] = sum;
         }
-    }
 }
 
 /*
 * Performs the Inverse Discrete Cosine Transform (IDCT) on an 8x8 block.
-* The input block should be of type CV_64F and the output will also be CV_64F.
+* f = Bᵀ·F·B, again evaluated as two separable passes.
 */
 void idct8x8(const double src[8][8], double dst[8][8]) {
-    for (int x = 0; x < 8; ++x) {
+    const double (*B)[8] = dctBasis();
+    double tmp[8][8];
+
+    for (int u = 0; u < 8; ++u)
         for (int y = 0; y < 8; ++y) {
             double sum = 0.0;
-            for (int u = 0; u < 8; ++u) {
-                for (int v = 0; v < 8; ++v) {
-                    sum += C(u) * C(v) * src[u][v] *
-                           std::cos(((2 * x + 1) * u * PI) / 16.0) *
-                           std::cos(((2 * y + 1) * v * PI) / 16.0);
-                }
-            }
-            dst[x][y] = 0.25 * sum;
+            for (int v = 0; v < 8; ++v)
+                sum += src[u][v] * B[v][y];
+            tmp[u][y] = sum;
         }
+
+    for (int x = 0; x < 8; ++x)
+        for (int y = 0; y < 8; ++y) {
+            double sum = 0.0;
+            for (int u = 0; u < 8; ++u)
+                sum += B[u][x] * tmp[u][y];
+            dst[x][y] = sum;
+        }
+}
+
+/*
+* First row/column of dct8x8(), accumulated in the same order so the result
+* matches the full transform's DC exactly.
+*/
+double dctDc8x8(const double src[8][8]) {
+    const double (*B)[8] = dctBasis();
+    double dc = 0.0;
+    for (int x = 0; x < 8; ++x) {
+        double row = 0.0;
+        for (int y = 0; y < 8; ++y)
+            row += src[x][y] * B[0][y];
+        dc += B[0][x] * row;
     }
+    return dc;
 }
+
+/*
+* With every AC coefficient zero, both idct8x8() passes reduce to a single
+* product per sample.
+*/
+void idctDc8x8(double dc, double dst[8][8]) {
+    const double (*B)[8] = dctBasis();
+    for (int x = 0; x < 8; ++x)
+        for (int y = 0; y < 8; ++y)
+            dst[x][y] = B[0][x] * (dc * B[0][y]);
+}
+
+const int ZIGZAG_ORDER[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
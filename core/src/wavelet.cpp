@@ -140,15 +140,16 @@ void idwt8x8(const double src[8][8], double dst[8][8]) {
  * - Zero coefficients are very cheap (part of a run).
  * - Non-zero coefficients are estimated based on their magnitude.
  */
-double dwtEstimateBits(const double* data, int width, int height) {
+double dwtEstimateBits(const double* data, int width, int height, double unit) {
     double totalBits = 0;
     size_t count = (size_t)width * height;
+    const double invUnit = 1.0 / unit;
     
     // Very simple model: 
     // - Each zero-run is roughly 1-2 bits per zero.
     // - Each non-zero coeff takes ~log2(abs(val)) + sign + overhead.
     for (size_t i = 0; i < count; ++i) {
-        double val = std::abs(data[i]);
+        double val = std::abs(data[i]) * invUnit;
         if (val < 0.5) {
             totalBits += 0.5; // Roughly 0.5 bits per zero on average (JPEG-like)
         } else {
@@ -163,10 +164,10 @@ double dwtEstimateBits(const double* data, int width, int height) {
 
 /*
  * Forward 1D orthonormal Haar on n elements (arbitrary even n), in-place.
- * Identical math to haar1d_fwd but uses a heap buffer for any length.
+ * Identical math to haar1d_fwd but uses the caller's `tmp` buffer (n elements)
+ * so any length can be handled without allocating.
  */
-static void haar1d_fwd_n(double* data, int n) {
-    std::vector<double> tmp(n);
+static void haar1d_fwd_n(double* data, int n, double* tmp) {
     int half = n / 2;
     for (int k = 0; k < half; ++k) {
         tmp[k]        = (data[2*k]     + data[2*k + 1]) * INV_SQRT2;
@@ -178,8 +179,7 @@ static void haar1d_fwd_n(double* data, int n) {
 /*
  * Inverse 1D orthonormal Haar on n elements (arbitrary even n), in-place.
  */
-static void haar1d_inv_n(double* data, int n) {
-    std::vector<double> tmp(n);
+static void haar1d_inv_n(double* data, int n, double* tmp) {
     int half = n / 2;
     for (int k = 0; k < half; ++k) {
         tmp[2*k]     = (data[k] + data[k + half]) * INV_SQRT2;
@@ -199,8 +199,15 @@ int calcDwtLevels(int width, int height) {
     return std::min(levels, 6);
 }
 
-void dwtImage(double* data, int width, int height, int levels) {
-    std::vector<double> buf;
+void dwtImage(double* data, int width, int height, int levels, double* scratch) {
+    // Each 1D pass needs a line buffer plus the Haar temporary.
+    std::vector<double> owned;
+    if (!scratch) {
+        owned.resize(dwtScratchSize(width, height));
+        scratch = owned.data();
+    }
+    double* buf = scratch;
+    double* tmp = scratch + std::max(width, height);
     int w = width, h = height;
 
     for (int lev = 0; lev < levels; ++lev) {
@@ -212,21 +219,13 @@ void dwtImage(double* data, int width, int height, int levels) {
         int ht = h & ~1;
 
         // Forward Haar on rows: transform wt elements of each of the first ht rows.
-        buf.resize(wt);
-        for (int y = 0; y < ht; ++y) {
-            std::copy(data + (size_t)y * width,
-                      data + (size_t)y * width + wt,
-                      buf.data());
-            haar1d_fwd_n(buf.data(), wt);
-            std::copy(buf.data(), buf.data() + wt,
-                      data + (size_t)y * width);
-        }
+        for (int y = 0; y < ht; ++y)
+            haar1d_fwd_n(data + (size_t)y * width, wt, tmp);
 
         // Forward Haar on columns: transform ht elements of each of the first wt columns.
-        buf.resize(ht);
         for (int x = 0; x < wt; ++x) {
             for (int y = 0; y < ht; ++y) buf[y] = data[(size_t)y * width + x];
-            haar1d_fwd_n(buf.data(), ht);
+            haar1d_fwd_n(buf, ht, tmp);
             for (int y = 0; y < ht; ++y) data[(size_t)y * width + x] = buf[y];
         }
 
@@ -235,11 +234,20 @@ void dwtImage(double* data, int width, int height, int levels) {
     }
 }
 
-void idwtImage(double* data, int width, int height, int levels) {
+void idwtImage(double* data, int width, int height, int levels, double* scratch) {
     if (levels <= 0) return;
+    if (levels > 16) levels = 16; // Same cap as dwtQuantStep
+
+    std::vector<double> owned;
+    if (!scratch) {
+        owned.resize(dwtScratchSize(width, height));
+        scratch = owned.data();
+    }
+    double* buf = scratch;
+    double* tmp = scratch + std::max(width, height);
 
     // Replay the forward pass to record the exact (wt, ht) at each level.
-    std::vector<int> fwdW(levels), fwdH(levels);
+    int fwdW[16], fwdH[16];
     {
         int w = width, h = height;
         for (int lev = 0; lev < levels; ++lev) {
@@ -250,8 +258,6 @@ void idwtImage(double* data, int width, int height, int levels) {
         }
     }
 
-    std::vector<double> buf;
-
     // Reconstruct from coarsest level (levels-1) back to finest (0).
     for (int lev = levels - 1; lev >= 0; --lev) {
         int tw = fwdW[lev]; // width of subimage that was transformed at this level
@@ -260,26 +266,22 @@ void idwtImage(double* data, int width, int height, int levels) {
         if (tw < 2 || th < 2) continue;
 
         // Inverse column transform: undo the column step of the forward pass.
-        buf.resize(th);
         for (int x = 0; x < tw; ++x) {
             for (int y = 0; y < th; ++y) buf[y] = data[(size_t)y * width + x];
-            haar1d_inv_n(buf.data(), th);
+            haar1d_inv_n(buf, th, tmp);
             for (int y = 0; y < th; ++y) data[(size_t)y * width + x] = buf[y];
         }
 
         // Inverse row transform: undo the row step of the forward pass.
-        buf.resize(tw);
-        for (int y = 0; y < th; ++y) {
-            std::copy(data + (size_t)y * width,
-                      data + (size_t)y * width + tw,
-                      buf.data());
-            haar1d_inv_n(buf.data(), tw);
-            std::copy(buf.data(), buf.data() + tw,
-                      data + (size_t)y * width);
-        }
+        for (int y = 0; y < th; ++y)
+            haar1d_inv_n(data + (size_t)y * width, tw, tmp);
     }
 }
 
+size_t dwtScratchSize(int width, int height) {
+    return 2 * static_cast<size_t>(std::max(width, height));
+}
+
 double dwtQuantStep(int x, int y, int width, int height, int levels, double baseStep) {
     if (levels <= 0) return baseStep;
     
@@ -318,3 +320,87 @@ double dwtQuantStep(int x, int y, int width, int height, int levels, double base
     // LL approximation: smallest step, preserving the global structure.
     return std::max(1.0, baseStep / (double)(1 << levels));
 }
+
+/*
+ * One forward 5/3 lifting step over `n` samples spaced `stride` apart.
+ * `line` is scratch for n samples. Right shifts of negative values floor,
+ * which is what makes the lifting exactly invertible.
+ */
+static void lift53Forward(int32_t* x, int n, size_t stride, int32_t* line) {
+    if (n < 2) return;
+    const int nh = n / 2;
+    const int nl = n - nh;
+    for (int i = 0; i < n; ++i) line[i] = x[i * stride];
+
+    // Predict: odd samples become high-pass residuals.
+    for (int i = 0; i < nh; ++i) {
+        const int32_t right = (2 * i + 2 < n) ? line[2 * i + 2] : line[2 * i];
+        line[2 * i + 1] -= (line[2 * i] + right) >> 1;
+    }
+    // Update: even samples become the low-pass band.
+    for (int i = 0; i < nl; ++i) {
+        const int32_t prev = line[(i > 0) ? 2 * i - 1 : 1];
+        const int32_t next = line[(i < nh) ? 2 * i + 1 : 2 * nh - 1];
+        line[2 * i] += (prev + next + 2) >> 2;
+    }
+
+    for (int i = 0; i < nl; ++i) x[i * stride] = line[2 * i];
+    for (int i = 0; i < nh; ++i) x[(nl + i) * stride] = line[2 * i + 1];
+}
+
+/*
+ * Inverse of lift53Forward().
+ */
+static void lift53Inverse(int32_t* x, int n, size_t stride, int32_t* line) {
+    if (n < 2) return;
+    const int nh = n / 2;
+    const int nl = n - nh;
+    for (int i = 0; i < nl; ++i) line[2 * i] = x[i * stride];
+    for (int i = 0; i < nh; ++i) line[2 * i + 1] = x[(nl + i) * stride];
+
+    for (int i = 0; i < nl; ++i) {
+        const int32_t prev = line[(i > 0) ? 2 * i - 1 : 1];
+        const int32_t next = line[(i < nh) ? 2 * i + 1 : 2 * nh - 1];
+        line[2 * i] -= (prev + next + 2) >> 2;
+    }
+    for (int i = 0; i < nh; ++i) {
+        const int32_t right = (2 * i + 2 < n) ? line[2 * i + 2] : line[2 * i];
+        line[2 * i + 1] += (line[2 * i] + right) >> 1;
+    }
+
+    for (int i = 0; i < n; ++i) x[i * stride] = line[i];
+}
+
+void dwt53Image(int32_t* data, int width, int height, int levels) {
+    std::vector<int32_t> line(std::max(width, height));
+    int w = width, h = height;
+    for (int lev = 0; lev < levels && (w >= 2 || h >= 2); ++lev) {
+        for (int y = 0; y < h; ++y)
+            lift53Forward(data + (size_t)y * width, w, 1, line.data());
+        for (int x = 0; x < w; ++x)
+            lift53Forward(data + x, h, (size_t)width, line.data());
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+}
+
+void idwt53Image(int32_t* data, int width, int height, int levels) {
+    std::vector<int32_t> line(std::max(width, height));
+
+    // Replay the forward pass to find each level's extent.
+    std::vector<int> ws, hs;
+    int w = width, h = height;
+    for (int lev = 0; lev < levels && (w >= 2 || h >= 2); ++lev) {
+        ws.push_back(w);
+        hs.push_back(h);
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    for (int lev = (int)ws.size() - 1; lev >= 0; --lev) {
+        for (int x = 0; x < ws[lev]; ++x)
+            lift53Inverse(data + x, hs[lev], (size_t)width, line.data());
+        for (int y = 0; y < hs[lev]; ++y)
+            lift53Inverse(data + (size_t)y * width, ws[lev], 1, line.data());
+    }
+}
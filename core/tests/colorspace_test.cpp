@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 #include "colorspace.h"
 #include "Image.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
 
 TEST(ColorspaceTest, BGRToYCrCb_Conversion) {
     // Pure Red BGR: (0, 0, 255)
@@ -32,6 +36,23 @@ TEST(ColorspaceTest, BGRToYCrCb_Conversion) {
     // If test fails, I will check implementation.
 }
 
+TEST(ColorspaceTest, DefaultFormatUsesExactBt601Scales) {
+    // Golden values for the default format: the forward chroma scales are
+    // 0.5 / (1 - Kr) and 0.5 / (1 - Kb), so saturated red and blue land on
+    // 255.5 (they were 255.4523 and 255.4245 with the old 0.713 / 0.564).
+    Image bgr(3, 1, 3);
+    bgr.at(0, 0, 2) = 255.0;                 // Red
+    bgr.at(1, 0, 0) = 255.0;                 // Blue
+    bgr.at(2, 0, 0) = 40.0; bgr.at(2, 0, 1) = 90.0; bgr.at(2, 0, 2) = 200.0;
+
+    Image ycrcb = bgrToYCrCb(bgr);
+    EXPECT_NEAR(ycrcb.at(0, 0, 1), 255.5, 1e-4);
+    EXPECT_NEAR(ycrcb.at(1, 0, 2), 255.5, 1e-4);
+    EXPECT_NEAR(ycrcb.at(2, 0, 0), 117.19, 1e-9);
+    EXPECT_NEAR(ycrcb.at(2, 0, 1), 187.065640, 1e-6);
+    EXPECT_NEAR(ycrcb.at(2, 0, 2), 84.439059, 1e-6);
+}
+
 TEST(ColorspaceTest, RoundTrip) {
     Image bgr(2, 2, 3);
     // Fill with random-ish values
@@ -56,3 +77,384 @@ TEST(ColorspaceTest, RoundTrip) {
         }
     }
 }
+
+TEST(ColorspaceTest, OutputOverloadsReuseBuffer) {
+    Image bgr(3, 2, 3);
+    for (size_t i = 0; i < bgr.size(); ++i)
+        bgr.data()[i] = static_cast<double>((i * 37) % 256);
+
+    Image ycrcb(3, 2, 3);
+    const double* ycrcbStorage = ycrcb.data();
+    bgrToYCrCb(bgr, ycrcb);
+    EXPECT_EQ(ycrcb.data(), ycrcbStorage);
+
+    Image expected = bgrToYCrCb(bgr);
+    for (size_t i = 0; i < expected.size(); ++i)
+        EXPECT_DOUBLE_EQ(ycrcb.data()[i], expected.data()[i]);
+
+    Image back;
+    ycrcbToBgr(ycrcb, back);
+    EXPECT_EQ(back.width(), 3);
+    EXPECT_EQ(back.height(), 2);
+    Image expectedBack = ycrcbToBgr(ycrcb);
+    for (size_t i = 0; i < expectedBack.size(); ++i)
+        EXPECT_DOUBLE_EQ(back.data()[i], expectedBack.data()[i]);
+}
+
+TEST(ColorspaceTest, YCoCgRRoundTripIsExact) {
+    // Every corner of the RGB cube plus a pseudo-random sweep.
+    std::vector<double> bgr;
+    for (int corner = 0; corner < 8; ++corner)
+        for (int c = 0; c < 3; ++c)
+            bgr.push_back((corner >> c) & 1 ? 255.0 : 0.0);
+    for (int i = 0; i < 4096; ++i)
+        for (int c = 0; c < 3; ++c)
+            bgr.push_back(static_cast<double>((i * (37 + 54 * c) + c * 11) % 256));
+
+    const size_t n = bgr.size() / 3;
+    std::vector<int32_t> y(n), co(n), cg(n);
+    bgrToYCoCgR(bgr.data(), n, y.data(), co.data(), cg.data());
+
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_GE(y[i], 0);
+        EXPECT_LE(y[i], 255);
+        EXPECT_GE(co[i], -255);
+        EXPECT_LE(co[i], 255);
+        EXPECT_GE(cg[i], -255);
+        EXPECT_LE(cg[i], 255);
+    }
+
+    std::vector<double> back(bgr.size());
+    yCoCgRToBgr(y.data(), co.data(), cg.data(), n, back.data());
+    EXPECT_EQ(back, bgr);
+}
+
+namespace {
+const ColorFormat ALL_FORMATS[] = {
+    { ColorMatrix::BT601,  ColorRange::Full }, { ColorMatrix::BT601,  ColorRange::Limited },
+    { ColorMatrix::BT709,  ColorRange::Full }, { ColorMatrix::BT709,  ColorRange::Limited },
+    { ColorMatrix::BT2020, ColorRange::Full }, { ColorMatrix::BT2020, ColorRange::Limited },
+};
+
+std::vector<uint8_t> sweepBgr8(size_t numPixels)
+{
+    std::vector<uint8_t> bgr(numPixels * 3);
+    for (size_t i = 0; i < bgr.size(); ++i)
+        bgr[i] = static_cast<uint8_t>((i * 97 + (i / 3) * 13) % 256);
+    // Pure black, white and primaries at the start
+    const uint8_t corners[][3] = { {0, 0, 0}, {255, 255, 255}, {0, 0, 255}, {0, 255, 0}, {255, 0, 0} };
+    for (int p = 0; p < 5; ++p)
+        for (int c = 0; c < 3; ++c)
+            bgr[p * 3 + c] = corners[p][c];
+    return bgr;
+}
+} // namespace
+
+TEST(ColorspaceTest, MatrixLumaWeights) {
+    Image red(1, 1, 3);
+    red.at(0, 0, 2) = 255.0;
+    EXPECT_NEAR(bgrToYCrCb(red, { ColorMatrix::BT709, ColorRange::Full }).at(0, 0, 0), 0.2126 * 255, 1e-9);
+    EXPECT_NEAR(bgrToYCrCb(red, { ColorMatrix::BT2020, ColorRange::Full }).at(0, 0, 0), 0.2627 * 255, 1e-9);
+
+    // Every matrix keeps R = 255 in range: Cr reaches (close to) the top
+    for (const ColorFormat& format : ALL_FORMATS) {
+        const double top = format.range == ColorRange::Full ? 255.5 : 240.0;
+        EXPECT_NEAR(bgrToYCrCb(red, format).at(0, 0, 1), top, 0.5);
+    }
+}
+
+TEST(ColorspaceTest, LimitedRangeLevels) {
+    const ColorFormat limited = { ColorMatrix::BT709, ColorRange::Limited };
+    Image bgr(3, 1, 3);
+    for (int c = 0; c < 3; ++c) {
+        bgr.at(0, 0, c) = 0.0;
+        bgr.at(1, 0, c) = 255.0;
+        bgr.at(2, 0, c) = 128.0;
+    }
+    Image ycrcb = bgrToYCrCb(bgr, limited);
+    EXPECT_NEAR(ycrcb.at(0, 0, 0), 16.0, 1e-9);
+    EXPECT_NEAR(ycrcb.at(1, 0, 0), 235.0, 1e-9);
+    for (int x = 0; x < 3; ++x) {
+        EXPECT_NEAR(ycrcb.at(x, 0, 1), 128.0, 1e-9);
+        EXPECT_NEAR(ycrcb.at(x, 0, 2), 128.0, 1e-9);
+    }
+
+    // 10-bit: 64..940 luma, 512 neutral chroma
+    const uint16_t bgr10[] = { 0, 0, 0, 1023, 1023, 1023 };
+    uint16_t y[2], cr[2], cb[2];
+    bgrToYCrCbPlanar(bgr10, 2, y, cr, cb, 10, limited);
+    EXPECT_EQ(y[0], 64);
+    EXPECT_EQ(y[1], 940);
+    for (int i = 0; i < 2; ++i) {
+        EXPECT_EQ(cr[i], 512);
+        EXPECT_EQ(cb[i], 512);
+    }
+}
+
+TEST(ColorspaceTest, ColorFormatsRoundTrip) {
+    const std::vector<uint8_t> bgr8 = sweepBgr8(2048);
+    std::vector<double> bgr(bgr8.begin(), bgr8.end());
+    const size_t n = bgr.size() / 3;
+    std::vector<double> y(n), cr(n), cb(n), back(bgr.size());
+
+    for (const ColorFormat& format : ALL_FORMATS) {
+        bgrToYCrCbPlanar(bgr.data(), n, y.data(), cr.data(), cb.data(), format);
+        yCrCbPlanarToBgr(y.data(), cr.data(), cb.data(), n, back.data(), format);
+        for (size_t i = 0; i < bgr.size(); ++i)
+            ASSERT_NEAR(back[i], bgr[i], 0.5) << "matrix " << static_cast<int>(format.matrix)
+                                              << " range " << static_cast<int>(format.range);
+    }
+}
+
+TEST(ColorspaceTest, FloatMatchesDouble) {
+    const std::vector<uint8_t> bgr8 = sweepBgr8(1024);
+    const size_t n = bgr8.size() / 3;
+    std::vector<double> bgrD(bgr8.begin(), bgr8.end()), yD(n), crD(n), cbD(n), backD(bgrD.size());
+    std::vector<float> bgrF(bgr8.begin(), bgr8.end()), yF(n), crF(n), cbF(n), backF(bgrF.size());
+
+    for (const ColorFormat& format : ALL_FORMATS) {
+        bgrToYCrCbPlanar(bgrD.data(), n, yD.data(), crD.data(), cbD.data(), format);
+        bgrToYCrCbPlanar(bgrF.data(), n, yF.data(), crF.data(), cbF.data(), format);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_NEAR(yF[i], yD[i], 1e-3);
+            ASSERT_NEAR(crF[i], crD[i], 1e-3);
+            ASSERT_NEAR(cbF[i], cbD[i], 1e-3);
+        }
+        yCrCbPlanarToBgr(yD.data(), crD.data(), cbD.data(), n, backD.data(), format);
+        yCrCbPlanarToBgr(yF.data(), crF.data(), cbF.data(), n, backF.data(), format);
+        for (size_t i = 0; i < bgrD.size(); ++i)
+            ASSERT_NEAR(backF[i], backD[i], 1e-3);
+    }
+}
+
+TEST(ColorspaceTest, FixedPointMatchesDouble) {
+    const std::vector<uint8_t> bgr8 = sweepBgr8(4096);
+    const size_t n = bgr8.size() / 3;
+    std::vector<double> bgr(bgr8.begin(), bgr8.end()), yD(n), crD(n), cbD(n), backD(bgr.size());
+    std::vector<uint8_t> y(n), cr(n), cb(n), back(bgr8.size());
+
+    for (const ColorFormat& format : ALL_FORMATS) {
+        bgrToYCrCbPlanar(bgr.data(), n, yD.data(), crD.data(), cbD.data(), format);
+        bgrToYCrCbPlanar(bgr8.data(), n, y.data(), cr.data(), cb.data(), format);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_NEAR(y[i], std::min(255.0, yD[i]), 1.0);
+            ASSERT_NEAR(cr[i], std::min(255.0, crD[i]), 1.0);
+            ASSERT_NEAR(cb[i], std::min(255.0, cbD[i]), 1.0);
+        }
+
+        // Same planes in, so only the inverse rounding differs
+        for (size_t i = 0; i < n; ++i) {
+            yD[i] = y[i];
+            crD[i] = cr[i];
+            cbD[i] = cb[i];
+        }
+        yCrCbPlanarToBgr(yD.data(), crD.data(), cbD.data(), n, backD.data(), format);
+        yCrCbPlanarToBgr(y.data(), cr.data(), cb.data(), n, back.data(), format);
+        for (size_t i = 0; i < back.size(); ++i)
+            ASSERT_NEAR(back[i], backD[i], 1.0);
+    }
+}
+
+TEST(ColorspaceTest, LookupTablesMatchArithmeticKernel) {
+    // The 8-bit overloads use lookup tables; the 16-bit kernel at 8
+    // significant bits multiplies the same fixed-point coefficients. Sweep
+    // a lattice of the colour cube (every fifth level, both ends included)
+    // in each direction and require identical results.
+    std::vector<uint8_t> cube;
+    for (int b = 0; b < 256; b += 5)
+        for (int g = 0; g < 256; g += 5)
+            for (int r = 0; r < 256; r += 5)
+                cube.insert(cube.end(), { static_cast<uint8_t>(b), static_cast<uint8_t>(g),
+                                          static_cast<uint8_t>(r) });
+    const size_t n = cube.size() / 3;
+    const std::vector<uint16_t> wide(cube.begin(), cube.end());
+    std::vector<uint8_t> y(n), cr(n), cb(n), back(cube.size());
+    std::vector<uint16_t> yRef(n), crRef(n), cbRef(n), backRef(cube.size());
+
+    for (const ColorFormat& format : ALL_FORMATS) {
+        bgrToYCrCbPlanar(cube.data(), n, y.data(), cr.data(), cb.data(), format);
+        bgrToYCrCbPlanar(wide.data(), n, yRef.data(), crRef.data(), cbRef.data(), 8, format);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y[i], yRef[i]) << "pixel " << i;
+            ASSERT_EQ(cr[i], crRef[i]) << "pixel " << i;
+            ASSERT_EQ(cb[i], cbRef[i]) << "pixel " << i;
+        }
+
+        // The same lattice read as Y, Cr, Cb covers out-of-gamut inputs too
+        std::vector<uint8_t> planes[3];
+        std::vector<uint16_t> planesWide[3];
+        for (int c = 0; c < 3; ++c) {
+            planes[c].resize(n);
+            for (size_t i = 0; i < n; ++i)
+                planes[c][i] = cube[i * 3 + c];
+            planesWide[c].assign(planes[c].begin(), planes[c].end());
+        }
+        yCrCbPlanarToBgr(planes[0].data(), planes[1].data(), planes[2].data(), n, back.data(), format);
+        yCrCbPlanarToBgr(planesWide[0].data(), planesWide[1].data(), planesWide[2].data(), n,
+                         backRef.data(), 8, format);
+        for (size_t i = 0; i < back.size(); ++i)
+            ASSERT_EQ(back[i], backRef[i]) << "sample " << i;
+    }
+}
+
+TEST(ColorspaceTest, SixteenBitFixedPoint) {
+    const std::vector<uint8_t> bgr8 = sweepBgr8(2048);
+    const size_t n = bgr8.size() / 3;
+    std::vector<uint8_t> y8(n), cr8(n), cb8(n);
+    std::vector<uint16_t> wide(bgr8.begin(), bgr8.end()), y(n), cr(n), cb(n), back(wide.size());
+
+    for (const ColorFormat& format : ALL_FORMATS) {
+        // At 8 significant bits the 16-bit kernel is the 8-bit kernel
+        bgrToYCrCbPlanar(bgr8.data(), n, y8.data(), cr8.data(), cb8.data(), format);
+        bgrToYCrCbPlanar(wide.data(), n, y.data(), cr.data(), cb.data(), 8, format);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(y[i], y8[i]);
+            ASSERT_EQ(cr[i], cr8[i]);
+            ASSERT_EQ(cb[i], cb8[i]);
+        }
+
+        // Deeper samples round-trip to within the chroma rounding step
+        for (int bitDepth : { 10, 12, 16 }) {
+            const int shift = bitDepth - 8;
+            std::vector<uint16_t> deep(wide.size());
+            for (size_t i = 0; i < wide.size(); ++i)
+                deep[i] = static_cast<uint16_t>((wide[i] << shift) | (wide[i] >> (8 - shift % 8)));
+            bgrToYCrCbPlanar(deep.data(), n, y.data(), cr.data(), cb.data(), bitDepth, format);
+            yCrCbPlanarToBgr(y.data(), cr.data(), cb.data(), n, back.data(), bitDepth, format);
+            const int tolerance = format.range == ColorRange::Full ? 3 : 5;
+            for (size_t i = 0; i < deep.size(); ++i)
+                ASSERT_NEAR(back[i], deep[i], tolerance) << "bit depth " << bitDepth;
+        }
+    }
+
+    EXPECT_THROW(bgrToYCrCbPlanar(wide.data(), n, y.data(), cr.data(), cb.data(), 17),
+                 std::invalid_argument);
+    EXPECT_THROW(yCrCbPlanarToBgr(y.data(), cr.data(), cb.data(), n, back.data(), 7),
+                 std::invalid_argument);
+}
+
+TEST(ColorspaceTest, PackedLayoutsMatchPlanarConversion) {
+    const std::vector<uint8_t> bgr8 = sweepBgr8(512);
+    const size_t n = bgr8.size() / 3;
+    std::vector<double> bgr(bgr8.begin(), bgr8.end());
+    std::vector<double> y(n), cr(n), cb(n), py(n), pcr(n), pcb(n);
+    bgrToYCrCbPlanar(bgr.data(), n, y.data(), cr.data(), cb.data());
+
+    const PixelLayout layouts[] = { PixelLayout::BGR8, PixelLayout::RGB8,
+                                    PixelLayout::BGRA8, PixelLayout::RGBA8 };
+    for (PixelLayout layout : layouts) {
+        const int bpp = bytesPerPixel(layout);
+        const bool rgb = layout == PixelLayout::RGB8 || layout == PixelLayout::RGBA8;
+        std::vector<uint8_t> packed(n * bpp, 7);
+        for (size_t i = 0; i < n; ++i) {
+            packed[i * bpp + (rgb ? 2 : 0)] = bgr8[i * 3];
+            packed[i * bpp + 1]             = bgr8[i * 3 + 1];
+            packed[i * bpp + (rgb ? 0 : 2)] = bgr8[i * 3 + 2];
+        }
+
+        packedToYCrCbPlanar(packed.data(), layout, n, py.data(), pcr.data(), pcb.data());
+        EXPECT_EQ(py, y);
+        EXPECT_EQ(pcr, cr);
+        EXPECT_EQ(pcb, cb);
+
+        std::vector<double> unpacked(n * 3);
+        unpackPixels(packed.data(), layout, n, unpacked.data());
+        EXPECT_EQ(unpacked, bgr);
+
+        // Both egress paths round the same reconstruction identically
+        std::vector<double> back(n * 3);
+        yCrCbPlanarToBgr(y.data(), cr.data(), cb.data(), n, back.data());
+        std::vector<uint8_t> direct(n * bpp), repacked(n * bpp);
+        yCrCbPlanarToPacked(y.data(), cr.data(), cb.data(), n, direct.data(), layout);
+        packPixels(back.data(), n, repacked.data(), layout);
+        EXPECT_EQ(direct, repacked);
+        if (bpp == 4) {
+            EXPECT_EQ(direct[3], 255);
+        }
+        for (size_t i = 0; i < packed.size(); ++i) {
+            if (bpp == 3 || i % 4 != 3) {
+                ASSERT_NEAR(direct[i], packed[i], 1);
+            }
+        }
+    }
+}
+
+TEST(ColorspaceTest, HighBitDepthFloatAndPackedConversion) {
+    const std::vector<uint8_t> bgr8 = sweepBgr8(512);
+    const size_t n = bgr8.size() / 3;
+    std::vector<double> bgr(bgr8.begin(), bgr8.end()), deep(bgr.size());
+    for (size_t i = 0; i < bgr.size(); ++i)
+        deep[i] = bgr[i] * 16.0;
+
+    // 16× the samples at 12 bits give 16× the planes: the chroma offset
+    // follows the bit depth. (Limited range maps 2^bitDepth - 1 to the
+    // nominal peak, which is not a plain scaling.)
+    std::vector<double> y(n), cr(n), cb(n), dy(n), dcr(n), dcb(n);
+    for (const ColorFormat& format : ALL_FORMATS) {
+        if (format.range == ColorRange::Limited)
+            continue;
+        bgrToYCrCbPlanar(bgr.data(), n, y.data(), cr.data(), cb.data(), format);
+        bgrToYCrCbPlanar(deep.data(), n, dy.data(), dcr.data(), dcb.data(), format, 12);
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_NEAR(dy[i], y[i] * 16.0, 1e-9);
+            ASSERT_NEAR(dcr[i], cr[i] * 16.0, 1e-9);
+            ASSERT_NEAR(dcb[i], cb[i] * 16.0, 1e-9);
+        }
+    }
+
+    // 16-bit layouts read and write uint16_t samples up to 2^bitDepth - 1
+    const PixelLayout layouts[] = { PixelLayout::BGR16, PixelLayout::RGBA16 };
+    for (PixelLayout layout : layouts) {
+        const int channels = bytesPerPixel(layout) / 2;
+        const bool rgb = layout == PixelLayout::RGBA16;
+        std::vector<uint16_t> packed(n * channels, 7);
+        for (size_t i = 0; i < n; ++i) {
+            packed[i * channels + (rgb ? 2 : 0)] = static_cast<uint16_t>(deep[i * 3]);
+            packed[i * channels + 1]             = static_cast<uint16_t>(deep[i * 3 + 1]);
+            packed[i * channels + (rgb ? 0 : 2)] = static_cast<uint16_t>(deep[i * 3 + 2]);
+        }
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(packed.data());
+
+        std::vector<double> py(n), pcr(n), pcb(n);
+        packedToYCrCbPlanar(bytes, layout, n, py.data(), pcr.data(), pcb.data(), ColorFormat(), 12);
+        bgrToYCrCbPlanar(deep.data(), n, dy.data(), dcr.data(), dcb.data(), ColorFormat(), 12);
+        EXPECT_EQ(py, dy);
+        EXPECT_EQ(pcr, dcr);
+        EXPECT_EQ(pcb, dcb);
+
+        std::vector<double> unpacked(n * 3);
+        unpackPixels(bytes, layout, n, unpacked.data());
+        EXPECT_EQ(unpacked, deep);
+
+        std::vector<uint16_t> direct(n * channels), repacked(n * channels);
+        std::vector<double> back(n * 3);
+        yCrCbPlanarToBgr(dy.data(), dcr.data(), dcb.data(), n, back.data(), ColorFormat(), 12);
+        yCrCbPlanarToPacked(dy.data(), dcr.data(), dcb.data(), n,
+                            reinterpret_cast<uint8_t*>(direct.data()), layout, ColorFormat(), 12);
+        packPixels(back.data(), n, reinterpret_cast<uint8_t*>(repacked.data()), layout, 12);
+        EXPECT_EQ(direct, repacked);
+        if (channels == 4) {
+            EXPECT_EQ(direct[3], 4095);
+        }
+        for (size_t i = 0; i < packed.size(); ++i) {
+            if (channels == 3 || i % 4 != 3) {
+                ASSERT_NEAR(direct[i], packed[i], 1);
+            }
+        }
+    }
+
+    // Packing clamps to the bit depth's range
+    const double outOfRange[3] = { -5.0, 1023.6, 5000.0 };
+    uint16_t clamped[3];
+    packPixels(outOfRange, 1, reinterpret_cast<uint8_t*>(clamped), PixelLayout::BGR16, 10);
+    EXPECT_EQ(clamped[0], 0);
+    EXPECT_EQ(clamped[1], 1023);
+    EXPECT_EQ(clamped[2], 1023);
+
+    std::vector<uint8_t> bytes8(n * 3);
+    EXPECT_THROW(packedToYCrCbPlanar(bytes8.data(), PixelLayout::BGR8, n, y.data(), cr.data(), cb.data(),
+                                     ColorFormat(), 12),
+                 std::invalid_argument);
+    EXPECT_THROW(bgrToYCrCbPlanar(bgr.data(), n, y.data(), cr.data(), cb.data(), ColorFormat(), 17),
+                 std::invalid_argument);
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include "FrameArena.h"
+#include "ImageCodec.h"
+#include "Image.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Count every global heap allocation in the test binary so the steady-state
+// tests below can assert that a call performed none.
+static std::atomic<size_t> g_allocationCount{0};
+
+void* operator new(size_t size) {
+    ++g_allocationCount;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+static Image createArenaTestImage(int width, int height) {
+    Image img(width, height, 3);
+    double* data = img.data();
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            size_t idx = (static_cast<size_t>(y) * width + x) * 3;
+            data[idx + 0] = static_cast<double>((x * 7) % 256);
+            data[idx + 1] = static_cast<double>((y * 3) % 256);
+            data[idx + 2] = static_cast<double>((x + y) % 256);
+        }
+    return img;
+}
+
+TEST(FrameArenaTest, AllocationsDoNotOverlap) {
+    FrameArena arena;
+    double* a = arena.allocate(10);
+    double* b = arena.allocate(10);
+    for (int i = 0; i < 10; ++i) a[i] = 1.0;
+    for (int i = 0; i < 10; ++i) b[i] = 2.0;
+    for (int i = 0; i < 10; ++i) EXPECT_DOUBLE_EQ(a[i], 1.0);
+    EXPECT_GE(arena.used(), 20u);
+}
+
+TEST(FrameArenaTest, AllocationsStartOnCacheLines) {
+    FrameArena arena;
+    const size_t counts[] = { 1, 3, 8, 13, 1 << 17, 5 };
+    for (size_t count : counts)
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(arena.allocate(count)) % 64, 0u) << "count=" << count;
+}
+
+TEST(FrameArenaTest, AllocateZeroedClearsReusedMemory) {
+    FrameArena arena;
+    double* a = arena.allocate(64);
+    for (int i = 0; i < 64; ++i) a[i] = 5.0;
+    arena.reset();
+    double* b = arena.allocateZeroed(64);
+    for (int i = 0; i < 64; ++i) EXPECT_DOUBLE_EQ(b[i], 0.0);
+}
+
+TEST(FrameArenaTest, ResetCoalescesSpilledBlocks) {
+    FrameArena arena;
+    arena.allocate(1 << 16);
+    arena.allocate(1 << 17); // Spills into a second block
+    const size_t spilled = arena.capacity();
+    arena.reset();
+    EXPECT_EQ(arena.used(), 0u);
+    EXPECT_GE(arena.capacity(), spilled);
+
+    // The same frame now fits without growing the arena.
+    size_t before = g_allocationCount;
+    arena.allocate(1 << 16);
+    arena.allocate(1 << 17);
+    EXPECT_EQ(g_allocationCount - before, 0u);
+}
+
+TEST(FrameArenaTest, RewindReusesMemoryAfterMark) {
+    FrameArena arena;
+    double* kept = arena.allocate(16);
+    const FrameArena::Mark mark = arena.mark();
+    double* first = arena.allocate(1 << 17); // Spills into a second block
+    arena.rewind(mark);
+    EXPECT_EQ(arena.used(), mark.used);
+
+    // Every iteration of a mark/rewind loop gets the same memory back.
+    const size_t capacity = arena.capacity();
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(arena.allocate(1 << 17), first);
+        arena.rewind(mark);
+    }
+    EXPECT_EQ(arena.capacity(), capacity);
+    EXPECT_EQ(arena.allocate(8), kept + 16);
+}
+
+TEST(FrameArenaTest, ReusedOutputMatchesFreshOutput) {
+    Image input = createArenaTestImage(40, 24);
+    ImageCodec codec(60.0, true, ImageCodec::ChromaSubsampling::CS_420);
+
+    Image fresh = codec.process(input);
+    Image reused;
+    codec.process(input, reused);
+    codec.process(input, reused);
+
+    ASSERT_EQ(reused.size(), fresh.size());
+    for (size_t i = 0; i < fresh.size(); ++i)
+        EXPECT_DOUBLE_EQ(reused.data()[i], fresh.data()[i]);
+}
+
+TEST(FrameArenaTest, SteadyStateEncodeDoesNotAllocate) {
+    const ImageCodec::TransformType transforms[] = {
+        ImageCodec::TransformType::DCT, ImageCodec::TransformType::DWT,
+        ImageCodec::TransformType::Adaptive
+    };
+    const ImageCodec::ChromaSubsampling modes[] = {
+        ImageCodec::ChromaSubsampling::CS_444,
+        ImageCodec::ChromaSubsampling::CS_422,
+        ImageCodec::ChromaSubsampling::CS_420
+    };
+    Image input = createArenaTestImage(70, 45);
+
+    for (auto transform : transforms) {
+        for (auto cs : modes) {
+            ImageCodec codec(50.0, true, cs, transform);
+            Image out;
+            codec.process(input, out); // First frame sizes the arena and output
+
+            size_t before = g_allocationCount;
+            codec.process(input, out);
+            codec.process(input, out);
+            EXPECT_EQ(g_allocationCount - before, 0u)
+                << "transform=" << static_cast<int>(transform)
+                << " cs=" << static_cast<int>(cs);
+        }
+    }
+}
@@ -25,6 +25,19 @@ TEST(ImageTest, InvalidDimensions) {
     EXPECT_THROW(Image(10, 10, 0), std::invalid_argument);
 }
 
+TEST(ImageTest, SampleOffsetsBeyond32Bits) {
+    // at() uses the same offsets
+    Image img(5, 4, 3);
+    EXPECT_EQ(&img.at(3, 2, 1) - img.data(), static_cast<ptrdiff_t>(Image::sampleOffset(3, 2, 1, 5, 3)));
+
+    // The last sample of a 65536x40000 BGR frame sits past both INT32_MAX
+    // and UINT32_MAX, so no intermediate product may be formed in int.
+    const size_t last = Image::sampleOffset(65535, 39999, 2, 65536, 3);
+    EXPECT_EQ(last, 65536ull * 40000ull * 3ull - 1);
+    EXPECT_GT(last, static_cast<size_t>(UINT32_MAX));
+    EXPECT_EQ(Image::sampleOffset(0, 32768, 0, 65536, 1), 1ull << 31);
+}
+
 TEST(ImageTest, PixelAccess) {
     Image img(2, 2, 1);
     img.at(0, 0, 0) = 1.0;
@@ -75,3 +88,40 @@ TEST(ImageTest, MoveConstructor) {
     EXPECT_EQ(img1.channels(), 0);
     EXPECT_TRUE(img1.empty());
 }
+
+TEST(ImageTest, ResizeKeepsCapacity) {
+    Image img(10, 10, 3);
+    const double* before = img.data();
+    const size_t capacity = img.capacity();
+
+    img.resize(5, 4, 3); // Shrink
+    EXPECT_EQ(img.width(), 5);
+    EXPECT_EQ(img.height(), 4);
+    EXPECT_EQ(img.size(), 5u * 4u * 3u);
+    EXPECT_EQ(img.capacity(), capacity);
+
+    img.resize(10, 10, 3); // Grow back within capacity
+    EXPECT_EQ(img.data(), before);
+    EXPECT_EQ(img.size(), 300u);
+}
+
+TEST(ImageTest, ResizeInvalidDimensions) {
+    Image img(4, 4, 1);
+    EXPECT_THROW(img.resize(0, 4, 1), std::invalid_argument);
+    EXPECT_THROW(img.resize(4, 4, -1), std::invalid_argument);
+}
+
+TEST(ImageTest, ReshapePreservesSamples) {
+    Image img(4, 2, 3);
+    img.at(3, 1, 2) = 7.0; // Last sample
+    const double* before = img.data();
+
+    img.reshape(8, 3, 1);
+    EXPECT_EQ(img.width(), 8);
+    EXPECT_EQ(img.height(), 3);
+    EXPECT_EQ(img.channels(), 1);
+    EXPECT_EQ(img.data(), before);
+    EXPECT_DOUBLE_EQ(img.at(7, 2, 0), 7.0);
+
+    EXPECT_THROW(img.reshape(5, 5, 1), std::invalid_argument);
+}
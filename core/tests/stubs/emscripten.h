@@ -0,0 +1,4 @@
+// Stand-in for Emscripten's header so the web glue (web/cpp/codec_web.cpp)
+// builds natively for codec_web_tests.
+#pragma once
+#define EMSCRIPTEN_KEEPALIVE
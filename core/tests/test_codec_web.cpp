@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Exports of web/cpp/codec_web.cpp, built natively into this test.
+extern "C" {
+void init_session(uint8_t* rgba_input, int width, int height);
+void process_image(int quality, int cs_mode, int transform_mode);
+double* rd_sweep(int cs_mode, int transform_mode, const int* qualities, int count);
+double get_psnr_y();
+double get_last_bit_estimate();
+}
+
+static std::vector<uint8_t> createRgbaTestImage(int width, int height) {
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            uint8_t* p = &rgba[(static_cast<size_t>(y) * width + x) * 4];
+            p[0] = static_cast<uint8_t>((x * 7 + y) % 256);
+            p[1] = static_cast<uint8_t>((y * 5) % 256);
+            p[2] = static_cast<uint8_t>((x + y * 3) % 256);
+            p[3] = 255;
+        }
+    return rgba;
+}
+
+TEST(CodecWebTest, ProcessImageAfterSweepOfAnotherTransform) {
+    std::vector<uint8_t> rgba = createRgbaTestImage(48, 40);
+    init_session(rgba.data(), 48, 40);
+
+    // A DCT encode, then a DWT sweep that replaces the shared cache
+    process_image(50, 420, 0);
+    const int qualities[] = {30, 50, 90};
+    double* points = rd_sweep(420, 1, qualities, 3);
+    ASSERT_NE(points, nullptr);
+    EXPECT_EQ(points[1 * 8], 50.0);
+    const double sweptBits = points[1 * 8 + 1];
+    const double sweptPsnr = points[1 * 8 + 2];
+    std::free(points);
+
+    // The DWT encode must reuse the swept cache, not the stale DCT codec
+    ASSERT_NO_THROW(process_image(50, 420, 1));
+    EXPECT_DOUBLE_EQ(get_last_bit_estimate(), sweptBits);
+    EXPECT_DOUBLE_EQ(get_psnr_y(), sweptPsnr);
+
+    // And back to DCT after sweeping it
+    points = rd_sweep(420, 0, qualities, 1);
+    ASSERT_NE(points, nullptr);
+    std::free(points);
+    ASSERT_NO_THROW(process_image(70, 420, 0));
+    EXPECT_GT(get_last_bit_estimate(), 0.0);
+
+    const int invalid[] = {50, 101};
+    EXPECT_EQ(rd_sweep(420, 0, invalid, 2), nullptr);
+}
@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 #include "CodecAnalysis.h"
 #include "Image.h"
+#include "colorspace.h"
+#include <algorithm>
 #include <cmath>
+#include <stdexcept>
 
 // Helper to create a flat color image
 Image createFlatImage(int width, int height, double r, double g, double b) {
@@ -70,3 +73,340 @@ TEST(CodecAnalysisTest, ComputeMetrics_Structure) {
     EXPECT_DOUBLE_EQ(metrics.ssimCr, 1.0);
     EXPECT_DOUBLE_EQ(metrics.ssimCb, 1.0);
 }
+
+TEST(CodecAnalysisTest, ComputeMetrics_OutputOverloadMatches) {
+    Image img1 = createFlatImage(16, 16, 100.0, 50.0, 25.0);
+    Image img2 = createFlatImage(16, 16, 110.0, 45.0, 30.0);
+
+    CodecMetrics expected = CodecAnalysis::computeMetrics(img1, img2);
+    CodecMetrics metrics;
+    CodecAnalysis::computeMetrics(img1, img2, metrics);
+    const double* mapStorage = metrics.artifactMap.data();
+    CodecAnalysis::computeMetrics(img1, img2, metrics);
+
+    EXPECT_EQ(metrics.artifactMap.data(), mapStorage);
+    EXPECT_DOUBLE_EQ(metrics.psnrY, expected.psnrY);
+    EXPECT_DOUBLE_EQ(metrics.psnrCr, expected.psnrCr);
+    EXPECT_DOUBLE_EQ(metrics.ssimCb, expected.ssimCb);
+    for (size_t i = 0; i < expected.artifactMap.size(); ++i)
+        EXPECT_DOUBLE_EQ(metrics.artifactMap.data()[i], expected.artifactMap.data()[i]);
+}
+
+TEST(CodecAnalysisTest, EdgeDistortionMap_ReusedBufferBorderIsZero) {
+    Image orig(8, 8, 1);
+    Image recon(8, 8, 1);
+    for (int y = 0; y < 8; ++y)
+        for (int x = 0; x < 8; ++x) {
+            orig.at(x, y, 0) = x * 10.0;
+            recon.at(x, y, 0) = y * 10.0;
+        }
+
+    Image out(8, 8, 1);
+    for (size_t i = 0; i < out.size(); ++i) out.data()[i] = 99.0; // Stale contents
+    CodecAnalysis::computeEdgeDistortionMap(orig, recon, out);
+
+    Image expected = CodecAnalysis::computeEdgeDistortionMap(orig, recon);
+    for (size_t i = 0; i < expected.size(); ++i)
+        EXPECT_DOUBLE_EQ(out.data()[i], expected.data()[i]);
+    EXPECT_DOUBLE_EQ(out.at(0, 0, 0), 0.0);
+    EXPECT_DOUBLE_EQ(out.at(7, 7, 0), 0.0);
+}
+
+TEST(CodecAnalysisTest, MetricsUseBitDepthPeak) {
+    Image img1(16, 16, 3), img2(16, 16, 3);
+    for (size_t i = 0; i < img1.size(); ++i) {
+        img1.data()[i] = static_cast<double>((i * 37) % 200 + 20);
+        img2.data()[i] = img1.data()[i] + static_cast<double>(i % 5) - 2.0;
+    }
+    Image deep1(16, 16, 3), deep2(16, 16, 3);
+    for (size_t i = 0; i < img1.size(); ++i) {
+        deep1.data()[i] = img1.data()[i] * 16.0;
+        deep2.data()[i] = img2.data()[i] * 16.0;
+    }
+
+    // 16× the samples at 12 bits: the same PSNR apart from the peak moving
+    // from 255 × 16 to 4095, and SSIM close to the 8-bit value
+    const CodecMetrics shallow = CodecAnalysis::computeMetrics(img1, img2);
+    const CodecMetrics deep = CodecAnalysis::computeMetrics(deep1, deep2, 12);
+    const double peakGain = 20.0 * std::log10(4095.0 / 4080.0);
+    EXPECT_NEAR(deep.psnrY, shallow.psnrY + peakGain, 1e-9);
+    EXPECT_NEAR(deep.psnrCr, shallow.psnrCr + peakGain, 1e-9);
+    EXPECT_NEAR(deep.ssimY, shallow.ssimY, 1e-3);
+    EXPECT_NEAR(deep.ssimCb, shallow.ssimCb, 1e-3);
+
+    // The artifact map stays on the 8-bit display scale
+    for (size_t i = 0; i < shallow.artifactMap.size(); ++i)
+        ASSERT_DOUBLE_EQ(deep.artifactMap.data()[i], shallow.artifactMap.data()[i]);
+
+    // Read at 8 bits, the deep images look far noisier
+    EXPECT_LT(CodecAnalysis::computePSNR(deep1, deep2), shallow.psnrY);
+    EXPECT_THROW(CodecAnalysis::computePSNR(img1, img2, 17), std::invalid_argument);
+}
+
+// Direct SSIM over the clipped 9x9 window at every pixel, averaged over
+// pixels and channels: the definition the summed-area version implements.
+static double referenceSSIM(const Image& a, const Image& b, double peak) {
+    const double C1 = (0.01 * peak) * (0.01 * peak);
+    const double C2 = (0.03 * peak) * (0.03 * peak);
+    const int w = a.width(), h = a.height(), channels = a.channels();
+    double total = 0.0;
+    for (int c = 0; c < channels; ++c)
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x) {
+                double ux = 0.0, uy = 0.0;
+                int count = 0;
+                for (int j = std::max(0, y - 4); j <= std::min(h - 1, y + 4); ++j)
+                    for (int i = std::max(0, x - 4); i <= std::min(w - 1, x + 4); ++i) {
+                        ux += a.at(i, j, c);
+                        uy += b.at(i, j, c);
+                        ++count;
+                    }
+                ux /= count;
+                uy /= count;
+                double sx = 0.0, sy = 0.0, sxy = 0.0;
+                for (int j = std::max(0, y - 4); j <= std::min(h - 1, y + 4); ++j)
+                    for (int i = std::max(0, x - 4); i <= std::min(w - 1, x + 4); ++i) {
+                        const double dx = a.at(i, j, c) - ux;
+                        const double dy = b.at(i, j, c) - uy;
+                        sx += dx * dx;
+                        sy += dy * dy;
+                        sxy += dx * dy;
+                    }
+                sx /= count;
+                sy /= count;
+                sxy /= count;
+                total += ((2 * ux * uy + C1) * (2 * sxy + C2)) /
+                         ((ux * ux + uy * uy + C1) * (sx + sy + C2));
+            }
+    return total / (static_cast<double>(w) * h * channels);
+}
+
+TEST(CodecAnalysisTest, SSIM_MatchesDirectWindowSums) {
+    // Odd sizes exercise the clipped windows; 3 channels the interleaving.
+    const int sizes[][3] = {{37, 29, 1}, {5, 3, 1}, {24, 17, 3}};
+    unsigned seed = 12345u;
+    auto noise = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<double>((seed >> 16) & 0x7FFF) / 32768.0;
+    };
+    for (const auto& size : sizes) {
+        Image a(size[0], size[1], size[2]), b(size[0], size[1], size[2]);
+        for (size_t i = 0; i < a.size(); ++i) {
+            a.data()[i] = 40.0 + 170.0 * noise();
+            b.data()[i] = std::min(255.0, std::max(0.0, a.data()[i] + 30.0 * (noise() - 0.5)));
+        }
+        EXPECT_NEAR(CodecAnalysis::computeSSIM(a, b), referenceSSIM(a, b, 255.0), 1e-6);
+
+        Image deepA = a, deepB = b;
+        for (size_t i = 0; i < a.size(); ++i) {
+            deepA.data()[i] *= 256.0;
+            deepB.data()[i] *= 256.0;
+        }
+        EXPECT_NEAR(CodecAnalysis::computeSSIM(deepA, deepB, 16),
+                    referenceSSIM(deepA, deepB, 65535.0), 1e-6);
+    }
+}
+
+// Direct 2D evaluation of the 11x11, sigma 1.5 window at every position
+// where it fits inside a single-channel image. Returns the mean SSIM and
+// stores the mean contrast-structure term in `cs`.
+static double referenceGaussianSSIM(const Image& a, const Image& b, double& cs) {
+    double window[11][11];
+    double total = 0.0;
+    for (int j = 0; j < 11; ++j)
+        for (int i = 0; i < 11; ++i) {
+            window[j][i] = std::exp(-((i - 5) * (i - 5) + (j - 5) * (j - 5)) / (2.0 * 1.5 * 1.5));
+            total += window[j][i];
+        }
+    const double C1 = 6.5025, C2 = 58.5225;
+    double sum = 0.0;
+    cs = 0.0;
+    for (int y = 0; y + 11 <= a.height(); ++y)
+        for (int x = 0; x + 11 <= a.width(); ++x) {
+            double ux = 0.0, uy = 0.0, sxx = 0.0, syy = 0.0, sxy = 0.0;
+            for (int j = 0; j < 11; ++j)
+                for (int i = 0; i < 11; ++i) {
+                    const double wgt = window[j][i] / total;
+                    const double va = a.at(x + i, y + j, 0), vb = b.at(x + i, y + j, 0);
+                    ux += wgt * va;
+                    uy += wgt * vb;
+                    sxx += wgt * va * va;
+                    syy += wgt * vb * vb;
+                    sxy += wgt * va * vb;
+                }
+            const double contrast = (2 * (sxy - ux * uy) + C2) / (sxx - ux * ux + syy - uy * uy + C2);
+            cs += contrast;
+            sum += (2 * ux * uy + C1) / (ux * ux + uy * uy + C1) * contrast;
+        }
+    const double windows = (a.width() - 10.0) * (a.height() - 10.0);
+    cs /= windows;
+    return sum / windows;
+}
+
+TEST(CodecAnalysisTest, GaussianSSIM_MatchesDirectConvolution) {
+    auto reference = [](const Image& a, const Image& b) {
+        double cs;
+        return referenceGaussianSSIM(a, b, cs);
+    };
+
+    // Tall enough for several parallel row bands.
+    Image a(53, 75, 1), b(53, 75, 1);
+    for (int y = 0; y < a.height(); ++y)
+        for (int x = 0; x < a.width(); ++x) {
+            a.at(x, y, 0) = 128.0 + 90.0 * std::sin(x * 0.3) * std::cos(y * 0.17);
+            b.at(x, y, 0) = a.at(x, y, 0) + ((x * 7 + y * 13) % 11) - 5.0;
+        }
+    const double ssim = CodecAnalysis::computeSSIM(a, b, 8, SsimWindow::Gaussian);
+    EXPECT_NEAR(ssim, reference(a, b), 1e-9);
+    EXPECT_LT(ssim, 1.0);
+    EXPECT_DOUBLE_EQ(CodecAnalysis::computeSSIM(a, a, 8, SsimWindow::Gaussian), 1.0);
+
+    // Selected through the metrics options.
+    Image bgrA(53, 75, 3), bgrB(53, 75, 3);
+    for (size_t i = 0; i < a.size(); ++i)
+        for (int c = 0; c < 3; ++c) {
+            bgrA.data()[i * 3 + c] = a.data()[i];
+            bgrB.data()[i * 3 + c] = b.data()[i];
+        }
+    MetricsOptions options;
+    options.ssimWindow = SsimWindow::Gaussian;
+    const CodecMetrics metrics = CodecAnalysis::computeMetrics(bgrA, bgrB, 8, options);
+    EXPECT_NEAR(metrics.ssimY, ssim, 1e-9);
+    EXPECT_NE(metrics.ssimY, CodecAnalysis::computeMetrics(bgrA, bgrB).ssimY);
+
+    Image small(10, 20, 1);
+    EXPECT_THROW(CodecAnalysis::computeSSIM(small, small, 8, SsimWindow::Gaussian), std::invalid_argument);
+
+    // computeMetrics() falls back to the box window instead of throwing.
+    Image smallA(10, 20, 3), smallB(10, 20, 3);
+    for (size_t i = 0; i < smallA.size(); ++i) {
+        smallA.data()[i] = static_cast<double>((i * 37) % 256);
+        smallB.data()[i] = static_cast<double>((i * 41) % 256);
+    }
+    const CodecMetrics boxMetrics = CodecAnalysis::computeMetrics(smallA, smallB);
+    CodecMetrics smallMetrics;
+    ASSERT_NO_THROW(smallMetrics = CodecAnalysis::computeMetrics(smallA, smallB, 8, options));
+    EXPECT_EQ(smallMetrics.ssimY, boxMetrics.ssimY);
+    EXPECT_EQ(smallMetrics.ssimCr, boxMetrics.ssimCr);
+}
+
+TEST(CodecAnalysisTest, MSSSIM_MatchesDirectPyramid) {
+    // Odd sizes check the dropped edges of the 2x2 averaging.
+    Image a(197, 181, 1), b(197, 181, 1);
+    for (int y = 0; y < a.height(); ++y)
+        for (int x = 0; x < a.width(); ++x) {
+            a.at(x, y, 0) = 128.0 + 60.0 * std::sin(x * 0.11) * std::cos(y * 0.07) + ((x * y) % 9) * 4.0;
+            b.at(x, y, 0) = a.at(x, y, 0) + ((x * 5 + y * 3) % 13) - 6.0;
+        }
+
+    const double weights[5] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+    double expected = 1.0;
+    Image levelA = a, levelB = b;
+    for (int level = 0; level < 5; ++level) {
+        double cs;
+        const double ssim = referenceGaussianSSIM(levelA, levelB, cs);
+        expected *= std::pow(level == 4 ? ssim : cs, weights[level]);
+
+        Image nextA(levelA.width() / 2, levelA.height() / 2, 1), nextB = nextA;
+        for (int y = 0; y < nextA.height(); ++y)
+            for (int x = 0; x < nextA.width(); ++x) {
+                nextA.at(x, y, 0) = 0.25 * (levelA.at(2 * x, 2 * y, 0) + levelA.at(2 * x + 1, 2 * y, 0) +
+                                            levelA.at(2 * x, 2 * y + 1, 0) + levelA.at(2 * x + 1, 2 * y + 1, 0));
+                nextB.at(x, y, 0) = 0.25 * (levelB.at(2 * x, 2 * y, 0) + levelB.at(2 * x + 1, 2 * y, 0) +
+                                            levelB.at(2 * x, 2 * y + 1, 0) + levelB.at(2 * x + 1, 2 * y + 1, 0));
+            }
+        levelA = nextA;
+        levelB = nextB;
+    }
+
+    const double msssim = CodecAnalysis::computeMSSSIM(a, b);
+    EXPECT_NEAR(msssim, expected, 1e-9);
+    EXPECT_LT(msssim, 1.0);
+    EXPECT_DOUBLE_EQ(CodecAnalysis::computeMSSSIM(a, a), 1.0);
+
+    // Reported for luma only when requested and the image is large enough.
+    Image bgrA(197, 181, 3), bgrB(197, 181, 3);
+    for (size_t i = 0; i < a.size(); ++i)
+        for (int c = 0; c < 3; ++c) {
+            bgrA.data()[i * 3 + c] = a.data()[i];
+            bgrB.data()[i * 3 + c] = b.data()[i];
+        }
+    MetricsOptions options;
+    options.metrics |= MetricsOptions::MSSSIM_Y;
+    EXPECT_NEAR(CodecAnalysis::computeMetrics(bgrA, bgrB, 8, options).msssimY, msssim, 1e-9);
+    EXPECT_DOUBLE_EQ(CodecAnalysis::computeMetrics(bgrA, bgrB).msssimY, 0.0);
+
+    EXPECT_TRUE(CodecAnalysis::supportsMSSSIM(176, 176));
+    EXPECT_FALSE(CodecAnalysis::supportsMSSSIM(175, 400));
+    Image small(175, 400, 1);
+    EXPECT_THROW(CodecAnalysis::computeMSSSIM(small, small), std::invalid_argument);
+    EXPECT_DOUBLE_EQ(CodecAnalysis::computeMetrics(createFlatImage(175, 400, 9, 9, 9),
+                                                   createFlatImage(175, 400, 9, 9, 9), 8, options).msssimY, 0.0);
+}
+
+TEST(CodecAnalysisTest, ComputeMetrics_MatchesPerChannelMetrics) {
+    // The single-sweep kernel must agree with converting to planes and
+    // measuring each one separately.
+    const int w = 45, h = 38;
+    Image img1(w, h, 3), img2(w, h, 3);
+    for (size_t i = 0; i < img1.size(); ++i) {
+        img1.data()[i] = static_cast<double>((i * 97) % 251);
+        img2.data()[i] = std::min(255.0, img1.data()[i] + static_cast<double>((i * 13) % 9));
+    }
+
+    Image planes1[3], planes2[3];
+    for (int c = 0; c < 3; ++c) {
+        planes1[c].resize(w, h, 1);
+        planes2[c].resize(w, h, 1);
+    }
+    const size_t numPixels = static_cast<size_t>(w) * h;
+    bgrToYCrCbPlanar(img1.data(), numPixels, planes1[0].data(), planes1[1].data(), planes1[2].data());
+    bgrToYCrCbPlanar(img2.data(), numPixels, planes2[0].data(), planes2[1].data(), planes2[2].data());
+
+    const CodecMetrics metrics = CodecAnalysis::computeMetrics(img1, img2);
+    const double psnr[3] = {metrics.psnrY, metrics.psnrCr, metrics.psnrCb};
+    const double ssim[3] = {metrics.ssimY, metrics.ssimCr, metrics.ssimCb};
+    for (int c = 0; c < 3; ++c) {
+        EXPECT_DOUBLE_EQ(psnr[c], CodecAnalysis::computePSNR(planes1[c], planes2[c]));
+        EXPECT_DOUBLE_EQ(ssim[c], CodecAnalysis::computeSSIM(planes1[c], planes2[c]));
+    }
+    const Image artifact = CodecAnalysis::computeArtifactMap(img1, img2);
+    for (size_t i = 0; i < artifact.size(); ++i)
+        ASSERT_DOUBLE_EQ(metrics.artifactMap.data()[i], artifact.data()[i]);
+
+    EXPECT_THROW(CodecAnalysis::computeMetrics(img1, Image(w, h + 1, 3)), std::invalid_argument);
+}
+
+TEST(CodecAnalysisTest, ComputeMetrics_OnlyRequestedMetrics) {
+    Image img1(24, 20, 3), img2(24, 20, 3);
+    for (size_t i = 0; i < img1.size(); ++i) {
+        img1.data()[i] = static_cast<double>((i * 53) % 241);
+        img2.data()[i] = std::max(0.0, img1.data()[i] - static_cast<double>(i % 6));
+    }
+    const CodecMetrics full = CodecAnalysis::computeMetrics(img1, img2);
+
+    MetricsOptions options;
+    options.metrics = MetricsOptions::PSNR_Y | MetricsOptions::SSIM_CB;
+    CodecMetrics metrics;
+    metrics.artifactMap.resize(2, 2, 1);
+    metrics.artifactMap.at(0, 0, 0) = 42.0;
+    metrics.ssimY = 7.0; // Stale values are cleared
+    CodecAnalysis::computeMetrics(img1, img2, metrics, 8, options);
+
+    EXPECT_DOUBLE_EQ(metrics.psnrY, full.psnrY);
+    EXPECT_DOUBLE_EQ(metrics.ssimCb, full.ssimCb);
+    EXPECT_DOUBLE_EQ(metrics.psnrCr, 0.0);
+    EXPECT_DOUBLE_EQ(metrics.psnrCb, 0.0);
+    EXPECT_DOUBLE_EQ(metrics.ssimY, 0.0);
+    EXPECT_DOUBLE_EQ(metrics.ssimCr, 0.0);
+
+    // The artifact map is only built on request.
+    EXPECT_EQ(metrics.artifactMap.width(), 2);
+    EXPECT_DOUBLE_EQ(metrics.artifactMap.at(0, 0, 0), 42.0);
+    options.metrics = MetricsOptions::ARTIFACT_MAP;
+    CodecAnalysis::computeMetrics(img1, img2, metrics, 8, options);
+    EXPECT_DOUBLE_EQ(metrics.psnrY, 0.0);
+    ASSERT_EQ(metrics.artifactMap.size(), full.artifactMap.size());
+    for (size_t i = 0; i < full.artifactMap.size(); ++i)
+        ASSERT_DOUBLE_EQ(metrics.artifactMap.data()[i], full.artifactMap.data()[i]);
+}
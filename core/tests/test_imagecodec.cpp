@@ -1,8 +1,17 @@
 #include <gtest/gtest.h>
 #include "ImageCodec.h"
 #include "CodecAnalysis.h"
+#include "colorspace.h"
+#include "transform.h"
 #include "Image.h"
 #include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 // Helper to create a simple test image (gradient)
 Image createTestImage(int width, int height) {
@@ -188,6 +197,233 @@ TEST(ImageCodecTest, ProcessChromaLossOrdering) {
     EXPECT_GE(m422.psnrCr, m420.psnrCr);
 }
 
+TEST(ImageCodecTest, ChromaUpsamplingReproducesLinearRamps) {
+    // Box-averaged chroma followed by triangle upsampling is exact on linear
+    // ramps, so with quantization disabled only the outermost pixels may differ
+    const int width = 48, height = 32;
+    Image input(width, height, 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            double* px = input.data() + (y * width + x) * 3;
+            px[0] = 40.0 + 3.0 * x;
+            px[1] = 120.0 + 0.5 * x - y;
+            px[2] = 200.0 - 2.0 * x + 1.5 * y;
+        }
+    }
+
+    const ImageCodec::ChromaSubsampling modes[] = {
+        ImageCodec::ChromaSubsampling::CS_422,
+        ImageCodec::ChromaSubsampling::CS_420
+    };
+    for (ImageCodec::ChromaSubsampling cs : modes) {
+        ImageCodec codec(50.0, false, cs);
+        Image output = codec.process(input);
+        for (int y = 1; y < height - 1; ++y) {
+            for (int x = 1; x < width - 1; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    const int idx = (y * width + x) * 3 + c;
+                    ASSERT_NEAR(output.data()[idx], input.data()[idx], 0.25)
+                        << "cs=" << static_cast<int>(cs) << " x=" << x << " y=" << y;
+                }
+            }
+        }
+    }
+}
+
+TEST(ImageCodecTest, ColorFormatIsUsedOnEveryPath) {
+    Image input = createTestImage(40, 24);
+    const ColorFormat hd = { ColorMatrix::BT709, ColorRange::Limited };
+
+    ImageCodec lossless(50.0, false);
+    lossless.setColorFormat(hd);
+    EXPECT_EQ(lossless.colorFormat().matrix, ColorMatrix::BT709);
+    CodecMetrics metrics = CodecAnalysis::computeMetrics(input, lossless.process(input));
+    EXPECT_GT(metrics.psnrY, 50.0);
+
+    ImageCodec frameCodec(60.0, true, ImageCodec::ChromaSubsampling::CS_420);
+    ImageCodec stripCodec(60.0, true, ImageCodec::ChromaSubsampling::CS_420);
+    ImageCodec defaultCodec(60.0, true, ImageCodec::ChromaSubsampling::CS_420);
+    frameCodec.setColorFormat(hd);
+    stripCodec.setColorFormat(hd);
+    stripCodec.setStripProcessing(true);
+
+    Image frameOut = frameCodec.process(input);
+    Image stripOut = stripCodec.process(input);
+    Image defaultOut = defaultCodec.process(input);
+    bool differsFromDefault = false;
+    for (size_t i = 0; i < frameOut.size(); ++i) {
+        ASSERT_DOUBLE_EQ(stripOut.data()[i], frameOut.data()[i]);
+        differsFromDefault |= frameOut.data()[i] != defaultOut.data()[i];
+    }
+    EXPECT_TRUE(differsFromDefault);
+}
+
+TEST(ImageCodecTest, PackedPixelsMatchImagePath) {
+    // RGBA rows padded to a 16-byte stride in, BGR rows with slack out
+    const int width = 37, height = 21;
+    const size_t inStride = 160, outStride = width * 3 + 5;
+    std::vector<uint8_t> rgba(inStride * height, 0xAB);
+    Image input(width, height, 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t* px = rgba.data() + y * inStride + x * 4;
+            px[0] = static_cast<uint8_t>((x * 7 + y * 3) % 256);   // R
+            px[1] = static_cast<uint8_t>((x * x + 5 * y) % 256);   // G
+            px[2] = static_cast<uint8_t>((200 + x - 2 * y) % 256); // B
+            input.at(x, y, 0) = px[2];
+            input.at(x, y, 1) = px[1];
+            input.at(x, y, 2) = px[0];
+        }
+    }
+    const ImageCodec::PackedImage packed = { rgba.data(), width, height, inStride, PixelLayout::RGBA8 };
+
+    const ImageCodec::ChromaSubsampling modes[] = {
+        ImageCodec::ChromaSubsampling::CS_444,
+        ImageCodec::ChromaSubsampling::CS_420
+    };
+    for (ImageCodec::ChromaSubsampling cs : modes) {
+        for (int strip = 0; strip < 2; ++strip) {
+            ImageCodec imageCodec(55.0, true, cs);
+            ImageCodec packedCodec(55.0, true, cs);
+            imageCodec.setStripProcessing(strip != 0);
+            packedCodec.setStripProcessing(strip != 0);
+
+            const Image expected = imageCodec.process(input);
+            std::vector<uint8_t> out(outStride * height, 0x5A);
+            packedCodec.process(packed, { out.data(), outStride, PixelLayout::BGR8 });
+            EXPECT_DOUBLE_EQ(packedCodec.getLastBitEstimate(), imageCodec.getLastBitEstimate());
+
+            std::vector<uint8_t> expectedRow(width * 3);
+            for (int y = 0; y < height; ++y) {
+                packPixels(expected.data() + static_cast<size_t>(y) * width * 3, width,
+                           expectedRow.data(), PixelLayout::BGR8);
+                for (int i = 0; i < width * 3; ++i)
+                    ASSERT_EQ(out[y * outStride + i], expectedRow[i]) << "row " << y << " sample " << i;
+                for (size_t i = width * 3; i < outStride; ++i)
+                    ASSERT_EQ(out[y * outStride + i], 0x5A); // Row padding untouched
+            }
+
+            // Packed analysis and reconstruction round the same way
+            ImageCodec::CoefficientCache cache;
+            packedCodec.analyze(packed, cache);
+            std::vector<uint8_t> rebuilt(outStride * height, 0x5A);
+            packedCodec.reconstruct(cache, { rebuilt.data(), outStride, PixelLayout::BGR8 });
+            EXPECT_EQ(rebuilt, out);
+        }
+    }
+
+    ImageCodec codec(55.0);
+    std::vector<uint8_t> out(outStride * height);
+    const ImageCodec::PackedImage shortStride = { rgba.data(), width, height, width * 3, PixelLayout::RGBA8 };
+    EXPECT_THROW(codec.process(shortStride, { out.data(), outStride, PixelLayout::BGR8 }), std::invalid_argument);
+    EXPECT_THROW(codec.process(packed, { nullptr, outStride, PixelLayout::BGR8 }), std::invalid_argument);
+}
+
+TEST(ImageCodecTest, HighBitDepthMatchesEightBitEquivalent) {
+    // 12-bit samples that are exactly 16× an 8-bit image code to the same
+    // levels and bit estimate, and reconstruct to 16× the 8-bit result.
+    // The content stays clear of the 8-bit clamp, which sits just below
+    // the 12-bit one.
+    const int width = 61, height = 43;
+    Image input8(width, height, 3);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            for (int c = 0; c < 3; ++c)
+                input8.at(x, y, c) = std::round(128.0 + 50.0 * std::sin(x * 0.3 + c) * std::cos(y * 0.2 - c));
+    Image input12(width, height, 3);
+    for (size_t i = 0; i < input8.size(); ++i)
+        input12.data()[i] = input8.data()[i] * 16.0;
+
+    using TT = ImageCodec::TransformType;
+    for (TT transform : { TT::DCT, TT::DWT, TT::Adaptive }) {
+        for (int tools = 0; tools < 2; ++tools) {
+            ImageCodec codec8(40.0, true, ImageCodec::ChromaSubsampling::CS_420, transform);
+            ImageCodec codec12(40.0, true, ImageCodec::ChromaSubsampling::CS_420, transform);
+            codec12.setBitDepth(12);
+            for (ImageCodec* codec : {&codec8, &codec12}) {
+                codec->setCoefficientOutput(true);
+                codec->setAdaptiveQuantization(tools != 0);
+                codec->setRdoQuantization(tools != 0);
+                codec->setIntraPrediction(tools != 0);
+            }
+
+            const Image out8 = codec8.process(input8);
+            const Image out12 = codec12.process(input12);
+            EXPECT_DOUBLE_EQ(codec12.getLastBitEstimate(), codec8.getLastBitEstimate());
+            for (size_t i = 0; i < out8.size(); ++i)
+                ASSERT_NEAR(out12.data()[i], out8.data()[i] * 16.0, 1e-7) << "sample " << i;
+            EXPECT_EQ(codec12.getQuantizedCoefficients().y.levels, codec8.getQuantizedCoefficients().y.levels);
+            EXPECT_EQ(codec12.getQuantizedCoefficients().cr.levels, codec8.getQuantizedCoefficients().cr.levels);
+
+            // Cached coefficients carry the depth they were analysed at
+            ImageCodec::CoefficientCache cache;
+            codec12.analyze(input12, cache);
+            EXPECT_DOUBLE_EQ(codec12.estimateBits(cache), codec8.getLastBitEstimate());
+            EXPECT_FALSE(codec8.canReconstruct(cache));
+        }
+    }
+
+    // Reconstructions clamp to the 12-bit range, not to 255
+    ImageCodec nearLossless(100.0);
+    nearLossless.setBitDepth(12);
+    Image bright(16, 16, 3);
+    std::fill(bright.data(), bright.data() + bright.size(), 4000.0);
+    const Image brightOut = nearLossless.process(bright);
+    EXPECT_NEAR(brightOut.at(5, 5, 1), 4000.0, 1.0);
+
+    ImageCodec codec(50.0);
+    EXPECT_THROW(codec.setBitDepth(7), std::invalid_argument);
+    EXPECT_THROW(codec.setBitDepth(17), std::invalid_argument);
+    EXPECT_EQ(codec.bitDepth(), 8);
+}
+
+TEST(ImageCodecTest, SixteenBitPackedPixelsMatchImagePath) {
+    const int width = 29, height = 19;
+    const size_t inStride = width * 3 * 2 + 6, outStride = width * 4 * 2;
+    std::vector<uint16_t> bgr(inStride / 2 * height);
+    Image input(width, height, 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                const uint16_t v = static_cast<uint16_t>((x * 131 + y * 257 + c * 1000) % 1024);
+                bgr[y * inStride / 2 + x * 3 + c] = v;
+                input.at(x, y, c) = v;
+            }
+        }
+    }
+    const ImageCodec::PackedImage packed = {
+        reinterpret_cast<const uint8_t*>(bgr.data()), width, height, inStride, PixelLayout::BGR16
+    };
+
+    ImageCodec imageCodec(70.0, true, ImageCodec::ChromaSubsampling::CS_422);
+    ImageCodec packedCodec(70.0, true, ImageCodec::ChromaSubsampling::CS_422);
+    imageCodec.setBitDepth(10);
+    packedCodec.setBitDepth(10);
+
+    const Image expected = imageCodec.process(input);
+    std::vector<uint16_t> out(outStride / 2 * height);
+    packedCodec.process(packed, { reinterpret_cast<uint8_t*>(out.data()), outStride, PixelLayout::RGBA16 });
+    EXPECT_DOUBLE_EQ(packedCodec.getLastBitEstimate(), imageCodec.getLastBitEstimate());
+
+    std::vector<uint16_t> expectedRgba(static_cast<size_t>(width) * height * 4);
+    packPixels(expected.data(), static_cast<size_t>(width) * height,
+               reinterpret_cast<uint8_t*>(expectedRgba.data()), PixelLayout::RGBA16, 10);
+    EXPECT_EQ(out, expectedRgba);
+    EXPECT_EQ(out[3], 1023); // Alpha is the largest 10-bit value
+
+    // 8-bit layouts cannot carry 10-bit samples, and 16-bit rows must be aligned
+    std::vector<uint8_t> bytes(static_cast<size_t>(width) * height * 4);
+    const ImageCodec::PackedImage eightBit = { bytes.data(), width, height, width * 4u, PixelLayout::RGBA8 };
+    EXPECT_THROW(packedCodec.process(eightBit, { bytes.data(), width * 4u, PixelLayout::RGBA8 }),
+                 std::invalid_argument);
+    const ImageCodec::PackedImage misaligned = {
+        reinterpret_cast<const uint8_t*>(bgr.data()) + 1, width, height - 1, inStride, PixelLayout::BGR16
+    };
+    EXPECT_THROW(packedCodec.process(misaligned, { reinterpret_cast<uint8_t*>(out.data()), outStride,
+                                                   PixelLayout::RGBA16 }),
+                 std::invalid_argument);
+}
+
 // ── inspectBlock() tests ───────────────────────────────────────────────────
 
 TEST(ImageCodecTest, InspectBlockQuantTableMinValue) {
@@ -225,9 +461,10 @@ TEST(ImageCodecTest, InspectBlockDCDominatesForUniform) {
 
     for (int i = 0; i < 8; ++i)
         for (int j = 0; j < 8; ++j)
-            if (i != 0 || j != 0)
+            if (i != 0 || j != 0) {
                 EXPECT_NEAR(debug.coefficients[i][j], 0.0, 1e-6)
                     << "AC coefficient [" << i << "][" << j << "] not near zero";
+            }
 }
 
 TEST(ImageCodecTest, InspectBlockQuantizedAreIntegers) {
@@ -285,3 +522,618 @@ TEST(ImageCodecTest, InspectBlockHigherQualityLowerQuantTable) {
         }
     EXPECT_GT(lowSum, highSum);
 }
+
+// ── Strip processing ───────────────────────────────────────────────────────
+
+TEST(ImageCodecTest, StripProcessingMatchesFrameProcessing) {
+    // Odd sizes exercise partial MCU rows, boundary blocks and chroma tails
+    const int sizes[][2] = {{64, 64}, {37, 29}, {8, 8}, {50, 17}};
+    const ImageCodec::ChromaSubsampling modes[] = {
+        ImageCodec::ChromaSubsampling::CS_444,
+        ImageCodec::ChromaSubsampling::CS_422,
+        ImageCodec::ChromaSubsampling::CS_420
+    };
+
+    for (const auto& size : sizes) {
+        Image input = createTestImage(size[0], size[1]);
+        for (auto cs : modes) {
+            for (bool quantize : {true, false}) {
+                ImageCodec frameCodec(40.0, quantize, cs);
+                ImageCodec stripCodec(40.0, quantize, cs);
+                stripCodec.setStripProcessing(true);
+
+                Image frameOut = frameCodec.process(input);
+                Image stripOut = stripCodec.process(input);
+
+                ASSERT_EQ(stripOut.size(), frameOut.size());
+                for (size_t i = 0; i < frameOut.size(); ++i)
+                    ASSERT_EQ(stripOut.data()[i], frameOut.data()[i])
+                        << size[0] << "x" << size[1] << " cs=" << static_cast<int>(cs)
+                        << " sample " << i;
+                EXPECT_NEAR(stripCodec.getLastBitEstimate(), frameCodec.getLastBitEstimate(), 1e-6);
+            }
+        }
+    }
+}
+
+TEST(ImageCodecTest, StripProcessingFallsBackForDWT) {
+    Image input = createTestImage(40, 24);
+    ImageCodec frameCodec(60.0, true, ImageCodec::ChromaSubsampling::CS_420, ImageCodec::TransformType::DWT);
+    ImageCodec stripCodec(60.0, true, ImageCodec::ChromaSubsampling::CS_420, ImageCodec::TransformType::DWT);
+    stripCodec.setStripProcessing(true);
+
+    Image frameOut = frameCodec.process(input);
+    Image stripOut = stripCodec.process(input);
+    for (size_t i = 0; i < frameOut.size(); ++i)
+        ASSERT_EQ(stripOut.data()[i], frameOut.data()[i]);
+}
+
+TEST(ImageCodecTest, StreamProcessingMatchesFrameProcessing) {
+    const int width = 45, height = 53;
+    Image input = createTestImage(width, height);
+    const ImageCodec::ChromaSubsampling modes[] = {
+        ImageCodec::ChromaSubsampling::CS_444,
+        ImageCodec::ChromaSubsampling::CS_422,
+        ImageCodec::ChromaSubsampling::CS_420
+    };
+
+    for (auto cs : modes) {
+        ImageCodec frameCodec(55.0, true, cs);
+        ImageCodec streamCodec(55.0, true, cs);
+        Image frameOut = frameCodec.process(input);
+
+        Image streamOut(width, height, 3);
+        const size_t rowSamples = static_cast<size_t>(width) * 3;
+        int nextRow = 0;
+        streamCodec.processStream(width, height,
+            [&](int y, int rows, double* bgr) {
+                std::copy(input.data() + y * rowSamples,
+                          input.data() + (y + rows) * rowSamples, bgr);
+            },
+            [&](int y, int rows, const double* bgr) {
+                EXPECT_EQ(y, nextRow); // Rows arrive in order, exactly once
+                nextRow = y + rows;
+                std::copy(bgr, bgr + rows * rowSamples, streamOut.data() + y * rowSamples);
+            });
+
+        EXPECT_EQ(nextRow, height);
+        for (size_t i = 0; i < frameOut.size(); ++i)
+            ASSERT_EQ(streamOut.data()[i], frameOut.data()[i]) << "cs=" << static_cast<int>(cs);
+        EXPECT_NEAR(streamCodec.getLastBitEstimate(), frameCodec.getLastBitEstimate(), 1e-6);
+    }
+}
+
+TEST(ImageCodecTest, StreamProcessingRejectsDWT) {
+    ImageCodec codec(50.0, true, ImageCodec::ChromaSubsampling::CS_444, ImageCodec::TransformType::DWT);
+    auto read = [](int, int, double*) {};
+    auto write = [](int, int, const double*) {};
+    EXPECT_THROW(codec.processStream(16, 16, read, write), std::logic_error);
+}
+
+// Streams a `height`-row 4:2:0 image whose rows repeat every `period` rows
+// (a multiple of the MCU height dividing `height`) through processStream()
+// and counts output rows that differ from process() on three periods of the
+// same pattern. Chroma upsampling blends across period seams, so the first
+// and last periods match the reference's edge periods and every other period
+// matches its middle one, which has a neighbouring period on both sides.
+static size_t periodicStreamMismatches(int width, int height, int period) {
+    auto fillRows = [width, period](int y, int rows, double* bgr) {
+        const size_t rowSamples = static_cast<size_t>(width) * 3;
+        for (int r = 0; r < rows; ++r) {
+            const int phase = (y + r) % period;
+            for (int x = 0; x < width; ++x) {
+                double* px = bgr + r * rowSamples + static_cast<size_t>(x) * 3;
+                px[0] = x % 256;
+                px[1] = (phase * 7) % 256;
+                px[2] = (x + phase) % 256;
+            }
+        }
+    };
+
+    Image source(width, 3 * period, 3);
+    fillRows(0, 3 * period, source.data());
+    ImageCodec refCodec(50.0, true, ImageCodec::ChromaSubsampling::CS_420);
+    const Image reference = refCodec.process(source);
+
+    ImageCodec codec(50.0, true, ImageCodec::ChromaSubsampling::CS_420);
+    const size_t rowSamples = static_cast<size_t>(width) * 3;
+    int64_t rowsWritten = 0;
+    size_t mismatches = 0;
+    codec.processStream(width, height, fillRows,
+        [&](int y, int rows, const double* bgr) {
+            for (int r = 0; r < rows; ++r) {
+                const int row = y + r;
+                int refRow = period + row % period;
+                if (row < period)
+                    refRow = row;
+                else if (row >= height - period)
+                    refRow = 2 * period + (row - (height - period));
+                const double* expected = reference.data() + static_cast<size_t>(refRow) * rowSamples;
+                const double* actual = bgr + r * rowSamples;
+                mismatches += !std::equal(actual, actual + rowSamples, expected);
+            }
+            rowsWritten += rows;
+        });
+
+    EXPECT_EQ(rowsWritten, height);
+    return mismatches;
+}
+
+TEST(ImageCodecTest, StreamProcessingMatchesPeriodicReference) {
+    // Several strips and period seams, small enough to always run.
+    EXPECT_EQ(periodicStreamMismatches(40, 6 * 32, 32), 0u);
+}
+
+// Streams a 65536×32800 image (more than 2^31 pixels) through the codec. The
+// test pattern repeats every 32 rows, so each reconstructed row can be
+// checked against a three-period reference without holding the full frame.
+// Takes minutes; enable with CODEC_LARGE_IMAGE_TESTS=1.
+TEST(ImageCodecTest, StreamProcessingBeyond32BitSampleCount) {
+    if (!std::getenv("CODEC_LARGE_IMAGE_TESTS"))
+        GTEST_SKIP() << "set CODEC_LARGE_IMAGE_TESTS=1 to run";
+
+    const int width = 65536;
+    const int period = 32;
+    const int height = 32768 + period;
+    ASSERT_GT(static_cast<int64_t>(width) * height, static_cast<int64_t>(INT32_MAX));
+    EXPECT_EQ(periodicStreamMismatches(width, height, period), 0u);
+}
+
+TEST(ImageCodecTest, CachedReconstructionMatchesProcess) {
+    Image input = createTestImage(45, 37);
+    const ImageCodec::TransformType transforms[] = {
+        ImageCodec::TransformType::DCT, ImageCodec::TransformType::DWT
+    };
+    const ImageCodec::ChromaSubsampling modes[] = {
+        ImageCodec::ChromaSubsampling::CS_444,
+        ImageCodec::ChromaSubsampling::CS_422,
+        ImageCodec::ChromaSubsampling::CS_420
+    };
+
+    for (auto transform : transforms) {
+        for (auto cs : modes) {
+            ImageCodec::CoefficientCache cache;
+            ImageCodec(50.0, true, cs, transform).analyze(input, cache);
+
+            // One analysis serves every quality setting.
+            for (double quality : {10.0, 50.0, 90.0}) {
+                ImageCodec direct(quality, true, cs, transform);
+                ImageCodec cached(quality, true, cs, transform);
+                ASSERT_TRUE(cached.canReconstruct(cache));
+
+                Image expected = direct.process(input);
+                Image actual;
+                cached.reconstruct(cache, actual);
+
+                ASSERT_EQ(actual.size(), expected.size());
+                for (size_t i = 0; i < expected.size(); ++i)
+                    ASSERT_EQ(actual.data()[i], expected.data()[i])
+                        << "transform=" << static_cast<int>(transform)
+                        << " cs=" << static_cast<int>(cs) << " q=" << quality;
+                EXPECT_EQ(cached.getLastBitEstimate(), direct.getLastBitEstimate());
+            }
+        }
+    }
+}
+
+TEST(ImageCodecTest, ReconstructRejectsMismatchedCache) {
+    Image input = createTestImage(16, 16);
+    ImageCodec::CoefficientCache cache;
+
+    ImageCodec codec420(50.0, true, ImageCodec::ChromaSubsampling::CS_420);
+    Image out;
+    EXPECT_FALSE(codec420.canReconstruct(cache));
+    EXPECT_THROW(codec420.reconstruct(cache, out), std::invalid_argument);
+
+    ImageCodec(50.0, true, ImageCodec::ChromaSubsampling::CS_444).analyze(input, cache);
+    EXPECT_FALSE(codec420.canReconstruct(cache));
+    EXPECT_THROW(codec420.reconstruct(cache, out), std::invalid_argument);
+
+    ImageCodec dwt(50.0, true, ImageCodec::ChromaSubsampling::CS_444, ImageCodec::TransformType::DWT);
+    EXPECT_FALSE(dwt.canReconstruct(cache));
+
+    // The colour format is applied on the way back to BGR, so it must match too
+    ImageCodec codec444(50.0, true, ImageCodec::ChromaSubsampling::CS_444);
+    EXPECT_TRUE(codec444.canReconstruct(cache));
+    codec444.setColorFormat({ColorMatrix::BT709, ColorRange::Limited});
+    EXPECT_FALSE(codec444.canReconstruct(cache));
+    EXPECT_THROW(codec444.reconstruct(cache, out), std::invalid_argument);
+
+    cache.clear();
+    EXPECT_TRUE(cache.empty());
+}
+
+TEST(ImageCodecTest, RdoQuantizationSpendsFewerBits) {
+    Image input = createTestImage(64, 64);
+    for (int y = 0; y < 64; ++y)
+        for (int x = 0; x < 64; ++x)
+            input.at(x, y, 1) = 128.0 + 60.0 * std::sin(x * 0.4) * std::cos(y * 0.3); // Add texture
+
+    ImageCodec plain(75.0);
+    ImageCodec rdo(75.0);
+    rdo.setRdoQuantization(true);
+    EXPECT_TRUE(rdo.rdoQuantization());
+
+    Image plainOut = plain.process(input);
+    Image rdoOut = rdo.process(input);
+    EXPECT_LT(rdo.getLastBitEstimate(), plain.getLastBitEstimate());
+
+    // Lowering levels trades a little fidelity for the rate saving.
+    double psnrPlain = CodecAnalysis::computePSNR(input, plainOut);
+    double psnrRdo = CodecAnalysis::computePSNR(input, rdoOut);
+    EXPECT_LE(psnrRdo, psnrPlain);
+    EXPECT_GT(psnrRdo, psnrPlain - 3.0);
+}
+
+TEST(ImageCodecTest, RdoQuantizationOnlyLowersLevels) {
+    ImageCodec plain(60.0);
+    ImageCodec rdo(60.0);
+    rdo.setRdoQuantization(true);
+
+    Image y(32, 32, 1);
+    for (int py = 0; py < 32; ++py)
+        for (int px = 0; px < 32; ++px)
+            y.at(px, py, 0) = (px * 13 + py * 7) % 256;
+
+    auto a = plain.inspectBlock(y, 1, 1);
+    auto b = rdo.inspectBlock(y, 1, 1);
+    EXPECT_EQ(b.quantized[0][0], a.quantized[0][0]); // DC is never touched
+    for (int i = 0; i < 8; ++i)
+        for (int j = 0; j < 8; ++j) {
+            EXPECT_LE(std::abs(b.quantized[i][j]), std::abs(a.quantized[i][j]));
+            if (b.quantized[i][j] != 0.0) { // Otherwise at most one level lower
+                EXPECT_GE(std::abs(b.quantized[i][j]), std::abs(a.quantized[i][j]) - 1.0);
+                EXPECT_EQ(std::signbit(b.quantized[i][j]), std::signbit(a.quantized[i][j]));
+            }
+        }
+}
+
+TEST(ImageCodecTest, AdaptiveQuantizationScalesFlatAndTexturedBlocks) {
+    // Left half flat, right half high-contrast checkerboard
+    Image input(32, 16, 3);
+    for (int y = 0; y < 16; ++y)
+        for (int x = 0; x < 32; ++x)
+            for (int c = 0; c < 3; ++c)
+                input.at(x, y, c) = (x < 16) ? 100.0 : (((x + y) & 1) ? 220.0 : 30.0);
+
+    ImageCodec codec(50.0);
+    codec.process(input);
+    EXPECT_EQ(codec.getQpScaleMap().size(), 0u); // Disabled by default
+
+    codec.setAdaptiveQuantization(true);
+    EXPECT_TRUE(codec.adaptiveQuantization());
+    codec.process(input);
+
+    const Image& map = codec.getQpScaleMap();
+    ASSERT_EQ(map.width(), 4);
+    ASSERT_EQ(map.height(), 2);
+    EXPECT_LT(map.at(0, 0, 0), 1.0); // Flat: finer steps
+    EXPECT_GT(map.at(3, 1, 0), 1.0); // Textured: coarser steps
+
+    EXPECT_THROW(codec.setAdaptiveQuantization(true, -1.0), std::invalid_argument);
+}
+
+// One input run through the three encode paths a coding tool has to agree
+// on: process() on the whole frame, strip processing, and analyze() plus
+// reconstruct() from a coefficient cache. The codecs are kept so tests can
+// compare the maps and levels they expose.
+struct CodecPaths {
+    CodecPaths(double quality, ImageCodec::ChromaSubsampling cs, ImageCodec::TransformType transform)
+        : frame(quality, true, cs, transform), strip(quality, true, cs, transform),
+          cached(quality, true, cs, transform) {}
+
+    ImageCodec frame, strip, cached;
+    ImageCodec::CoefficientCache cache;
+    Image frameOut, stripOut, cachedOut;
+};
+
+// Applies `configure` to each codec, runs the three paths and checks that
+// they reconstruct the same image and agree on its bit estimate.
+static std::unique_ptr<CodecPaths> runCodecPaths(
+    const Image& input, double quality, ImageCodec::ChromaSubsampling cs,
+    ImageCodec::TransformType transform, const std::function<void(ImageCodec&)>& configure)
+{
+    auto paths = std::make_unique<CodecPaths>(quality, cs, transform);
+    for (ImageCodec* codec : {&paths->frame, &paths->strip, &paths->cached})
+        configure(*codec);
+    paths->strip.setStripProcessing(true);
+
+    paths->frameOut = paths->frame.process(input);
+    paths->stripOut = paths->strip.process(input);
+    paths->cached.analyze(input, paths->cache);
+    paths->cached.reconstruct(paths->cache, paths->cachedOut);
+
+    EXPECT_EQ(paths->stripOut.size(), paths->frameOut.size());
+    EXPECT_EQ(paths->cachedOut.size(), paths->frameOut.size());
+    EXPECT_TRUE(std::equal(paths->frameOut.data(), paths->frameOut.data() + paths->frameOut.size(),
+                           paths->stripOut.data()));
+    EXPECT_TRUE(std::equal(paths->frameOut.data(), paths->frameOut.data() + paths->frameOut.size(),
+                           paths->cachedOut.data()));
+    EXPECT_NEAR(paths->strip.getLastBitEstimate(), paths->frame.getLastBitEstimate(), 1e-6);
+    EXPECT_EQ(paths->cached.estimateBits(paths->cache), paths->cached.getLastBitEstimate());
+    return paths;
+}
+
+TEST(ImageCodecTest, AdaptiveQuantizationIsConsistentAcrossPaths) {
+    Image input = createTestImage(53, 41);
+    for (int y = 0; y < 41; ++y)
+        for (int x = 0; x < 53; ++x)
+            input.at(x, y, 1) = 128.0 + 60.0 * std::sin(x * 0.9) * std::cos(y * 0.2);
+
+    for (auto cs : {ImageCodec::ChromaSubsampling::CS_444, ImageCodec::ChromaSubsampling::CS_420}) {
+        const auto paths = runCodecPaths(input, 40.0, cs, ImageCodec::TransformType::DCT,
+            [](ImageCodec& codec) { codec.setAdaptiveQuantization(true, 1.5); });
+
+        const Image& map = paths->frame.getQpScaleMap();
+        for (size_t i = 0; i < map.size(); ++i) {
+            EXPECT_EQ(paths->strip.getQpScaleMap().data()[i], map.data()[i]);
+            EXPECT_EQ(paths->cached.getQpScaleMap().data()[i], map.data()[i]);
+        }
+    }
+}
+
+TEST(ImageCodecTest, FlatBlockFastPathMatchesFullTransform) {
+    // Screenshot-like content: flat panels with a faint dither, a gentle
+    // ramp, and one strip of hard text-like edges.
+    Image input(64, 48, 3);
+    for (int y = 0; y < 48; ++y)
+        for (int x = 0; x < 64; ++x) {
+            input.at(x, y, 0) = 200.0 + ((x + y) & 1) * 0.5;
+            input.at(x, y, 1) = 96.0 + x * 0.05;
+            input.at(x, y, 2) = (y >= 16 && y < 24) ? ((x / 3) % 2) * 255.0 : 64.0;
+        }
+
+    ImageCodec codec(50.0, true, ImageCodec::ChromaSubsampling::CS_444);
+    Image out = codec.process(input);
+
+    const ImageCodec::BlockStats& stats = codec.getLastBlockStats();
+    EXPECT_EQ(stats.blocks, 3u * 48u);
+    EXPECT_GT(stats.flatBlocks, 0u);
+    EXPECT_LT(stats.flatBlocks, stats.blocks); // Edge blocks need the full DCT
+    EXPECT_GE(stats.dcOnlyBlocks, stats.flatBlocks);
+
+    // The cached path always runs the full forward DCT.
+    ImageCodec::CoefficientCache cache;
+    Image cachedOut;
+    codec.analyze(input, cache);
+    codec.reconstruct(cache, cachedOut);
+    EXPECT_EQ(codec.getLastBlockStats().flatBlocks, 0u);
+    EXPECT_EQ(codec.getLastBlockStats().dcOnlyBlocks, stats.dcOnlyBlocks);
+    for (size_t i = 0; i < out.size(); ++i)
+        ASSERT_EQ(cachedOut.data()[i], out.data()[i]);
+
+    codec.setStripProcessing(true);
+    Image stripOut = codec.process(input);
+    EXPECT_EQ(codec.getLastBlockStats().flatBlocks, stats.flatBlocks);
+    for (size_t i = 0; i < out.size(); ++i)
+        ASSERT_EQ(stripOut.data()[i], out.data()[i]);
+}
+
+TEST(ImageCodecTest, IntraPredictionFollowsOrientedContent) {
+    // Vertical stripes in the luma-carrying green channel, then the same
+    // pattern rotated: the predictor should copy the row above / the column
+    // to the left and the residual should cost far fewer bits.
+    Image vertical(64, 64, 3), horizontal(64, 64, 3);
+    for (int y = 0; y < 64; ++y)
+        for (int x = 0; x < 64; ++x)
+            for (int c = 0; c < 3; ++c) {
+                vertical.at(x, y, c) = ((x / 3) % 2) ? 220.0 : 30.0;
+                horizontal.at(x, y, c) = ((y / 3) % 2) ? 220.0 : 30.0;
+            }
+
+    const auto vert = static_cast<double>(ImageCodec::IntraMode::Vertical);
+    const auto horiz = static_cast<double>(ImageCodec::IntraMode::Horizontal);
+
+    ImageCodec plain(50.0);
+    ImageCodec intra(50.0);
+    EXPECT_FALSE(intra.intraPrediction());
+    intra.setIntraPrediction(true);
+    EXPECT_TRUE(intra.intraPrediction());
+
+    plain.process(vertical);
+    intra.process(vertical);
+    EXPECT_LT(intra.getLastBitEstimate(), plain.getLastBitEstimate());
+    const Image& map = intra.getIntraModeMap();
+    ASSERT_EQ(map.width(), 8);
+    ASSERT_EQ(map.height(), 8);
+    EXPECT_EQ(map.at(3, 5, 0), vert);
+
+    plain.process(horizontal);
+    intra.process(horizontal);
+    EXPECT_LT(intra.getLastBitEstimate(), plain.getLastBitEstimate());
+    EXPECT_EQ(intra.getIntraModeMap().at(5, 3, 0), horiz);
+
+    intra.setIntraPrediction(false);
+    EXPECT_EQ(intra.getIntraModeMap().size(), 0u);
+}
+
+TEST(ImageCodecTest, IntraPredictionIsConsistentAcrossPaths) {
+    Image input = createTestImage(61, 45);
+    for (int y = 0; y < 45; ++y)
+        for (int x = 0; x < 61; ++x)
+            input.at(x, y, 1) = 128.0 + 50.0 * std::sin(x * 0.3 + y * 0.1);
+
+    for (auto cs : {ImageCodec::ChromaSubsampling::CS_444, ImageCodec::ChromaSubsampling::CS_420}) {
+        const auto paths = runCodecPaths(input, 60.0, cs, ImageCodec::TransformType::DCT,
+            [](ImageCodec& codec) { codec.setIntraPrediction(true); });
+        EXPECT_TRUE(paths->cache.intraPrediction);
+        EXPECT_EQ(paths->cached.getLastBitEstimate(), paths->frame.getLastBitEstimate());
+
+        Image streamOut(61, 45, 3);
+        paths->strip.processStream(61, 45,
+            [&](int y, int rows, double* bgr) {
+                std::copy(input.data() + static_cast<size_t>(y) * 61 * 3,
+                          input.data() + static_cast<size_t>(y + rows) * 61 * 3, bgr);
+            },
+            [&](int y, int rows, const double* bgr) {
+                std::copy(bgr, bgr + static_cast<size_t>(rows) * 61 * 3,
+                          streamOut.data() + static_cast<size_t>(y) * 61 * 3);
+            });
+        for (size_t i = 0; i < paths->frameOut.size(); ++i)
+            ASSERT_EQ(streamOut.data()[i], paths->frameOut.data()[i]);
+
+        const Image& map = paths->frame.getIntraModeMap();
+        for (size_t i = 0; i < map.size(); ++i) {
+            EXPECT_EQ(paths->strip.getIntraModeMap().data()[i], map.data()[i]);
+            EXPECT_EQ(paths->cached.getIntraModeMap().data()[i], map.data()[i]);
+        }
+
+        // A cache analysed without prediction cannot be reused with it.
+        ImageCodec plain(60.0, true, cs);
+        ImageCodec::CoefficientCache plainCache;
+        Image cachedOut;
+        plain.analyze(input, plainCache);
+        EXPECT_FALSE(paths->cached.canReconstruct(plainCache));
+        EXPECT_THROW(paths->cached.reconstruct(plainCache, cachedOut), std::invalid_argument);
+    }
+}
+
+TEST(ImageCodecTest, AdaptiveTransformPicksModesPerRegion) {
+    // Left region: flat background with hard-edged "text"; right region:
+    // smooth ramp with no exact repeats.
+    Image input(128, 64, 3);
+    for (int y = 0; y < 64; ++y)
+        for (int x = 0; x < 128; ++x)
+            for (int c = 0; c < 3; ++c)
+                input.at(x, y, c) = (x < 64)
+                    ? (((y / 6) % 2 == 0 && (x * 7 + y) % 11 < 3) ? 20.0 : 240.0)
+                    : 40.0 + x * 1.3 + y * 0.7 + c * 10.0 + 0.01 * ((x * y) % 7);
+
+    ImageCodec codec(50.0, true, ImageCodec::ChromaSubsampling::CS_444,
+                     ImageCodec::TransformType::Adaptive);
+    Image out = codec.process(input);
+
+    const Image& map = codec.getRegionMap();
+    ASSERT_EQ(map.width(), 2);
+    ASSERT_EQ(map.height(), 1);
+    EXPECT_EQ(map.at(0, 0, 0), static_cast<double>(ImageCodec::RegionMode::Skip));
+    EXPECT_NE(map.at(1, 0, 0), static_cast<double>(ImageCodec::RegionMode::Skip));
+
+    // Skipped regions come back exactly, up to the colour round trip.
+    for (int y = 0; y < 64; ++y)
+        for (int x = 0; x < 64; ++x)
+            for (int c = 0; c < 3; ++c)
+                ASSERT_NEAR(out.at(x, y, c), input.at(x, y, c), 1e-6);
+
+    ImageCodec dct(50.0, true, ImageCodec::ChromaSubsampling::CS_444);
+    dct.process(input);
+    EXPECT_TRUE(dct.getRegionMap().size() == 0);
+}
+
+TEST(ImageCodecTest, AdaptiveTransformIsConsistentAcrossPaths) {
+    Image input = createTestImage(150, 90);
+    for (int y = 0; y < 90; ++y)
+        for (int x = 0; x < 70; ++x)
+            input.at(x, y, 1) = ((x / 4 + y / 5) % 3) ? 250.0 : 0.0;
+
+    for (auto cs : {ImageCodec::ChromaSubsampling::CS_444, ImageCodec::ChromaSubsampling::CS_420}) {
+        // Strip processing falls back to frame processing.
+        const auto paths = runCodecPaths(input, 40.0, cs, ImageCodec::TransformType::Adaptive,
+            [](ImageCodec&) {});
+        ImageCodec& cached = paths->cached;
+        EXPECT_EQ(cached.getLastBitEstimate(), paths->frame.getLastBitEstimate());
+        const Image& frameMap = paths->frame.getRegionMap();
+        for (size_t i = 0; i < frameMap.size(); ++i)
+            EXPECT_EQ(cached.getRegionMap().data()[i], frameMap.data()[i]);
+
+        // Estimating at another quality leaves the coded frame's map alone
+        const Image regionMap = cached.getRegionMap();
+        cached.setQuality(95.0);
+        cached.estimateBits(paths->cache);
+        ASSERT_EQ(cached.getRegionMap().size(), regionMap.size());
+        for (size_t i = 0; i < regionMap.size(); ++i)
+            EXPECT_EQ(cached.getRegionMap().data()[i], regionMap.data()[i]);
+
+        auto read = [](int, int, double*) {};
+        auto write = [](int, int, const double*) {};
+        EXPECT_THROW(paths->strip.processStream(16, 16, read, write), std::logic_error);
+    }
+}
+
+TEST(ImageCodecTest, QuantizedCoefficientsMatchInspectedBlocks) {
+    const int width = 53, height = 41;
+    Image input = createTestImage(width, height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            input.at(x, y, 1) = std::round(128.0 + 60.0 * std::sin(x * 0.9) * std::cos(y * 0.2));
+
+    ImageCodec codec(50.0);
+    codec.setCoefficientOutput(true);
+    codec.process(input);
+
+    const Image ycrcb = bgrToYCrCb(input);
+    const ImageCodec::QuantizedCoefficients& q = codec.getQuantizedCoefficients();
+    const ImageCodec::QuantizedPlane* planes[3] = { &q.y, &q.cr, &q.cb };
+
+    for (int c = 0; c < 3; ++c) {
+        const ImageCodec::QuantizedPlane& plane = *planes[c];
+        ASSERT_EQ(plane.blocksX, 7);
+        ASSERT_EQ(plane.blocksY, 6);
+        ASSERT_EQ(plane.levels.size(), 7u * 6u * 64u);
+
+        Image channel(width, height, 1);
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                channel.at(x, y, 0) = ycrcb.at(x, y, c);
+
+        for (int by = 0; by < plane.blocksY; ++by) {
+            for (int bx = 0; bx < plane.blocksX; ++bx) {
+                const int16_t* levels = plane.block(bx, by);
+                const int eob = plane.endOfBlock(bx, by);
+                if (bx == 6 || by == 5) {
+                    // Boundary blocks are copied, not transformed.
+                    EXPECT_EQ(eob, 0);
+                    EXPECT_TRUE(std::all_of(levels, levels + 64, [](int16_t l) { return l == 0; }));
+                    continue;
+                }
+
+                const auto debug = codec.inspectBlock(channel, bx, by, c != 0);
+                for (int k = 0; k < 64; ++k) {
+                    const int i = ZIGZAG_ORDER[k] / 8, j = ZIGZAG_ORDER[k] % 8;
+                    ASSERT_EQ(levels[k], debug.quantized[i][j]) << "plane " << c << " block " << bx << "," << by;
+                }
+                if (eob > 0) {
+                    EXPECT_NE(levels[eob - 1], 0);
+                }
+                EXPECT_TRUE(std::all_of(levels + eob, levels + 64, [](int16_t l) { return l == 0; }));
+            }
+        }
+    }
+}
+
+TEST(ImageCodecTest, QuantizedCoefficientsAreConsistentAcrossPaths) {
+    const int width = 45, height = 53;
+    Image input = createTestImage(width, height);
+
+    const auto paths = runCodecPaths(input, 35.0, ImageCodec::ChromaSubsampling::CS_420,
+        ImageCodec::TransformType::DCT, [](ImageCodec& codec) {
+            codec.setCoefficientOutput(true);
+            codec.setAdaptiveQuantization(true);
+            codec.setRdoQuantization(true);
+        });
+    ImageCodec& frame = paths->frame;
+
+    const auto& expected = frame.getQuantizedCoefficients();
+    EXPECT_EQ(expected.y.blocksX, 6);
+    EXPECT_EQ(expected.cr.blocksX, 3); // 23 chroma columns
+    EXPECT_EQ(expected.cr.blocksY, 4); // 27 chroma rows
+    for (const ImageCodec* codec : {&paths->strip, &paths->cached}) {
+        const auto& q = codec->getQuantizedCoefficients();
+        EXPECT_EQ(q.y.levels, expected.y.levels);
+        EXPECT_EQ(q.y.eob, expected.y.eob);
+        EXPECT_EQ(q.cr.levels, expected.cr.levels);
+        EXPECT_EQ(q.cr.eob, expected.cr.eob);
+        EXPECT_EQ(q.cb.levels, expected.cb.levels);
+        EXPECT_EQ(q.cb.eob, expected.cb.eob);
+    }
+
+    // No levels without the block DCT, quantization or the option itself.
+    ImageCodec dwt(35.0, true, ImageCodec::ChromaSubsampling::CS_444, ImageCodec::TransformType::DWT);
+    dwt.setCoefficientOutput(true);
+    dwt.process(input);
+    EXPECT_TRUE(dwt.getQuantizedCoefficients().y.empty());
+
+    frame.setCoefficientOutput(false);
+    frame.process(input);
+    EXPECT_TRUE(frame.getQuantizedCoefficients().y.empty());
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include "LosslessCodec.h"
+#include "Image.h"
+#include <cmath>
+#include <stdexcept>
+
+enum class Content { Noise, Smooth, Graphics };
+
+static Image createLosslessTestImage(int width, int height, Content content, int channels = 3) {
+    Image img(width, height, channels);
+    uint32_t state = 12345;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            for (int c = 0; c < channels; ++c) {
+                double v = 0.0;
+                switch (content) {
+                case Content::Noise:
+                    state = state * 1664525u + 1013904223u;
+                    v = state >> 24;
+                    break;
+                case Content::Smooth:
+                    v = std::round(127.5 + 100.0 * std::sin(x * 0.07 + c) * std::cos(y * 0.05 - c)
+                                   + ((x * 7 + y * 13 + c) % 5));
+                    break;
+                case Content::Graphics:
+                    v = ((x / 16 + y / 16) % 2) ? 240.0 : 30.0 * (c + 1);
+                    if (x % 23 == 0) v = 0.0;
+                    break;
+                }
+                img.at(x, y, c) = v;
+            }
+    return img;
+}
+
+static void expectIdentical(const Image& a, const Image& b) {
+    ASSERT_EQ(a.width(), b.width());
+    ASSERT_EQ(a.height(), b.height());
+    ASSERT_EQ(a.channels(), b.channels());
+    for (size_t i = 0; i < a.size(); ++i)
+        ASSERT_EQ(a.data()[i], b.data()[i]) << "sample " << i;
+}
+
+TEST(LosslessCodecTest, RoundTripIsExact) {
+    const int sizes[][2] = {{1, 1}, {3, 5}, {1, 40}, {40, 1}, {17, 9}, {64, 48}, {131, 77}};
+    for (Content content : {Content::Noise, Content::Smooth, Content::Graphics}) {
+        for (const auto& size : sizes) {
+            SCOPED_TRACE(std::to_string(size[0]) + "x" + std::to_string(size[1]));
+            Image input = createLosslessTestImage(size[0], size[1], content);
+            expectIdentical(LosslessCodec::decode(LosslessCodec::encode(input)), input);
+        }
+    }
+}
+
+TEST(LosslessCodecTest, GrayscaleRoundTripIsExact) {
+    Image input = createLosslessTestImage(45, 31, Content::Smooth, 1);
+    expectIdentical(LosslessCodec::decode(LosslessCodec::encode(input)), input);
+}
+
+TEST(LosslessCodecTest, PicksTransformByContent) {
+    // Byte 14 of the header is the number of wavelet levels (0 = spatial).
+    auto smooth = LosslessCodec::encode(createLosslessTestImage(128, 128, Content::Smooth));
+    auto graphics = LosslessCodec::encode(createLosslessTestImage(128, 128, Content::Graphics));
+    EXPECT_EQ(smooth[14], LosslessCodec::MAX_LEVELS);
+    EXPECT_EQ(graphics[14], 0);
+
+    // Both compress well below the 24 bits per pixel of the input.
+    EXPECT_LT(smooth.size(), 128u * 128u * 3u / 2u);
+    EXPECT_LT(graphics.size(), 128u * 128u * 3u / 20u);
+}
+
+TEST(LosslessCodecTest, RejectsNonIntegerOrOutOfRangeSamples) {
+    Image input = createLosslessTestImage(8, 8, Content::Smooth);
+    input.at(3, 4, 1) = 10.5;
+    EXPECT_THROW(LosslessCodec::encode(input), std::invalid_argument);
+    input.at(3, 4, 1) = 256.0;
+    EXPECT_THROW(LosslessCodec::encode(input), std::invalid_argument);
+    input.at(3, 4, 1) = -1.0;
+    EXPECT_THROW(LosslessCodec::encode(input), std::invalid_argument);
+
+    EXPECT_THROW(LosslessCodec::encode(Image(4, 4, 2)), std::invalid_argument);
+    EXPECT_THROW(LosslessCodec::encode(Image(65537, 1, 1)), std::invalid_argument);
+}
+
+TEST(LosslessCodecTest, RejectsMalformedStreams) {
+    auto stream = LosslessCodec::encode(createLosslessTestImage(32, 32, Content::Noise));
+
+    auto truncated = stream;
+    truncated.resize(truncated.size() / 2);
+    EXPECT_THROW(LosslessCodec::decode(truncated), std::runtime_error);
+
+    auto badMagic = stream;
+    badMagic[0] = 'X';
+    EXPECT_THROW(LosslessCodec::decode(badMagic), std::runtime_error);
+
+    auto badLevels = stream;
+    badLevels[14] = 3;
+    EXPECT_THROW(LosslessCodec::decode(badLevels), std::runtime_error);
+
+    EXPECT_THROW(LosslessCodec::decode({}), std::runtime_error);
+}
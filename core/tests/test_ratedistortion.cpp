@@ -0,0 +1,225 @@
+#include <gtest/gtest.h>
+#include "RateDistortion.h"
+#include "CodecAnalysis.h"
+#include "ImageCodec.h"
+#include "Image.h"
+#include <stdexcept>
+
+static Image createRdTestImage(int width, int height) {
+    Image img(width, height, 3);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            img.at(x, y, 0) = (x * 7 + y * y) % 256;
+            img.at(x, y, 1) = (y * 3 + x / 3) % 256;
+            img.at(x, y, 2) = ((x + y) * 5) % 256;
+        }
+    return img;
+}
+
+TEST(RateDistortionTest, SweepMatchesIndividualEncodes) {
+    Image input = createRdTestImage(40, 27);
+    const ImageCodec::TransformType transforms[] = {
+        ImageCodec::TransformType::DCT, ImageCodec::TransformType::DWT
+    };
+
+    for (auto transform : transforms) {
+        auto cs = ImageCodec::ChromaSubsampling::CS_420;
+        std::vector<RdPoint> points = RateDistortion::sweep(input, cs, transform, 1, 100);
+        ASSERT_EQ(points.size(), 100u);
+
+        for (int quality : {1, 37, 75, 100}) {
+            const RdPoint& point = points[quality - 1];
+            ImageCodec codec(quality, true, cs, transform);
+            Image recon = codec.process(input);
+            CodecMetrics metrics = CodecAnalysis::computeMetrics(input, recon);
+
+            EXPECT_EQ(point.quality, quality);
+            EXPECT_DOUBLE_EQ(point.bits, codec.getLastBitEstimate());
+            EXPECT_DOUBLE_EQ(point.psnrY, metrics.psnrY);
+            EXPECT_DOUBLE_EQ(point.psnrCr, metrics.psnrCr);
+            EXPECT_DOUBLE_EQ(point.psnrCb, metrics.psnrCb);
+            EXPECT_DOUBLE_EQ(point.ssimY, metrics.ssimY);
+            EXPECT_DOUBLE_EQ(point.ssimCr, metrics.ssimCr);
+            EXPECT_DOUBLE_EQ(point.ssimCb, metrics.ssimCb);
+        }
+    }
+}
+
+TEST(RateDistortionTest, SweepUsesTheCacheSettings) {
+    // 12-bit samples, intra prediction and a non-default colour format must
+    // all carry over from the cache to the trial codecs and the metrics.
+    Image input = createRdTestImage(32, 24);
+    for (size_t i = 0; i < input.size(); ++i)
+        input.data()[i] *= 16.0;
+    const ColorFormat format{ColorMatrix::BT709, ColorRange::Limited};
+    auto configure = [&](ImageCodec& codec) {
+        codec.setBitDepth(12);
+        codec.setIntraPrediction(true);
+        codec.setColorFormat(format);
+    };
+
+    auto cs = ImageCodec::ChromaSubsampling::CS_420;
+    ImageCodec analyser(50.0, true, cs);
+    configure(analyser);
+    ImageCodec::CoefficientCache cache;
+    analyser.analyze(input, cache);
+
+    std::vector<RdPoint> points = RateDistortion::sweep(input, cache, 20, 80);
+    ASSERT_EQ(points.size(), 61u);
+    for (int quality : {20, 50, 80}) {
+        ImageCodec codec(quality, true, cs);
+        configure(codec);
+        Image recon = codec.process(input);
+        CodecMetrics metrics = CodecAnalysis::computeMetrics(input, recon, 12);
+
+        const RdPoint& point = points[quality - 20];
+        EXPECT_DOUBLE_EQ(point.bits, codec.getLastBitEstimate());
+        EXPECT_DOUBLE_EQ(point.psnrY, metrics.psnrY);
+        EXPECT_DOUBLE_EQ(point.ssimCb, metrics.ssimCb);
+    }
+
+    RdTarget target;
+    target.kind = RdTarget::Kind::MinPsnrY;
+    target.value = points[30].psnrY;
+    Image out;
+    RdTargetResult result = RateDistortion::encodeToTarget(input, cache, target, out);
+    EXPECT_TRUE(result.met);
+    EXPECT_GE(result.point.psnrY, target.value);
+}
+
+TEST(RateDistortionTest, SweepOfQualityListMatchesRange) {
+    Image input = createRdTestImage(40, 32);
+    ImageCodec::CoefficientCache cache;
+    ImageCodec(50.0, true, ImageCodec::ChromaSubsampling::CS_420).analyze(input, cache);
+
+    const std::vector<RdPoint> range = RateDistortion::sweep(input, cache, 1, 100);
+    const std::vector<int> qualities = {95, 5, 50, 100, 1};
+    const std::vector<RdPoint> points = RateDistortion::sweep(input, cache, qualities);
+    ASSERT_EQ(points.size(), qualities.size());
+    for (size_t i = 0; i < qualities.size(); ++i) {
+        const RdPoint& expected = range[qualities[i] - 1];
+        EXPECT_EQ(points[i].quality, qualities[i]);
+        EXPECT_DOUBLE_EQ(points[i].bits, expected.bits);
+        EXPECT_DOUBLE_EQ(points[i].psnrY, expected.psnrY);
+        EXPECT_DOUBLE_EQ(points[i].ssimCb, expected.ssimCb);
+    }
+
+    EXPECT_THROW(RateDistortion::sweep(input, cache, std::vector<int>{}), std::invalid_argument);
+    EXPECT_THROW(RateDistortion::sweep(input, cache, std::vector<int>{50, 101}), std::invalid_argument);
+}
+
+TEST(RateDistortionTest, HigherQualityCostsMoreBits) {
+    Image input = createRdTestImage(48, 48);
+    std::vector<RdPoint> points = RateDistortion::sweep(
+        input, ImageCodec::ChromaSubsampling::CS_444, ImageCodec::TransformType::DCT, 10, 90);
+    ASSERT_EQ(points.size(), 81u);
+    EXPECT_EQ(points.front().quality, 10);
+    EXPECT_EQ(points.back().quality, 90);
+    EXPECT_LT(points.front().bits, points.back().bits);
+    EXPECT_LT(points.front().psnrY, points.back().psnrY);
+}
+
+TEST(RateDistortionTest, RejectsInvalidArguments) {
+    Image input = createRdTestImage(16, 16);
+    auto cs = ImageCodec::ChromaSubsampling::CS_444;
+    auto dct = ImageCodec::TransformType::DCT;
+    EXPECT_THROW(RateDistortion::sweep(input, cs, dct, 0, 50), std::invalid_argument);
+    EXPECT_THROW(RateDistortion::sweep(input, cs, dct, 60, 50), std::invalid_argument);
+
+    ImageCodec::CoefficientCache empty;
+    EXPECT_THROW(RateDistortion::sweep(input, empty), std::invalid_argument);
+}
+
+TEST(ImageCodecSetQualityTest, MatchesConstructedCodec) {
+    Image input = createRdTestImage(24, 24);
+    ImageCodec reused(90.0);
+    reused.process(input);
+    reused.setQuality(20.0);
+    EXPECT_DOUBLE_EQ(reused.quality(), 20.0);
+
+    Image expected = ImageCodec(20.0).process(input);
+    Image actual = reused.process(input);
+    for (size_t i = 0; i < expected.size(); ++i)
+        ASSERT_EQ(actual.data()[i], expected.data()[i]);
+}
+
+TEST(ImageCodecEstimateBitsTest, MatchesReconstructEstimate) {
+    Image input = createRdTestImage(45, 29);
+    for (auto transform : {ImageCodec::TransformType::DCT, ImageCodec::TransformType::DWT}) {
+        for (auto cs : {ImageCodec::ChromaSubsampling::CS_444, ImageCodec::ChromaSubsampling::CS_422,
+                        ImageCodec::ChromaSubsampling::CS_420}) {
+            ImageCodec codec(35.0, true, cs, transform);
+            ImageCodec::CoefficientCache cache;
+            codec.analyze(input, cache);
+
+            Image out;
+            codec.reconstruct(cache, out);
+            EXPECT_EQ(codec.estimateBits(cache), codec.getLastBitEstimate());
+        }
+    }
+}
+
+TEST(RateDistortionTest, BitBudgetPicksHighestQualityWithinBudget) {
+    Image input = createRdTestImage(64, 48);
+    auto cs = ImageCodec::ChromaSubsampling::CS_420;
+    auto dct = ImageCodec::TransformType::DCT;
+    std::vector<RdPoint> curve = RateDistortion::sweep(input, cs, dct);
+
+    const double budget = curve[59].bits; // Exactly the rate of quality 60
+    Image out;
+    RdTargetResult result = RateDistortion::encodeToTarget(
+        input, cs, dct, {RdTarget::Kind::MaxBits, budget}, out);
+
+    EXPECT_TRUE(result.met);
+    EXPECT_LE(result.iterations, 7);
+    EXPECT_LE(result.point.bits, budget);
+    EXPECT_GE(result.point.quality, 60);
+    if (result.point.quality < 100) {
+        EXPECT_GT(curve[result.point.quality].bits, budget);
+    }
+
+    // The final encode is a regular encode at the chosen quality.
+    ImageCodec codec(result.point.quality, true, cs, dct);
+    Image expected = codec.process(input);
+    for (size_t i = 0; i < expected.size(); ++i)
+        ASSERT_EQ(out.data()[i], expected.data()[i]);
+}
+
+TEST(RateDistortionTest, QualityFloorPicksLowestQualityMeetingIt) {
+    Image input = createRdTestImage(64, 48);
+    auto cs = ImageCodec::ChromaSubsampling::CS_444;
+    auto dct = ImageCodec::TransformType::DCT;
+    std::vector<RdPoint> curve = RateDistortion::sweep(input, cs, dct);
+
+    Image out;
+    RdTargetResult psnr = RateDistortion::encodeToTarget(
+        input, cs, dct, {RdTarget::Kind::MinPsnrY, curve[49].psnrY}, out);
+    EXPECT_TRUE(psnr.met);
+    EXPECT_LE(psnr.iterations, 7);
+    EXPECT_GE(psnr.point.psnrY, curve[49].psnrY);
+    EXPECT_LE(psnr.point.quality, 50);
+    if (psnr.point.quality > 1) {
+        EXPECT_LT(curve[psnr.point.quality - 2].psnrY, curve[49].psnrY);
+    }
+
+    RdTargetResult ssim = RateDistortion::encodeToTarget(
+        input, cs, dct, {RdTarget::Kind::MinSsimY, curve[79].ssimY}, out);
+    EXPECT_TRUE(ssim.met);
+    EXPECT_GE(ssim.point.ssimY, curve[79].ssimY);
+    EXPECT_LE(ssim.point.quality, 80);
+}
+
+TEST(RateDistortionTest, UnreachableTargetsFallBackToExtremes) {
+    Image input = createRdTestImage(32, 32);
+    auto cs = ImageCodec::ChromaSubsampling::CS_444;
+    auto dct = ImageCodec::TransformType::DCT;
+    Image out;
+
+    RdTargetResult tiny = RateDistortion::encodeToTarget(input, cs, dct, {RdTarget::Kind::MaxBits, 1.0}, out);
+    EXPECT_FALSE(tiny.met);
+    EXPECT_EQ(tiny.point.quality, 1);
+
+    RdTargetResult perfect = RateDistortion::encodeToTarget(input, cs, dct, {RdTarget::Kind::MinSsimY, 1.5}, out);
+    EXPECT_FALSE(perfect.met);
+    EXPECT_EQ(perfect.point.quality, 100);
+}
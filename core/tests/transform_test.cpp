@@ -56,3 +56,24 @@ TEST(TransformTest, RoundTrip) {
         }
     }
 }
+
+TEST(TransformTest, DcOnlyTransformsMatchFullTransforms) {
+    double src[8][8];
+    for(int i=0; i<8; ++i)
+        for(int j=0; j<8; ++j)
+            src[i][j] = -37.25 + 0.125 * ((i * 5 + j * 3) % 7);
+
+    double freq[8][8];
+    dct8x8(src, freq);
+    EXPECT_EQ(dctDc8x8(src), freq[0][0]);
+
+    double dcOnly[8][8] = {};
+    dcOnly[0][0] = freq[0][0];
+    double full[8][8];
+    double fast[8][8];
+    idct8x8(dcOnly, full);
+    idctDc8x8(freq[0][0], fast);
+    for(int i=0; i<8; ++i)
+        for(int j=0; j<8; ++j)
+            EXPECT_EQ(fast[i][j], full[i][j]) << "Mismatch at " << i << "," << j;
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "wavelet.h"
 #include <cmath>
+#include <vector>
 
 // For a constant block of value A, the 3-level 2D Haar DWT concentrates all
 // energy into dst[0][0] = 8*A, with all other coefficients zero.
@@ -141,3 +142,35 @@ TEST(WaveletTest, ImageRoundTrip) {
         EXPECT_NEAR(data[i], src[i], 1e-9);
     }
 }
+
+// The integer 5/3 lifting must be exactly invertible for any size,
+// including odd and single-sample dimensions.
+TEST(WaveletTest, Integer53RoundTripIsExact) {
+    const int sizes[][2] = {{1, 1}, {1, 7}, {6, 1}, {3, 5}, {8, 8}, {33, 17}, {64, 64}};
+    for (const auto& size : sizes) {
+        const int w = size[0], h = size[1];
+        std::vector<int32_t> data(static_cast<size_t>(w) * h);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = static_cast<int32_t>((i * 2654435761u) % 511) - 255;
+        const std::vector<int32_t> original = data;
+
+        dwt53Image(data.data(), w, h, 5);
+        idwt53Image(data.data(), w, h, 5);
+        EXPECT_EQ(data, original) << w << "x" << h;
+    }
+}
+
+// A linear ramp is predicted exactly by the 5/3 filter, so away from the
+// right edge every first-level horizontal detail coefficient is zero.
+TEST(WaveletTest, Integer53RampHasNoDetail) {
+    const int w = 16, h = 4;
+    std::vector<int32_t> data(w * h);
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x)
+            data[y * w + x] = 3 * x;
+
+    dwt53Image(data.data(), w, h, 1);
+    for (int y = 0; y < h; ++y)
+        for (int x = w / 2; x < w - 1; ++x)
+            EXPECT_EQ(data[y * w + x], 0) << "at " << x << "," << y;
+}
@@ -1,7 +1,9 @@
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
 #include <cmath>
+#include <memory>
 #include <emscripten.h>
 #include "ImageCodec.h"
 #include "CodecAnalysis.h"
@@ -10,14 +12,21 @@
 #include "transform.h"
 #include "wavelet.h"
 #include "MotionEstimator.h"
+#include "RateDistortion.h"
 
 // A global session to hold the state between calls from JavaScript.
 struct CodecSession {
     Image originalImage;
     Image originalYCrCb;
-    Image processedYCrCb;
+    Image processedBgr;
+    Image processedYCrCb; // Valid only while processedYCrCbReady is set
+    bool processedYCrCbReady = false;
+    Image viewImage;
     Image inspectionChannel;
     Image inspectionDS;
+    ImageCodec::CoefficientCache coeffCache; // Forward transform of originalImage
+    std::unique_ptr<ImageCodec> codec; // Codec that built coeffCache, reused across calls
+    Image regionMap; // Per-region modes of the last adaptive-transform encode
     double lastBitEstimate = 0.0;
     CodecMetrics metrics;
     bool initialized = false;
@@ -26,6 +35,9 @@ struct CodecSession {
 
 static CodecSession g_session;
 static double g_artifact_gain = 5.0;
+// Metrics process_image() computes. The artifact map is left out because
+// get_view_ptr() builds it on demand with the user's gain.
+static unsigned g_metrics_mask = MetricsOptions::PSNR | MetricsOptions::SSIM | MetricsOptions::MSSSIM_Y;
 
 // Motion estimation global state
 static MotionEstimator g_me;
@@ -40,7 +52,8 @@ enum ViewMode {
     Cr = 3,
     Cb = 4,
     EdgeDistortion = 5,
-    BlockingMap = 6
+    BlockingMap = 6,
+    TransformRegions = 7
 };
 
 static ImageCodec::ChromaSubsampling map_cs_mode(int mode) {
@@ -53,7 +66,23 @@ static ImageCodec::ChromaSubsampling map_cs_mode(int mode) {
 }
 
 static ImageCodec::TransformType map_transform_mode(int mode) {
-    return (mode == 1) ? ImageCodec::TransformType::DWT : ImageCodec::TransformType::DCT;
+    switch (mode) {
+        case 1:  return ImageCodec::TransformType::DWT;
+        case 2:  return ImageCodec::TransformType::Adaptive;
+        case 0:
+        default: return ImageCodec::TransformType::DCT;
+    }
+}
+
+// YCrCb form of the last reconstruction. Only the channel and region views
+// read it, so it is converted on first use rather than in process_image(),
+// and slider redraws of the other views skip the conversion.
+static const Image& processed_ycrcb() {
+    if (!g_session.processedYCrCbReady) {
+        bgrToYCrCb(g_session.processedBgr, g_session.processedYCrCb);
+        g_session.processedYCrCbReady = true;
+    }
+    return g_session.processedYCrCb;
 }
 
 extern "C" {
@@ -62,17 +91,14 @@ EMSCRIPTEN_KEEPALIVE
 void init_session(uint8_t* rgba_input, int width, int height) {
     if (!rgba_input || width <= 0 || height <= 0) return;
 
-    g_session.originalImage = Image(width, height, 3);
-    double* imgData = g_session.originalImage.data();
-    const size_t numPixels = static_cast<size_t>(width) * height;
-
-    // Convert RGBA from canvas to BGR for the codec
-    for (size_t i = 0; i < numPixels; ++i) {
-        imgData[i * 3 + 0] = static_cast<double>(rgba_input[i * 4 + 2]); // B
-        imgData[i * 3 + 1] = static_cast<double>(rgba_input[i * 4 + 1]); // G
-        imgData[i * 3 + 2] = static_cast<double>(rgba_input[i * 4 + 0]); // R
-    }
-    g_session.originalYCrCb = bgrToYCrCb(g_session.originalImage);
+    // The metrics and analysis views still work on the BGR doubles, so the
+    // original is kept in that form alongside the codec's cache.
+    g_session.originalImage.resize(width, height, 3);
+    unpackPixels(rgba_input, PixelLayout::RGBA8, static_cast<size_t>(width) * height,
+                 g_session.originalImage.data());
+    bgrToYCrCb(g_session.originalImage, g_session.originalYCrCb);
+    g_session.coeffCache.clear();
+    g_session.processedYCrCbReady = false;
     g_session.initialized = true;
 }
 
@@ -82,11 +108,33 @@ void process_image(int quality, int cs_mode, int transform_mode) {
 
     auto cs = map_cs_mode(cs_mode);
     auto transform = map_transform_mode(transform_mode);
-    ImageCodec codec(quality, true, cs, transform);
-    Image processedBgr = codec.process(g_session.originalImage);
+
+    // Dragging the quality slider only changes the quantisation tables, so
+    // the forward transform is redone only when the image, subsampling or
+    // transform changed since the last call. The codec is kept with the
+    // cache, so a slider step also reuses its frame arena instead of
+    // allocating every plane afresh. rd_sweep() may have rebuilt the cache
+    // for another configuration, so the codec is only reused while it can
+    // still reconstruct it.
+    const ImageCodec::CoefficientCache& cache = g_session.coeffCache;
+    if (!g_session.codec || cache.empty() ||
+        cache.chromaSubsampling != cs || cache.transformType != transform ||
+        !g_session.codec->canReconstruct(cache)) {
+        g_session.codec = std::make_unique<ImageCodec>(quality, true, cs, transform);
+        if (!g_session.codec->canReconstruct(cache))
+            g_session.codec->analyze(g_session.originalImage, g_session.coeffCache);
+    } else {
+        g_session.codec->setQuality(quality);
+    }
+    ImageCodec& codec = *g_session.codec;
+    codec.reconstruct(g_session.coeffCache, g_session.processedBgr);
     g_session.lastBitEstimate = codec.getLastBitEstimate();
-    g_session.metrics = CodecAnalysis::computeMetrics(g_session.originalImage, processedBgr);
-    g_session.processedYCrCb = bgrToYCrCb(processedBgr);
+    g_session.regionMap = codec.getRegionMap();
+    MetricsOptions options;
+    options.metrics = g_metrics_mask;
+    CodecAnalysis::computeMetrics(g_session.originalImage, g_session.processedBgr, g_session.metrics,
+                                  8, options);
+    g_session.processedYCrCbReady = false;
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -101,80 +149,103 @@ uint8_t* get_view_ptr(int mode) {
     uint8_t* rgba_output = (uint8_t*)malloc(totalRgbaValues);
     if (!rgba_output) return nullptr;
 
-    Image viewImage;
+    Image& viewImage = g_session.viewImage;
 
     switch (static_cast<ViewMode>(mode)) {
         case RGB:
-            viewImage = ycrcbToBgr(g_session.processedYCrCb);
-            break;
+            // The reconstruction is already BGR; pack it without a copy.
+            packPixels(g_session.processedBgr.data(), numPixels, rgba_output, PixelLayout::RGBA8);
+            return rgba_output;
         case Artifacts:
-            viewImage = CodecAnalysis::computeArtifactMap(
+            CodecAnalysis::computeArtifactMap(
                 g_session.originalImage,
-                ycrcbToBgr(g_session.processedYCrCb),
+                g_session.processedBgr,
+                viewImage,
                 g_artifact_gain
             );
             break;
         case EdgeDistortion:
-            viewImage = CodecAnalysis::computeEdgeDistortionMap(g_session.originalImage, ycrcbToBgr(g_session.processedYCrCb));
+            CodecAnalysis::computeEdgeDistortionMap(g_session.originalImage, g_session.processedBgr, viewImage);
             break;
         case BlockingMap:
-            viewImage = CodecAnalysis::computeBlockingMap(ycrcbToBgr(g_session.processedYCrCb));
+            CodecAnalysis::computeBlockingMap(g_session.processedBgr, viewImage);
+            break;
+        case TransformRegions: {
+            // Reconstruction luma tinted by each region's mode: DCT blue,
+            // DWT amber, skip green. Non-adaptive encodes show plain luma.
+            static const double TINTS[3][3] = {
+                { 1.0, 0.55, 0.25 },  // DCT  (B, G, R)
+                { 0.15, 0.65, 1.0 },  // DWT
+                { 0.35, 1.0, 0.35 },  // Skip
+            };
+            const Image& regions = g_session.regionMap;
+            const double* ycrcbData = processed_ycrcb().data();
+            viewImage.resize(width, height, 3);
+            double* bgrData = viewImage.data();
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    const size_t i = static_cast<size_t>(y) * width + x;
+                    const double v = ycrcbData[i * 3];
+                    if (regions.size() == 0) {
+                        bgrData[i * 3 + 0] = bgrData[i * 3 + 1] = bgrData[i * 3 + 2] = v;
+                        continue;
+                    }
+                    const int rx = x / ImageCodec::REGION_SIZE;
+                    const int ry = y / ImageCodec::REGION_SIZE;
+                    const double* tint = TINTS[static_cast<int>(regions.at(rx, ry, 0))];
+                    const bool edge = (x % ImageCodec::REGION_SIZE == 0) || (y % ImageCodec::REGION_SIZE == 0);
+                    for (int c = 0; c < 3; ++c)
+                        bgrData[i * 3 + c] = edge ? 255.0 * tint[c] : (64.0 + 0.75 * v) * tint[c];
+                }
+            }
             break;
+        }
         case Y:
         case Cr:
         case Cb: {
-            Image channel(width, height, 1);
-            const double* ycrcbData = g_session.processedYCrCb.data();
-            double* channelData = channel.data();
+            const double* ycrcbData = processed_ycrcb().data();
             int offset = (mode == Y) ? 0 : (mode == Cr ? 1 : 2);
 
+            // Convert the grayscale channel to 3-channel BGR for display
+            viewImage.resize(width, height, 3);
+            double* bgrData = viewImage.data();
             for (size_t i = 0; i < numPixels; ++i) {
-                channelData[i] = ycrcbData[i * 3 + offset];
-            }
-
-            // Convert grayscale channel to 3-channel BGR for display
-            Image bgrChannel(width, height, 3);
-            double* bgrData = bgrChannel.data();
-            for (size_t i = 0; i < numPixels; ++i) {
+                const double v = ycrcbData[i * 3 + offset];
                 if (mode == Y) {
-                    bgrData[i * 3 + 0] = channelData[i]; // B
-                    bgrData[i * 3 + 1] = channelData[i]; // G
-                    bgrData[i * 3 + 2] = channelData[i]; // R
+                    bgrData[i * 3 + 0] = v; // B
+                    bgrData[i * 3 + 1] = v; // G
+                    bgrData[i * 3 + 2] = v; // R
                 } else if (mode == Cr && g_session.useTint) {
-                    bgrData[i * 3 + 0] = 128.0;          // B
-                    bgrData[i * 3 + 1] = 128.0;          // G
-                    bgrData[i * 3 + 2] = channelData[i]; // R (Tinted Red)
+                    bgrData[i * 3 + 0] = 128.0; // B
+                    bgrData[i * 3 + 1] = 128.0; // G
+                    bgrData[i * 3 + 2] = v;     // R (Tinted Red)
                 } else if (mode == Cb && g_session.useTint) {
-                    bgrData[i * 3 + 0] = channelData[i]; // B (Tinted Blue)
-                    bgrData[i * 3 + 1] = 128.0;          // G
-                    bgrData[i * 3 + 2] = 128.0;          // R
+                    bgrData[i * 3 + 0] = v;     // B (Tinted Blue)
+                    bgrData[i * 3 + 1] = 128.0; // G
+                    bgrData[i * 3 + 2] = 128.0; // R
                 } else {
                     // Grayscale for Cr/Cb if tint is disabled
-                    bgrData[i * 3 + 0] = channelData[i];
-                    bgrData[i * 3 + 1] = channelData[i];
-                    bgrData[i * 3 + 2] = channelData[i];
+                    bgrData[i * 3 + 0] = v;
+                    bgrData[i * 3 + 1] = v;
+                    bgrData[i * 3 + 2] = v;
                 }
             }
-            viewImage = bgrChannel;
             break;
         }
     }
 
-    const double* viewData = viewImage.data();
-    const int viewCh = viewImage.channels();
     // Convert viewImage to 4-channel RGBA for the canvas.
     // EdgeDistortion and BlockingMap return 1-channel images; handle both cases.
+    if (viewImage.channels() == 3) {
+        packPixels(viewImage.data(), numPixels, rgba_output, PixelLayout::RGBA8);
+        return rgba_output;
+    }
+    const double* viewData = viewImage.data();
     for (size_t i = 0; i < numPixels; ++i) {
-        if (viewCh == 1) {
-            uint8_t v = static_cast<uint8_t>(std::max(0.0, std::min(viewData[i], 255.0)));
-            rgba_output[i * 4 + 0] = v; // R
-            rgba_output[i * 4 + 1] = v; // G
-            rgba_output[i * 4 + 2] = v; // B
-        } else {
-            rgba_output[i * 4 + 0] = static_cast<uint8_t>(std::max(0.0, std::min(viewData[i * 3 + 2], 255.0))); // R
-            rgba_output[i * 4 + 1] = static_cast<uint8_t>(std::max(0.0, std::min(viewData[i * 3 + 1], 255.0))); // G
-            rgba_output[i * 4 + 2] = static_cast<uint8_t>(std::max(0.0, std::min(viewData[i * 3 + 0], 255.0))); // B
-        }
+        uint8_t v = static_cast<uint8_t>(std::max(0.0, std::min(viewData[i], 255.0)));
+        rgba_output[i * 4 + 0] = v; // R
+        rgba_output[i * 4 + 1] = v; // G
+        rgba_output[i * 4 + 2] = v; // B
         rgba_output[i * 4 + 3] = 255; // Alpha
     }
     return rgba_output;
@@ -190,6 +261,20 @@ void set_artifact_gain(double gain) {
     if (gain > 0.0) g_artifact_gain = gain;
 }
 
+// Selects the metrics later process_image() calls compute, as a mask of
+// MetricsOptions flags (PSNR_Y = 1 alone while a slider is dragged).
+// Metrics left out read back as 0.
+EMSCRIPTEN_KEEPALIVE
+void set_metrics_mask(unsigned mask) {
+    g_metrics_mask = mask & ~static_cast<unsigned>(MetricsOptions::ARTIFACT_MAP);
+}
+
+// The current mask, so callers can restore it after a temporary change.
+EMSCRIPTEN_KEEPALIVE
+unsigned get_metrics_mask() {
+    return g_metrics_mask;
+}
+
 EMSCRIPTEN_KEEPALIVE
 double get_psnr_y() {
     return g_session.initialized ? g_session.metrics.psnrY : 0.0;
@@ -220,11 +305,59 @@ double get_ssim_cb() {
     return g_session.initialized ? g_session.metrics.ssimCb : 0.0;
 }
 
+// Luma MS-SSIM of the last process_image call; 0 for images smaller than
+// 176x176, where the coarsest scale cannot fit the SSIM window.
+EMSCRIPTEN_KEEPALIVE
+double get_msssim_y() {
+    return g_session.initialized ? g_session.metrics.msssimY : 0.0;
+}
+
 EMSCRIPTEN_KEEPALIVE
 double get_last_bit_estimate() {
     return g_session.initialized ? g_session.lastBitEstimate : 0.0;
 }
 
+// Evaluates the `count` qualities in `qualities` (each in [1, 100]) and
+// returns a malloc'd array of one row of 8 doubles per quality, in order:
+// [quality, bits, psnrY, psnrCr, psnrCb, ssimY, ssimCr, ssimCb].
+// The forward transform is shared with process_image through the session's
+// coefficient cache. Caller must free the returned pointer.
+EMSCRIPTEN_KEEPALIVE
+double* rd_sweep(int cs_mode, int transform_mode, const int* qualities, int count) {
+    if (!g_session.initialized || !qualities || count <= 0) return nullptr;
+    const std::vector<int> qualityList(qualities, qualities + count);
+    for (int quality : qualityList)
+        if (quality < 1 || quality > 100) return nullptr;
+
+    ImageCodec codec(50.0, true, map_cs_mode(cs_mode), map_transform_mode(transform_mode));
+    if (!codec.canReconstruct(g_session.coeffCache)) {
+        // The session codec belongs to the cache being replaced.
+        g_session.codec.reset();
+        codec.analyze(g_session.originalImage, g_session.coeffCache);
+    }
+
+    const std::vector<RdPoint> points =
+        RateDistortion::sweep(g_session.originalImage, g_session.coeffCache, qualityList);
+
+    const int fields = 8;
+    double* out = (double*)malloc(points.size() * fields * sizeof(double));
+    if (!out) return nullptr;
+
+    for (size_t i = 0; i < points.size(); ++i) {
+        const RdPoint& p = points[i];
+        double* row = out + i * fields;
+        row[0] = p.quality;
+        row[1] = p.bits;
+        row[2] = p.psnrY;
+        row[3] = p.psnrCr;
+        row[4] = p.psnrCb;
+        row[5] = p.ssimY;
+        row[6] = p.ssimCr;
+        row[7] = p.ssimCb;
+    }
+    return out;
+}
+
 // Returns a malloc'd array of 2*num_bins doubles: [dct_bins | dwt_bins].
 // Each series is normalized by the total AC coefficient count.
 // Scans all 8×8 blocks of the Y channel, applies both DCT and DWT per block,
@@ -256,7 +389,7 @@ double* get_coeff_histogram(int num_bins, double max_val) {
             // Extract 8×8 Y block with level shift matching processChannel
             for (int row = 0; row < 8; row++) {
                 for (int col = 0; col < 8; col++) {
-                    src[row][col] = ycrcbData[((by * 8 + row) * w + (bx * 8 + col)) * 3] - 128.0;
+                    src[row][col] = ycrcbData[(static_cast<size_t>(by * 8 + row) * w + (bx * 8 + col)) * 3] - 128.0;
                 }
             }
 
@@ -287,9 +420,7 @@ double* get_coeff_histogram(int num_bins, double max_val) {
     return out;
 }
 
-// Re-declaring to match the plan's arguments
-// Helper to downsample a channel (simple averaging)
-// Helper to downsample a channel (simple averaging)
+// Helper to downsample a channel (simple averaging) into a reused buffer
 void downsample_channel(const Image& src, Image& dst, ImageCodec::ChromaSubsampling cs) {
     if (cs == ImageCodec::ChromaSubsampling::CS_444) {
         // Just copy src to dst if 4:4:4 (shouldn't really happen with logic below, but safe fallback)
@@ -305,21 +436,9 @@ void downsample_channel(const Image& src, Image& dst, ImageCodec::ChromaSubsampl
     int newW = (w + scaleX - 1) / scaleX;
     int newH = (h + scaleY - 1) / scaleY;
 
-    // Resize dst only if dimensions differ
-    if (dst.width() != newW || dst.height() != newH || dst.channels() != 1) {
-        dst = Image(newW, newH, 1);
-    }
-    
-    // We can't easily reuse the internal vector without a resize method in Image that preserves capacity,
-    // but assignment operator with new Image(w,h) will reallocate.
-    // However, since we defined 'dst' in g_session, we want to avoid reallocation if possible.
-    // The Image class in Image.h doesn't have a 'resize' method that keeps capacity.
-    // Let's assume for now assignment is better than creating a LOCAL Image that dies immediately.
-    // Ideally Image class should have a 'resize' or 'reshape'.
-    // Use the naive assignment for now, it is still better than stack trashing if the compiler optimizes.
-    // user: "Image class uses vector, so we could add a resize method?"
-    // For now, let's just stick to the plan. Even member assignment avoids stack variable destroy/create overhead.
-    
+    // resize() keeps the session buffer's capacity across calls
+    dst.resize(newW, newH, 1);
+
     for (int y = 0; y < newH; ++y) {
         for (int x = 0; x < newW; ++x) {
             double sum = 0.0;
@@ -347,9 +466,7 @@ double* inspect_block_data(int blockX, int blockY, int channelIndex, int quality
     
     // Reuse session buffer
     Image& channel = g_session.inspectionChannel;
-    if (channel.width() != ycrcb.width() || channel.height() != ycrcb.height() || channel.channels() != 1) {
-        channel = Image(ycrcb.width(), ycrcb.height(), 1);
-    }
+    channel.resize(ycrcb.width(), ycrcb.height(), 1);
 
     const double* src = ycrcb.data();
     double* dst = channel.data();
@@ -5,7 +5,8 @@ export const ViewMode = {
     Cr: 3,
     Cb: 4,
     EdgeDistortion: 5,
-    BlockingMap: 6
+    BlockingMap: 6,
+    TransformRegions: 7
 } as const;
 
 export type ViewModeValue = typeof ViewMode[keyof typeof ViewMode];
@@ -51,6 +52,7 @@ class AppState {
     // Render stats
     psnr = $state({ y: 0, cr: 0, cb: 0 });
     ssim = $state({ y: 0, cr: 0, cb: 0 });
+    msssim = $state(0); // Luma MS-SSIM; 0 when the image is too small
 
     // Tint toggle
     tintEnabled = $state(true);
@@ -22,6 +22,19 @@ export function initSession(): void {
     }
 }
 
+// Metric mask for setMetricsMask(); the bit mirrors MetricsOptions in
+// core/inc/CodecAnalysis.h. The session's default mask lives in the C++
+// glue; read it with getMetricsMask() to restore it after a change.
+export const METRICS_PSNR_Y = 1;
+
+export function setMetricsMask(mask: number): void {
+    Module._set_metrics_mask(mask);
+}
+
+export function getMetricsMask(): number {
+    return Module._get_metrics_mask();
+}
+
 export function processImage(quality: number, csMode: number, transformType?: number): void {
     const t = transformType !== undefined ? transformType : appState.transformType;
     Module._process_image(quality, csMode, t);
@@ -42,7 +55,8 @@ export function getStats() {
             y: Module._get_ssim_y(),
             cr: Module._get_ssim_cr(),
             cb: Module._get_ssim_cb()
-        }
+        },
+        msssim: Module._get_msssim_y()
     };
 }
 
@@ -83,6 +97,50 @@ export function getCoeffHistogram(numBins: number, maxVal: number): { dct: numbe
     }
 }
 
+export interface RdPoint {
+    quality: number;
+    bits: number;
+    psnr: { y: number; cr: number; cb: number };
+    ssim: { y: number; cr: number; cb: number };
+}
+
+// Evaluates the given qualities (each in [1, 100]) for the loaded image in
+// one call, sharing a single forward transform, and returns the points in
+// the same order. Returns null if WASM is not ready, no image is loaded or
+// a quality is invalid.
+export function rdSweep(csMode: number, qualities: readonly number[], transformType?: number): RdPoint[] | null {
+    const t = transformType !== undefined ? transformType : appState.transformType;
+    if (qualities.length === 0) return null;
+
+    let ptr = 0;
+    const listPtr = Module._malloc(qualities.length * 4);
+    if (!listPtr) return null;
+    try {
+        new Int32Array(Module.HEAPU8.buffer, listPtr, qualities.length).set(qualities);
+        ptr = Module._rd_sweep(csMode, t, listPtr, qualities.length);
+    } finally {
+        Module._free(listPtr);
+    }
+    if (!ptr) return null;
+
+    try {
+        const view = new DataView(Module.HEAPU8.buffer);
+        const read = (row: number, field: number) => view.getFloat64(ptr + (row * 8 + field) * 8, true);
+        const points: RdPoint[] = [];
+        for (let row = 0; row < qualities.length; row++) {
+            points.push({
+                quality: read(row, 0),
+                bits: read(row, 1),
+                psnr: { y: read(row, 2), cr: read(row, 3), cb: read(row, 4) },
+                ssim: { y: read(row, 5), cr: read(row, 6), cb: read(row, 7) }
+            });
+        }
+        return points;
+    } finally {
+        Module._free(ptr);
+    }
+}
+
 export function getHeapU8(): Uint8Array {
     return Module.HEAPU8;
 }
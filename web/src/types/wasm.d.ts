@@ -14,6 +14,8 @@ export interface WasmModule {
     _get_view_ptr(viewMode: number): number;
     _set_view_tint(enabled: number): void;
     _set_artifact_gain(gain: number): void;
+    _set_metrics_mask(mask: number): void;
+    _get_metrics_mask(): number;
     _inspect_block_data(blockX: number, blockY: number, channelIndex: number, quality: number, csMode: number, transformMode: number): number;
     _get_coeff_histogram(numBins: number, maxVal: number): number;
     _get_psnr_y(): number;
@@ -22,7 +24,9 @@ export interface WasmModule {
     _get_ssim_y(): number;
     _get_ssim_cr(): number;
     _get_ssim_cb(): number;
+    _get_msssim_y(): number;
     _get_last_bit_estimate(): number;
+    _rd_sweep(csMode: number, transformMode: number, qualitiesPtr: number, count: number): number;
 }
 
 export { };
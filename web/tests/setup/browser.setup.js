@@ -18,11 +18,14 @@ globalThis.Module = {
     _process_image: () => {},
     _get_view_ptr: () => 256,
     _set_view_tint: () => {},
+    _set_metrics_mask: () => {},
+    _get_metrics_mask: () => 0x7f,
     _get_psnr_y: () => 35.5,
     _get_psnr_cr: () => 38.2,
     _get_psnr_cb: () => 37.8,
     _get_ssim_y: () => 0.9421,
     _get_ssim_cr: () => 0.9612,
     _get_ssim_cb: () => 0.9588,
+    _get_msssim_y: () => 0.9734,
     _inspect_block_data: () => 256,
 };
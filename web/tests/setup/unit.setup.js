@@ -56,13 +56,17 @@ globalThis.Module = {
     _process_image: vi.fn(),
     _get_view_ptr: vi.fn(() => 256),
     _set_view_tint: vi.fn(),
+    _set_metrics_mask: vi.fn(),
+    _get_metrics_mask: vi.fn(() => 0x7f),
     _get_psnr_y: vi.fn(() => 35.5),
     _get_psnr_cr: vi.fn(() => 38.2),
     _get_psnr_cb: vi.fn(() => 37.8),
     _get_ssim_y: vi.fn(() => 0.9421),
     _get_ssim_cr: vi.fn(() => 0.9612),
     _get_ssim_cb: vi.fn(() => 0.9588),
+    _get_msssim_y: vi.fn(() => 0.9734),
     _inspect_block_data: vi.fn(() => 256),
+    _rd_sweep: vi.fn(() => 256),
 };
 
 // Reset mock call counts and heap between tests.
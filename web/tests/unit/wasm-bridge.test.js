@@ -7,7 +7,11 @@ import {
     getViewPtr,
     getStats,
     setViewTint,
+    setMetricsMask,
+    getMetricsMask,
+    METRICS_PSNR_Y,
     inspectBlockData,
+    rdSweep,
     getHeapU8,
     free,
 } from '../../src/lib/wasm-bridge.js';
@@ -125,6 +129,20 @@ describe('getViewPtr', () => {
     });
 });
 
+describe('setMetricsMask', () => {
+    it('forwards the mask to Module._set_metrics_mask', () => {
+        setMetricsMask(METRICS_PSNR_Y);
+        expect(globalThis.Module._set_metrics_mask).toHaveBeenCalledWith(1);
+    });
+});
+
+describe('getMetricsMask', () => {
+    it('returns the mask from Module._get_metrics_mask', () => {
+        globalThis.Module._get_metrics_mask.mockReturnValueOnce(9);
+        expect(getMetricsMask()).toBe(9);
+    });
+});
+
 describe('getStats', () => {
     it('returns an object with psnr and ssim keys', () => {
         const stats = getStats();
@@ -154,6 +172,7 @@ describe('getStats', () => {
         expect(stats.ssim.y).toBe(0.9421);
         expect(stats.ssim.cr).toBe(0.9612);
         expect(stats.ssim.cb).toBe(0.9588);
+        expect(stats.msssim).toBe(0.9734);
     });
 });
 
@@ -188,6 +207,36 @@ describe('inspectBlockData', () => {
     });
 });
 
+describe('rdSweep', () => {
+    it('decodes one row of 8 doubles per quality and frees the buffer', () => {
+        const view = new DataView(globalThis.Module.HEAPU8.buffer);
+        const rows = [
+            [10, 1200, 30.5, 38.1, 37.9, 0.81, 0.92, 0.91],
+            [11, 1300, 31.0, 38.4, 38.2, 0.83, 0.93, 0.92],
+        ];
+        rows.forEach((row, r) => row.forEach((v, f) => view.setFloat64(256 + (r * 8 + f) * 8, v, true)));
+        globalThis.Module._malloc.mockReturnValueOnce(1024); // The quality list
+
+        const points = rdSweep(420, [10, 11]);
+
+        expect(globalThis.Module._rd_sweep).toHaveBeenCalledWith(420, 0, 1024, 2);
+        expect(Array.from(new Int32Array(globalThis.Module.HEAPU8.buffer, 1024, 2))).toEqual([10, 11]);
+        expect(points).toEqual([
+            { quality: 10, bits: 1200, psnr: { y: 30.5, cr: 38.1, cb: 37.9 }, ssim: { y: 0.81, cr: 0.92, cb: 0.91 } },
+            { quality: 11, bits: 1300, psnr: { y: 31.0, cr: 38.4, cb: 38.2 }, ssim: { y: 0.83, cr: 0.93, cb: 0.92 } },
+        ]);
+        expect(globalThis.Module._free).toHaveBeenCalledWith(1024);
+        expect(globalThis.Module._free).toHaveBeenCalledWith(256);
+    });
+
+    it('returns null when the sweep is unavailable', () => {
+        globalThis.Module._rd_sweep.mockReturnValueOnce(0);
+        expect(rdSweep(444, [50], 1)).toBeNull();
+        expect(globalThis.Module._rd_sweep).toHaveBeenCalledWith(444, 1, 256, 1);
+        expect(rdSweep(444, [])).toBeNull();
+    });
+});
+
 describe('getHeapU8', () => {
     it('returns Module.HEAPU8', () => {
         expect(getHeapU8()).toBe(globalThis.Module.HEAPU8);